@@ -4,19 +4,83 @@
 #include <sys/types.h>
 
 #include "common_includes.h"
+#include "disk_layer.h"
 
 #define ALLOCATE_DATA_BLOCK "allocate_data_block"
+#define COUNT_FREE_DATA_BLOCKS "count_free_data_blocks"
 #define FREE_DATA_BLOCK "free_data_block"
+#define FREE_DATA_BLOCKS "free_data_blocks"
 #define READ_DATA_BLOCK "read_data_block"
 #define WRITE_DATA_BLOCK "write_data_block"
 
+#define BLOCK_RESERVATION_SLOTS ((ssize_t) 64)
+#define BLOCK_RESERVATION_WINDOW ((ssize_t) 16)     // blocks kept free after a file's last allocated block
+#define BLOCK_RESERVATION_LIFETIME ((ssize_t) 4096) // allocations (by anyone) after which an unused window lapses
+#define FREED_BLOCK_SLOTS ((ssize_t) (2 * JOURNAL_MAX_BLOCKS))     // blocks freed by the running transaction tracked one by one, times 2
+
+/*
+A soft reservation: blocks [start, end) are left to owner (an inode number) by the other allocations,
+as long as they have other blocks to choose from. Nothing is written to disk for it.
+*/
+struct block_reservation {
+    ssize_t owner;      // 0 if the slot is empty
+    ssize_t start;
+    ssize_t end;
+    ssize_t last_used;  // allocation count when the window was last moved
+};
+
 /*
-Allocate a new data block
+Allocate a new data block from the allocation group of the calling thread (or the next group with free
+blocks, if it has none).
 
 @return Data block number on success or -1 on failure
 */
 ssize_t allocate_data_block();
 
+/*
+Allocate a new data block as close as possible after a goal block, among the blocks of the goal's
+allocation group that can be handed out without extra reads. If owner is given, the blocks right after the new block are reserved for it.
+Blocks freed by the running journal transaction are not handed out until it commits, as their old file
+still owns them on disk until then.
+
+@param goal: The preferred block number (usually one past the file's last block), or 0 for no preference.
+@param owner: Inode number of the file the block is for, or 0 for no reservation.
+
+@return Data block number on success or -1 on failure
+*/
+ssize_t allocate_data_block_near(ssize_t goal, ssize_t owner);
+
+/*
+Hold back free data blocks for an allocation that will happen later (the blocks of delayed writes).
+allocate_data_block_near does not hand out the last held blocks until they are given back.
+
+@param count: Number of blocks.
+
+@return True if that many free blocks were not held yet, false if they were (nothing is held then).
+*/
+bool hold_data_blocks(ssize_t count);
+
+/*
+Give back held data blocks: right before allocating them, or when they are no longer needed.
+
+@param count: Number of blocks.
+*/
+void release_held_data_blocks(ssize_t count);
+
+/*
+Number of free data blocks that are not held for delayed writes.
+
+@return The number of blocks.
+*/
+ssize_t get_available_data_blocks();
+
+/*
+Drop the block reservation of a file, if it has one. Call once it stops growing (truncate, unlink).
+
+@param owner: Inode number of the file.
+*/
+void release_block_reservation(ssize_t owner);
+
 /*
 Read information contained in a data block.
 
@@ -36,6 +100,17 @@ Write information to a data block
 */
 bool write_data_block(ssize_t index, char* buffer);
 
+/*
+Write a data block that holds file system metadata (directory entries, indirect block pointers) as
+part of the running journal transaction.
+
+@param index: The data block number.
+@param buf: the buffer which contains data to write
+
+@return Success or failure
+*/
+bool write_metadata_block(ssize_t index, char* buffer);
+
 /*
 Free a data block.
 
@@ -45,4 +120,25 @@ Free a data block.
 */
 bool free_data_block(ssize_t index);
 
+/*
+Free many data blocks at once: each allocation group is locked once and each of its freelist blocks is
+read and written once, instead of once per block.
+
+@param blocks: The data block numbers, in any order.
+@param count: Number of blocks.
+
+@return True if all of them were freed.
+*/
+bool free_data_blocks(const ssize_t* blocks, ssize_t count);
+
+/*
+Count the free data blocks by walking the freelist of every allocation group. Used to repair the free
+block counts, which the allocator keeps up to date otherwise.
+
+@param repair: If true, the count of every group and s_free_blocks_count are set to what was found.
+
+@return Number of free data blocks, or -1 on failure.
+*/
+ssize_t count_free_data_blocks(bool repair);
+
 #endif
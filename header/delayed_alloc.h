@@ -0,0 +1,94 @@
+#ifndef __DELAYED_ALLOC__
+#define __DELAYED_ALLOC__
+
+#include <sys/types.h>
+
+#include "common_includes.h"
+#include "superblock_layer.h"
+
+#define FLUSH_DELAYED_BLOCKS "flush_delayed_blocks"
+#define PREPARE_DELAYED_WRITE "prepare_delayed_write"
+
+#define DELAYED_ALLOC_SLOTS ((ssize_t) 16)
+#define DELAYED_ALLOC_MAX_BLOCKS ((ssize_t) 64)     // blocks buffered per file before it has to be flushed
+#define DELAYED_ALLOC_METADATA_BLOCKS ((ssize_t) 3) // indirect blocks a flush may need on top of the data blocks
+
+/*
+Data written past the last allocated block of a regular file is kept in memory, with data blocks
+reserved for it but not allocated. Blocks are only allocated (all at once, one after the other) when
+the file is flushed: before it is read or truncated, when its buffer is full, when another file needs
+the slot, and on unmount. statfs counts the reserved blocks as used.
+
+The blocks in data follow the file's allocated blocks: data[0] is logical block first_block, which is
+always the i_blocks_num of the inode. Until the flush, the inode on disk keeps the size of the data
+that has blocks, and file_size is the size including the buffered data.
+*/
+struct delayed_file {
+    ssize_t inum;           // 0 if the slot is empty
+    ssize_t first_block;
+    ssize_t num_blocks;     // blocks of data in use
+    ssize_t reserved;       // data blocks held for the flush (num_blocks + DELAYED_ALLOC_METADATA_BLOCKS)
+    ssize_t file_size;
+    char* data;             // DELAYED_ALLOC_MAX_BLOCKS * BLOCK_SIZE bytes
+};
+
+/*
+Get ready to buffer a write that reaches past the allocated blocks of a file, reserving the data blocks
+it will need. The file in the same slot, if any, is flushed first.
+
+@param node: The inode of the file (a regular file without inline data).
+@param inum: The inode number of the file.
+@param offset: Offset of the write.
+@param nbytes: Length of the write.
+
+@return True if the part of the write past the allocated blocks can be given to write_delayed_blocks,
+false if it has to be written (and its blocks allocated) right away, after flush_delayed_blocks.
+*/
+bool prepare_delayed_write(const struct inode* const node, ssize_t inum, off_t offset, size_t nbytes);
+
+/*
+Copy data to the buffer of a file. Only for a range past the allocated blocks that was accepted by
+prepare_delayed_write.
+
+@param inum: The inode number of the file.
+@param buff: The data.
+@param nbytes: Length of the data.
+@param offset: Offset in the file.
+*/
+void write_delayed_blocks(ssize_t inum, const char* buff, size_t nbytes, off_t offset);
+
+/*
+Allocate blocks for the buffered data of a file and write it out.
+
+@param inum: The inode number of the file.
+@param node: The inode of the file, updated but not written; or NULL to have the inode read and written here.
+
+@return True if success (or nothing was buffered), false if failure.
+*/
+bool flush_delayed_blocks(ssize_t inum, struct inode* node);
+
+/*
+Flush the buffered data of every file.
+
+@return True if all of it was written.
+*/
+bool flush_all_delayed_blocks();
+
+/*
+Throw away the buffered data of a file that is being deleted, and its reservation.
+
+@param inum: The inode number of the file.
+*/
+void drop_delayed_blocks(ssize_t inum);
+
+/*
+Size of a file including its buffered data.
+
+@param inum: The inode number of the file.
+@param disk_file_size: i_file_size of the inode.
+
+@return The larger of the two sizes.
+*/
+ssize_t get_delayed_file_size(ssize_t inum, ssize_t disk_file_size);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef __DIRECTORY_CACHE__
+#define __DIRECTORY_CACHE__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "common_includes.h"
+#include "superblock_layer.h"
+
+#define DIR_CACHE_BUILD "dir_cache_build"
+
+#define DIR_CACHE_SETS ((ssize_t) 64)
+#define DIR_CACHE_WAYS ((ssize_t) 4)    // entries per set
+#define DIR_BLOOM_BITS_PER_BLOCK ((ssize_t) 2048)  // about 16 bits per record of a typical block
+#define DIR_BLOOM_PROBES 4
+
+/*
+In-memory metadata kept per directory, used to speed up directory operations.
+
+A directory is identified by the physical number of its first data block: a directory keeps that
+block for as long as it exists, and no two live directories share one. Directories without data
+blocks have nothing worth caching. The key picks one of DIR_CACHE_SETS sets of DIR_CACHE_WAYS entries;
+a directory cached in a full set replaces the least recently used entry of the set.
+
+free_bytes[l] is the length of the longest record that fits in logical block l of the directory (see
+get_dir_block_free_space).
+The table is only a hint: whoever uses it must check the block itself before writing to it.
+
+bloom is a Bloom filter over the names of the directory's records, used to answer lookups of names
+that are not there without reading any block. Every name written to the directory is added to it;
+names removed are not taken out, which only costs false positives. It is rebuilt together with the
+free space table, and dropped (to be rebuilt on the next lookup) once the directory outgrows it.
+*/
+struct dir_cache_entry {
+    ssize_t key;            // first data block of the directory, 0 if the slot is empty
+    ssize_t num_blocks;     // i_blocks_num of the directory when the table was last updated
+    uint64_t last_used;     // dirCacheClock when the entry was last used
+    ssize_t capacity;       // allocated length of free_bytes
+    unsigned short* free_bytes;
+    ssize_t bloom_bits;     // size of bloom in bits (a power of 2), 0 if there is no filter
+    uint64_t* bloom;
+};
+
+/*
+Room for a new record in a directory data block: the unused bytes after the last record, or the
+longest deleted record if that is longer.
+
+@param dblock: Contents of the data block.
+
+@return Length of the longest record that fits.
+*/
+ssize_t get_dir_block_free_space(const char* const dblock);
+
+/*
+Find a logical block of the directory that has room for a record of the given length.
+Builds the directory's free space table (reading every block once) if it is missing or stale.
+
+@param dir_inode: The directory inode.
+@param record_len: Total length of the record to be added.
+
+@return Logical block number, or -1 if no block is known to have room.
+*/
+ssize_t dir_cache_find_space(const struct inode* const dir_inode, ssize_t record_len);
+
+/*
+Record the free space of a directory block after it was changed.
+If the directory just grew by one block, the block is appended to the table; if the table is out of
+sync with the inode in any other way, it is dropped and rebuilt on the next lookup.
+
+@param dir_inode: The directory inode (with i_blocks_num already updated).
+@param l_block_num: Logical block number that changed.
+@param free_bytes: Room for a new record in that block (see get_dir_block_free_space).
+*/
+void dir_cache_update_space(const struct inode* const dir_inode, ssize_t l_block_num, ssize_t free_bytes);
+
+/*
+Record that a name was written to a directory, so that lookups of it get past the directory's filter.
+Must be called for every record added or renamed (after dir_cache_update_space, if both are called).
+
+@param dir_inode: The directory inode.
+@param name: The file name.
+@param name_len: Length of the name, without the \0.
+*/
+void dir_cache_add_name(const struct inode* const dir_inode, const char* const name, ssize_t name_len);
+
+/*
+Check a name against the directory's filter, building the filter (reading every block once) if it is
+missing or stale.
+
+@param dir_inode: The directory inode.
+@param name: The file name.
+@param name_len: Length of the name, without the \0.
+
+@return False only if the directory certainly has no record with this name.
+*/
+bool dir_cache_may_contain(const struct inode* const dir_inode, const char* const name, ssize_t name_len);
+
+/*
+Trim the table after blocks were removed from the end of a directory.
+
+@param dir_inode: The directory inode (with i_blocks_num already updated).
+*/
+void dir_cache_truncate(const struct inode* const dir_inode);
+
+/*
+Drop everything cached for a directory. Call before the directory's blocks are freed.
+
+@param dir_inode: The directory inode.
+*/
+void dir_cache_invalidate(const struct inode* const dir_inode);
+
+/*
+Drop everything cached for every directory.
+*/
+void flush_dir_cache();
+
+#endif
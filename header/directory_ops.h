@@ -13,21 +13,44 @@
 #define GET_FILE_POS_IN_DIR "get_file_position_in_dir"
 #define IS_DIR_EMPTY "is_dir_empty"
 #define NAME_I "name_i"
+#define REMOVE_DIRECTORY_ENTRY "remove_directory_entry"
+#define RENAME_DIRECTORY_ENTRY "rename_directory_entry_in_place"
+#define SET_DIRECTORY_ENTRY_INUM "set_directory_entry_inum"
 #define SETUP_FILESYSTEM "setup_filesystem"
 
 // Directory entry contants
 #define MAX_FILE_NAME_LENGTH ((ssize_t) 255)
 #define RECORD_LENGTH ((unsigned short) 2) // use unsigned short
 #define RECORD_INUM ((ssize_t) 8)   // TODO: Make sure search file, unlink (file layer), and altfs_readdir (fuse layer) use this and not INODE_SIZE while reading directory records
-#define RECORD_FIXED_LEN ((unsigned short)(RECORD_LENGTH + RECORD_INUM))
+#define RECORD_TYPE ((ssize_t) 1)
+#define RECORD_TAG ((ssize_t) 2)   // use unsigned short
+#define RECORD_TAG_OFFSET ((ssize_t)(RECORD_LENGTH + RECORD_INUM + RECORD_TYPE))
+#define RECORD_FIXED_LEN ((unsigned short)(RECORD_LENGTH + RECORD_INUM + RECORD_TYPE + RECORD_TAG))
+// The type byte holds the S_IFMT bits of the file's mode, which are also the DT_* values readdir reports
+#define MODE_TO_RECORD_TYPE(mode) ((unsigned char)(((mode) & S_IFMT) >> 12))
+#define RECORD_TYPE_TO_MODE(type) (((mode_t)(type)) << 12)
 #define LAST_POSSIBLE_RECORD ((ssize_t)(BLOCK_SIZE - RECORD_FIXED_LEN))
+#define MAX_RECORDS_PER_BLOCK ((ssize_t)(BLOCK_SIZE / (RECORD_FIXED_LEN + 1)))  // every record has at least a \0 for its name
+#define RECORD_DELETED_INUM ((ssize_t) 0)  // inodes 0 - 2 are reserved, so no file has inum 0
+#define INLINE_DIR_BLOCK_NUM ((ssize_t) 0)  // physical block "number" of the records of an inline directory (block 0 is the superblock)
+
+/*
+16 bit hash of a file name, stored in its directory record.
+
+@param name: The file name.
+@param name_len: Length of the name, without the \0.
+
+@return The tag.
+*/
+unsigned short get_name_tag(const char* const name, ssize_t name_len);
 
 /*
 Struct used to store the position of a file's inode inside it's parent directory
 */
 struct fileposition {
     char *p_block; // contents of physical data block
-    ssize_t p_plock_num; // physical data block number
+    ssize_t p_plock_num; // physical data block number, INLINE_DIR_BLOCK_NUM if the records are stored in the inode
+    ssize_t l_block_num; // logical block number of that block in the directory
     ssize_t offset; // offset in the dir's physical data block where the file's inode is stored
 };
 
@@ -70,20 +93,32 @@ bool copy_file_name(char* const buffer, const char* const path, ssize_t path_len
 
 /*
 A directory entry (record) in altfs looks like:
-[ Total entry length (2) | INUM (8) | Name (variable len) ]
+[ Total entry length (2) | INUM (8) | Type (1) | Tag (2) | Name (variable len) ]
 
-Total entry length is 2 + 8 + length of name in bytes.
-There are no holes in a single data block, so a total entry length of 0 means there are no records from that point on.
+Total entry length is 2 + 8 + 1 + 2 + length of name in bytes (including the \0).
+Records are laid out back to back from the start of the block, so a total entry length of 0 means there are no records from that point on.
+Live records never move; the room of removed ones is kept as deleted records, which a new record may reuse.
+A record renamed in place keeps its length, so the name may be followed by unused \0 bytes.
+A record with INUM RECORD_DELETED_INUM is a deleted record (tombstone) and must be skipped by readers.
 INUM is the inode number of the file being pointed to.
+Type is the file type (see MODE_TO_RECORD_TYPE), so that listing a directory needs no inode reads.
+Tag is a 16 bit hash of the name (see get_name_tag), so that a lookup can skip most records without comparing names.
 Name is the file name.
 
+A new directory (INODE_FLAG_INLINE_DATA set) keeps its records in the inode, in place of the block
+pointers. When a record no longer fits there, the records are moved, unchanged and at the same
+offsets, to the start of a newly allocated first data block. Records of an inline directory are
+only updated in the inode in memory: the caller writes the directory inode, as it does after any
+change of i_child_num.
+
 @param dir_inode: Double pointer to the directory (parent) inode.
 @param child_inum: Inode number of the file being added as an entry.
+@param child_mode: Mode of the file being added (only the file type bits are stored).
 @param file_name: Name of the file being added.
 
 @return true or false
 */
-bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, char* file_name);
+bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, mode_t child_mode, char* file_name);
 
 /*
 Remove record for a file from a directory's records.
@@ -95,6 +130,74 @@ Remove record for a file from a directory's records.
 */
 bool remove_directory_entry(struct inode** dir_inode, char* file_name);
 
+/*
+Remove a record that has already been located with get_file_position_in_dir().
+The record is marked deleted in place and joined with the deleted records next to it, for a later
+add_directory_entry to reuse; the other records do not move, except in an inline directory, which is
+compacted. Empty blocks at the end of the directory are freed.
+
+@param dir_inode: Double pointer to the directory (parent) inode.
+@param file_pos: Position of the record. file_pos->p_block must hold the current contents of the block, and is updated.
+
+@return true or false
+*/
+bool remove_directory_entry_at(struct inode** dir_inode, const struct fileposition* const file_pos);
+
+/*
+Overwrite the name of a located record, keeping its length and position.
+
+@param dir_inode: The directory holding the record (updated, not written, if it is inline).
+@param file_pos: Position of the record. file_pos->p_block is updated and written back.
+@param new_name: New file name.
+
+@return False if the new name does not fit in the record (nothing is written), or on a write error.
+*/
+bool rename_directory_entry_in_place(struct inode* dir_inode, const struct fileposition* const file_pos, const char* const new_name);
+
+/*
+Point a located record at a different inode.
+
+@param dir_inode: The directory holding the record (updated, not written, if it is inline).
+@param file_pos: Position of the record. file_pos->p_block is updated and written back.
+@param child_inum: The new inode number.
+@param child_mode: Mode of the new inode (only the file type bits are stored).
+
+@return true or false
+*/
+bool set_directory_entry_inum(struct inode* dir_inode, const struct fileposition* const file_pos, ssize_t child_inum, mode_t child_mode);
+
+/*
+Number of blocks of records in a directory. An inline directory has one, held in its inode.
+
+@param dir_inode: The directory inode.
+
+@return Number of blocks.
+*/
+ssize_t get_directory_block_count(const struct inode* const dir_inode);
+
+/*
+Read a block of a directory's records.
+
+@param dir_inode: The directory inode.
+@param l_block_num: Logical block number.
+@param prev_block: See get_disk_block_from_inode_block.
+@param p_block_num: Set to the physical block number, or to INLINE_DIR_BLOCK_NUM for an inline directory.
+
+@return Contents of the block (BLOCK_SIZE bytes, to be freed by the caller), or NULL.
+*/
+char* read_directory_block(const struct inode* const dir_inode, ssize_t l_block_num, ssize_t* prev_block, ssize_t* p_block_num);
+
+/*
+Re-read the block of a located record, after the directory was changed through another position.
+If the directory was inline and has since moved to a data block, the position is moved along with it.
+
+@param dir_inode: The directory inode.
+@param file_pos: Position of the record.
+
+@return true or false
+*/
+bool reload_file_position(const struct inode* const dir_inode, struct fileposition* file_pos);
+
 /*
 Return position of file in dir
 
@@ -114,7 +217,8 @@ Sets up the file system.
 bool setup_filesystem();
 
 /*
-Get inum for given file path
+Get inum for given file path. Resolution starts from the deepest prefix of the path found in the
+inode cache, and every prefix resolved on the way is added to the cache.
 
 @param file_path: File path whose inode number is required
 
@@ -123,11 +227,11 @@ Get inum for given file path
 ssize_t name_i(const char* const file_path);
 
 /*
-Helper to remove a path's entry from the inode cache.
+Helper to remove a path's entry, and the entries of every path beneath it, from the inode cache.
 
 @param path: Full path of the entry to be removed.
 
-@return True is success, false if failure.
+@return True if any entry was removed, false if nothing under the path was cached.
 */
 bool remove_from_inode_cache(const char* path);
 
@@ -1,12 +1,19 @@
 #ifndef __DISK_LAYER__
 #define __DISK_LAYER__
 
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
 #include "common_includes.h"
 
 #define ALTFS_ALLOC_MEMORY "altfs_alloc_memory"
 #define ALTFS_DEALLOC_MEMORY "altfs_dealloc_memory"
 #define ALTFS_READ_BLOCK "altfs_read_block"
 #define ALTFS_WRITE_BLOCK "altfs_write_block"
+#define ALTFS_PREFETCH_BLOCKS "altfs_prefetch_blocks"
+#define ALTFS_JOURNAL "altfs_journal"
 
 #ifdef DISK_MEMORY
     #define DEVICE_NAME "/dev/vdb"
@@ -19,6 +26,46 @@
 
 #define BLOCK_COUNT ((ssize_t) (FS_SIZE/BLOCK_SIZE))
 
+#define PREFETCH_CACHE_SLOTS ((ssize_t) 1024)   // blocks kept after being read ahead
+#define PREFETCH_QUEUE_SIZE ((ssize_t) 256)     // blocks waiting for the prefetch thread
+
+/*
+Metadata journal, kept in the last JOURNAL_BLOCK_COUNT blocks of the volume: a header block, the
+descriptor blocks (the home block ids of the logged blocks) and the logged blocks themselves. Only the
+last committed transaction is kept. Its blocks are written to the log, then the header (with the
+checksum of the descriptors and logged blocks), and one flush makes the transaction durable. The blocks
+are then written home, and once that is flushed the header count goes back to 0. At mount, a header with
+a count and a matching checksum has its blocks written home again.
+*/
+#define JOURNAL_MAX_BLOCKS ((ssize_t) 2048)     // blocks one transaction can log
+#define JOURNAL_OPERATION_BLOCKS ((ssize_t) 256)    // blocks one operation may log (see altfs_journal_start)
+#define JOURNAL_IDS_PER_BLOCK ((ssize_t) (BLOCK_SIZE / sizeof(int64_t)))
+#define JOURNAL_DESCRIPTOR_BLOCKS ((ssize_t) ((JOURNAL_MAX_BLOCKS + JOURNAL_IDS_PER_BLOCK - 1) / JOURNAL_IDS_PER_BLOCK))
+#define JOURNAL_BLOCK_COUNT ((ssize_t) (1 + JOURNAL_DESCRIPTOR_BLOCKS + JOURNAL_MAX_BLOCKS))
+#define JOURNAL_FIRST_BLOCK ((ssize_t) (BLOCK_COUNT - JOURNAL_BLOCK_COUNT))    // the header block
+#define JOURNAL_FIRST_LOG_BLOCK ((ssize_t) (JOURNAL_FIRST_BLOCK + 1 + JOURNAL_DESCRIPTOR_BLOCKS))
+#define JOURNAL_INDEX_SLOTS ((ssize_t) (2 * JOURNAL_MAX_BLOCKS))
+#define JOURNAL_COMMIT_BLOCKS ((ssize_t) (JOURNAL_MAX_BLOCKS * 3 / 4))   // a transaction this full is committed when its operations end
+#define JOURNAL_MAGIC ((uint64_t) 0x314c4e524a544c41ull)   // "ALTJRNL1"
+
+// Longest time (in seconds) a transaction stays in memory, checked whenever an operation ends.
+#ifndef JOURNAL_COMMIT_INTERVAL
+#define JOURNAL_COMMIT_INTERVAL ((time_t) 5)
+#endif
+
+// Time (in microseconds) a batched sync waits for other syncs to share its device flush with.
+#ifndef SYNC_BATCH_WINDOW
+#define SYNC_BATCH_WINDOW ((useconds_t) 2000)
+#endif
+
+struct journal_header
+{
+    uint64_t j_magic;       // JOURNAL_MAGIC
+    uint64_t j_sequence;    // number of the last committed transaction
+    int64_t j_count;        // blocks logged by that transaction, 0 once they are all home
+    uint64_t j_checksum;    // FNV-1a of its descriptor blocks and logged blocks
+};
+
 // Allocates memory - returns true on success
 bool altfs_alloc_memory(bool erase);
 
@@ -34,4 +81,123 @@ bool altfs_read_block(ssize_t blockid, char *buffer);
 // Open the mounted volume
 bool altfs_open_volume();
 
+/*
+Write an empty journal to the journal region. Part of mkfs.
+
+@return true if success, false if failure.
+*/
+bool altfs_format_journal();
+
+/*
+Replay the last committed transaction if its blocks may not all be home, and start journaling: from
+here on altfs_journal_block adds blocks to the running transaction. Call at mount, before anything
+else is read from the volume.
+
+@return true if success, false if there is no journal (run mkfs again) or it could not be replayed.
+*/
+bool altfs_replay_journal();
+
+/*
+@return true once altfs_replay_journal started journaling, until unmount.
+*/
+bool altfs_journal_enabled();
+
+/*
+@return The number of the last committed transaction; the running one is the next.
+*/
+uint64_t altfs_journal_sequence();
+
+/*
+@param blockid: The block id.
+
+@return true if the block was logged in the running transaction.
+*/
+bool altfs_journal_logged(ssize_t blockid);
+
+/*
+Commit the running transaction as soon as possible: right away if no operation is running, else when
+the running ones have ended (new ones wait for it).
+*/
+void altfs_journal_request_commit();
+
+/*
+Write a metadata block as part of the running transaction. Until the transaction is committed,
+altfs_read_block returns the block from it, and altfs_write_block to the block updates it there.
+Writes the block right away when journaling was not started.
+
+A transaction is committed when no operation is running and it is JOURNAL_COMMIT_BLOCKS blocks full or
+JOURNAL_COMMIT_INTERVAL seconds old, when an operation does not fit in it any more, on
+altfs_journal_commit and at unmount; so the operations that ran at the same time share one commit, and
+an operation is always committed whole.
+
+@param blockid: The block id.
+@param buffer: The new contents of the block.
+
+@return true if success, false if failure.
+*/
+bool altfs_journal_block(ssize_t blockid, char *buffer);
+
+/*
+Mark the start of an operation: its metadata blocks are not committed without the rest of them.
+Each call is paired with an altfs_journal_stop.
+
+An operation logs at most JOURNAL_OPERATION_BLOCKS blocks; larger ones are split with
+altfs_journal_restart. Room for that is kept in the running transaction for every running operation:
+when a new one does not fit, it waits until the running ones have ended and the transaction is
+committed.
+*/
+void altfs_journal_start();
+
+/*
+Mark the end of an operation, and commit the running transaction if it is due.
+
+@return true if success (or nothing to commit), false if the commit failed.
+*/
+bool altfs_journal_stop();
+
+/*
+End the operation the calling thread is in and start another one, for an operation that would log more
+than JOURNAL_OPERATION_BLOCKS blocks. The blocks logged so far may then be committed without the rest:
+call where the file system is consistent. Does nothing outside of an operation.
+
+@return Same as altfs_journal_stop.
+*/
+bool altfs_journal_restart();
+
+/*
+Commit the running transaction once the operations running now have ended. Operations that start in
+the meantime wait for the commit. Not to be called between altfs_journal_start and altfs_journal_stop.
+
+@return true if success (or nothing to commit), false if failure.
+*/
+bool altfs_journal_commit();
+
+/*
+Make everything written so far durable: commit the running transaction (as altfs_journal_commit) and
+flush the device.
+
+@return true if success, false if failure.
+*/
+bool altfs_sync_volume();
+
+/*
+Same as altfs_sync_volume, shared with the other threads that sync within SYNC_BATCH_WINDOW: the first
+one waits for the window to pass and syncs for all of them.
+
+@return true if success, false if failure.
+*/
+bool altfs_sync_volume_batched();
+
+/*
+Queue blocks to be read ahead by the prefetch thread (started on the first call). altfs_read_block
+returns a prefetched block without going to the device, and altfs_write_block drops it. Blocks that
+are already cached or queued are skipped, and so are the ones that do not fit in the queue.
+
+@param blockids: The block ids.
+@param count: Number of block ids.
+
+@return Number of blocks queued.
+*/
+ssize_t altfs_prefetch_blocks(const ssize_t* blockids, ssize_t count);
+
 #endif 
@@ -1,30 +1,101 @@
 #ifndef __INODE_CACHE__
 #define __INODE_CACHE__
 
+#include <stdint.h>
+
 #include "common_includes.h"
 
+#define CACHE_MIN_BUCKETS ((ssize_t) 1024)
+#define CACHE_MAX_LOAD_NUM ((ssize_t) 3)   // resize when size > buckets * 3/4
+#define CACHE_MAX_LOAD_DEN ((ssize_t) 4)
+
+/*
+An entry sits on two independent lists:
+- prev/next: the LRU list (head = most recently used).
+- hash_next: the chain of its hash bucket.
+The key is stored inline after the entry, so an entry is a single allocation.
+
+Entries are also linked to the cached entry of their parent path (parent/first_child/siblings), so
+a directory's cached subtree can be dropped without touching the rest of the cache. Using an entry
+also refreshes its ancestors, which keeps every ancestor ahead of its descendants in LRU order: the
+LRU tail is therefore always a leaf.
+An entry whose parent path was not cached when it was inserted is an orphan. Orphans are kept on
+their own list (through the sibling links) which invalidation scans by prefix.
+*/
 struct cache_entry {
     struct cache_entry* prev;
     struct cache_entry* next;
-    char* key;
+    struct cache_entry* hash_next;
+    struct cache_entry* parent;
+    struct cache_entry* first_child;
+    struct cache_entry* prev_sibling;
+    struct cache_entry* next_sibling;
+    uint64_t hash;
+    bool orphan;
     ssize_t value;
+    size_t key_len;
+    char key[];
 };
 
 struct inode_cache {
     ssize_t size;
     ssize_t capacity;
+    ssize_t num_buckets;    // always a power of 2
+    ssize_t num_orphans;
     struct cache_entry** map;
     struct cache_entry* head;
     struct cache_entry* tail;
+    struct cache_entry* orphans;
 };
 
+#define PATH_HASH_SEED ((uint64_t) 0x243f6a8885a308d3ull)
+
+/*
+64-bit hash of a path. The path is split at '/' and the components are hashed (wyhash) and chained
+one at a time, so that the hash of every prefix ending before a '/' comes out of the same pass:
+path_hash("/a/b") == path_hash_component(path_hash("/a"), "b", 1).
+
+@param key: Bytes to hash.
+@param len: Number of bytes.
+
+@return The hash value.
+*/
+uint64_t path_hash(const char* key, size_t len);
+
+/*
+Extend the hash of a path by one more component.
+
+@param hash: Hash of the path so far (PATH_HASH_SEED for no components).
+@param component: The component, without any '/'.
+@param len: Length of the component.
+
+@return Hash of the extended path.
+*/
+uint64_t path_hash_component(uint64_t hash, const char* component, size_t len);
+
 struct inode_cache* create_inode_cache(ssize_t capacity);
 
+/*
+Remove a path and every cached path beneath it.
+
+@param cache: The cache.
+@param key: Path to invalidate.
+
+@return True if anything was removed.
+*/
 bool remove_cache_entry(struct inode_cache* cache, const char* key);
 
 void set_cache_entry(struct inode_cache* cache, const char* key, ssize_t value);
 
 ssize_t get_cache_entry(struct inode_cache* cache, const char* key);
 
+/*
+Variants of set_cache_entry and get_cache_entry for a key that is a prefix of a longer string, with a
+hash already computed with path_hash().
+*/
+void set_cache_entry_hashed(struct inode_cache* cache, const char* key, size_t key_len, uint64_t hash, ssize_t value);
+
+ssize_t get_cache_entry_hashed(struct inode_cache* cache, const char* key, size_t key_len, uint64_t hash);
+
 void free_inode_cache(struct inode_cache* cache);
-#endif
\ No newline at end of file
+#endif
@@ -7,6 +7,8 @@
 #include "superblock_layer.h"
 
 #define ADD_DATABLOCK_TO_INODE "add_datablock_to_inode"
+#define MOVE_DATA_INLINE "move_data_inline"
+#define MOVE_INLINE_DATA_TO_BLOCK "move_inline_data_to_block"
 #define OVERWRITE_DATABLOCK_TO_INODE "overwrite_datablock_to_inode"
 #define REMOVE_DATABLOCKS_FROM_INODE "remove_datablocks_from_inode"
 #define REMOVE_DATABLOCKS_UTILITY "remove_datablocks_utility"
@@ -48,4 +50,39 @@ Remove a data block to an existing inode
 */
 bool remove_datablocks_from_inode(struct inode* inodeObj, const ssize_t file_block_num);
 
+/*
+Move the contents of a file stored inline into a newly allocated data block, so that the file can
+grow past INODE_INLINE_DATA_SIZE bytes. The inode is updated but not written.
+
+@param inodeObj: The pointer to the inode of the file, with INODE_FLAG_INLINE_DATA set
+
+@param inum: The inode number of the file
+
+@return bool: true if operation is successful
+*/
+bool move_inline_data_to_block(struct inode* inodeObj, ssize_t inum);
+
+/*
+Pick the block a file's next data block should be allocated near: the block after its last data block,
+or for a file without data blocks, a block in its inode's allocation group.
+
+@param inodeObj: The pointer to the inode of the file
+
+@param inum: The inode number of the file
+
+@return The goal block number, to pass to allocate_data_block_near
+*/
+ssize_t get_allocation_goal(const struct inode* const inodeObj, ssize_t inum);
+
+/*
+Store the first bytes of a file inline, freeing all of its data blocks. The inode is updated but not written.
+
+@param inodeObj: The pointer to the inode of the file, without INODE_FLAG_INLINE_DATA set
+
+@param length: Number of bytes to keep (at most INODE_INLINE_DATA_SIZE, and at most the file size)
+
+@return bool: true if operation is successful
+*/
+bool move_data_inline(struct inode* inodeObj, ssize_t length);
+
 #endif
@@ -10,6 +10,8 @@
 #define FREE_INODE "free_inode"
 #define GET_DBLOCK_FROM_IBLOCK "get_disk_block_from_inode_block"
 #define GET_INODE "get_inode"
+#define GET_INODES "get_inodes"
+#define LOAD_INODE_BITMAP "load_inode_bitmap"
 #define WRITE_INODE "write_inode"
 
 #define ROOT_INODE_NUM ((ssize_t) 2)
@@ -22,12 +24,39 @@
 #define DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR ((ssize_t) (NUM_OF_DIRECT_BLOCKS + NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR + NUM_OF_DOUBLE_INDIRECT_BLOCK_ADDR))
 
 /*
-Allocates a new inode.
+Build the in-memory inode bitmap (one bit per inode, set if allocated) and the free inode and directory
+counts of every allocation group, by reading every inode block once. Also moves s_first_ino down to
+the lowest free inode. Called when the file system is mounted; allocate_inode calls it if needed.
+
+@return True if success, false if failure.
+*/
+bool load_inode_bitmap();
+
+/*
+Drop the in-memory inode bitmap.
+*/
+void free_inode_bitmap();
+
+/*
+Allocates a new inode: the lowest free inode number, found in the in-memory inode bitmap.
 
 @return Inode number or -1.
 */
 ssize_t allocate_inode();
 
+/*
+Allocates a new inode for a file about to be made in a directory. A directory made in the root directory
+goes to a group with more free inodes and blocks than average and the fewest directories, so that top
+level trees are spread over the disk; anything else goes to its parent's group (or the next group with a
+free inode), so that it stays close to its siblings.
+
+@param parent_inum: Inode number of the directory the file is made in.
+@param mode: Mode of the new file, to tell directories apart.
+
+@return Inode number or -1.
+*/
+ssize_t allocate_inode_for(ssize_t parent_inum, mode_t mode);
+
 /*
 Gets the inode corresponding to the given number.
 
@@ -37,6 +66,17 @@ Gets the inode corresponding to the given number.
 */
 struct inode* get_inode(ssize_t inum);
 
+/*
+Get several inodes at once, reading each inode block only once.
+
+@param inums: The inode numbers.
+@param count: Number of inode numbers.
+@param nodes: Array of count inodes, filled in the same order as inums. Inodes that could not be read are zeroed.
+
+@return True if all the inodes were read.
+*/
+bool get_inodes(const ssize_t* const inums, ssize_t count, struct inode* nodes);
+
 /*
 Write the inode to the given number.
 
@@ -1,6 +1,7 @@
 #ifndef __INTERFACE_LAYER__
 #define __INTERFACE_LAYER__
 
+#include <sys/statvfs.h>
 #include <sys/types.h>
 
 #include "common_includes.h"
@@ -8,19 +9,39 @@
 #define ACCESS "altfs_access"
 #define CHMOD "altfs_chmod"
 #define CLOSE "altfs_close"
+#define FLUSH "altfs_flush"
 #define GETATTR "altfs_getattr"
+#define INIT "altfs_init"
 #define MKDIR "altfs_mkdir"
 #define MKNOD "altfs_mknod"
 #define OPEN "altfs_open"
 #define READ "altfs_read"
 #define READDIR "altfs_readdir"
 #define RENAME "altfs_rename"
+#define SYNC "altfs_sync"
 #define TRUNCATE "altfs_truncate"
 #define UNLINK "altfs_unlink"
 #define WRITE "altfs_write"
 
-// Wrapper over setup_filesystem()
-bool altfs_init();
+#define OPERATION_BATCH_BLOCKS ((ssize_t) 1024)    // blocks a write allocates or a truncate frees per journal operation
+
+/*
+What altfs_sync does, chosen at mount.
+STRICT: commit the journal and flush the device on every call.
+BATCHED: the calls made within SYNC_BATCH_WINDOW share one commit and device flush.
+NONE: nothing; the data and metadata reach the disk with the next commit.
+*/
+enum durability_mode { DURABILITY_STRICT, DURABILITY_BATCHED, DURABILITY_NONE };
+
+/*
+Wrapper over setup_filesystem() that also checks the free space counters.
+
+@param recount: Set true to recount the free data blocks by walking the freelist, for when the
+counter in the superblock may be stale (the free inode count is always rebuilt from the inodes).
+
+@return True if success, false if failure.
+*/
+bool altfs_init(bool recount);
 
 /*
 Get attributes for the file at path.
@@ -56,11 +77,14 @@ Read contents of a directory.
 
 @param path: A c-string that contains the full path.
 @param buff: The buffer to fill with the info.
-@param filler: Helper function to fill the buffer with data.
+@param filler: Helper function to fill the buffer with data. Listing stops when it returns non-zero.
+@param offset: 0 to start from the beginning, or an offset that was passed to filler to resume after that entry.
+@param flags: With FUSE_READDIR_PLUS, entries are filled with full attributes (FUSE_FILL_DIR_PLUS).
+Otherwise only the inode number and file type are filled, and no inodes are read.
 
 @return 0 if successful, -errno otherwise.
 */
-ssize_t altfs_readdir(const char* path, void* buff, fuse_fill_dir_t filler);
+ssize_t altfs_readdir(const char* path, void* buff, fuse_fill_dir_t filler, off_t offset, enum fuse_readdir_flags flags);
 
 /*
 Create a special file.
@@ -94,8 +118,43 @@ Open a file.
 */
 ssize_t altfs_open(const char* path, ssize_t oflag);
 
+/*
+Close a file opened for writing, writing out what its write buffer still holds.
+
+@param file_descriptor: The handle returned by open_write_buffer, or 0 if the file has none.
+
+@return 0 if success, -errornum if a buffered write failed since the file was opened.
+*/
 ssize_t altfs_close(ssize_t file_descriptor);
 
+/*
+Write out the buffered data of a file (of every handle that holds some, and the blocks whose
+allocation was delayed), so that it is in the file system. Done on close and fsync.
+
+@param path: A c-string that contains the full path.
+@param file_descriptor: The handle returned by open_write_buffer, or 0 if the file has none.
+
+@return 0 if success, -errornum if a write out failed (or a buffered write of the handle did earlier).
+*/
+ssize_t altfs_flush(const char* path, ssize_t file_descriptor);
+
+/*
+Make what was written to the file system durable, as the durability mode asks. Call after altfs_flush
+for an fsync, outside of a journal operation.
+
+fdatasync does the same: the metadata it could leave out is only in the inode, which is synced anyway.
+
+@return 0 if success, -errornum if failure.
+*/
+ssize_t altfs_sync();
+
+/*
+Set the durability mode used by altfs_sync. DURABILITY_STRICT until set.
+
+@param mode: The mode.
+*/
+void altfs_set_durability(enum durability_mode mode);
+
 /*
 Read bytes from a file.
 
@@ -121,7 +180,21 @@ Write bytes to a file.
 ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t offset);
 
 /*
-Truncate a file to the given length.
+Write bytes to a file given by inode number, without looking up a path and without going through
+the write buffers.
+
+@param inum: The inode number of the file.
+@param buff: The bytes that need to be written to the file.
+@param n_bytes: The number of bytes that are to be written.
+@param offset: The byte-offset in the file from where the data is supposed to be written.
+
+@return Actual number of bytes written if data written, -1 if not written.
+*/
+ssize_t altfs_write_inum(ssize_t inum, const char* buff, size_t nbytes, off_t offset);
+
+/*
+Truncate a file to the given length. A long tail is freed OPERATION_BATCH_BLOCKS blocks at a time, each
+batch a journal operation of its own, like an orphan's.
 
 @param path: A c-string that contains the full path.
 @param length: The final length of the file.
@@ -141,7 +214,8 @@ Change the permission bits of the inode corresponding to the path.
 ssize_t altfs_chmod(const char* path, mode_t mode);
 
 /*
-Rename a file.
+Rename a file. A file that already exists at the final path is replaced.
+Renames within a directory rewrite the existing record in place when the new name fits in it.
 
 @param from: A c-string that contains the full existing path.
 @param to: A c-string that contains the full final path.
@@ -150,6 +224,15 @@ Rename a file.
 */
 ssize_t altfs_rename(const char *from, const char *to);
 
+/*
+Get file system statistics, from the counters kept in the superblock.
+
+@param st: The statvfs object to be filled.
+
+@return 0 if successful, -errno otherwise.
+*/
+ssize_t altfs_statfs(struct statvfs* st);
+
 /*
 Graceful shutdown of the filesystem
 */
@@ -0,0 +1,54 @@
+#ifndef __ORPHAN_LIST__
+#define __ORPHAN_LIST__
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "common_includes.h"
+#include "superblock_layer.h"
+
+#define ADD_ORPHAN "add_orphan"
+#define FREE_ORPHAN "free_orphan"
+
+#define ORPHAN_MIN_BLOCKS ((ssize_t) 1024)    // files with fewer blocks are freed by unlink itself
+#define ORPHAN_FREE_BATCH ((ssize_t) 1024)    // blocks freed per write of the orphan's inode
+
+/*
+Large files are deleted in the background. Unlink removes the directory entry, writes the inode with
+no links and records it in s_orphans of the superblock, in the same journal transaction. The orphan
+thread then frees the file's blocks from the end, ORPHAN_FREE_BATCH blocks at a time, and at last the
+inode.
+
+Each batch shortens the inode before its blocks go back on the freelists, and is one journal
+operation: a crash never frees a block twice. The orphans left by an unmount or a crash are picked up
+when the thread starts at the next mount. An entry whose inode still has links (the unlink did not
+reach the disk) is dropped.
+
+Orphans added while s_orphans is full go on s_orphan_chain instead, linked through i_next_orphan of
+their inodes and written in the same transaction as the unlink, like the list. The thread moves them
+to the list as entries leave it.
+*/
+
+/*
+Hand an unlinked file to the orphan thread.
+
+@param inum: The inode number of the file.
+@param node: The inode of the file, with no links left. Written here if the file becomes an orphan.
+
+@return True if the file is an orphan now, false if the caller has to free it (it is a directory,
+smaller than ORPHAN_MIN_BLOCKS, or could not be written).
+*/
+bool add_orphan(ssize_t inum, struct inode* node);
+
+/*
+Start the orphan thread, which frees the orphans on the list and then waits for new ones.
+*/
+void start_orphan_worker();
+
+/*
+Stop the orphan thread once it has finished its current batch. The orphans that are left stay on the
+list and the chain for the next start.
+*/
+void stop_orphan_worker();
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __READAHEAD__
+#define __READAHEAD__
+
+#include <sys/types.h>
+
+#include "common_includes.h"
+#include "superblock_layer.h"
+
+#define READAHEAD "readahead"
+
+#define READAHEAD_SLOTS ((ssize_t) 64)
+#define READAHEAD_MIN_BLOCKS ((ssize_t) 4)     // first window of a file that is read sequentially
+#define READAHEAD_MAX_BLOCKS ((ssize_t) 64)    // the window doubles up to this with every sequential window
+
+/*
+Readahead state of a file. A read that starts where the previous one ended (or in its last block) is
+sequential: the blocks after it are queued for the prefetch thread, window blocks at a time, together
+with the indirect blocks that map them. The next window is queued once the reader gets within half a
+window of the end of the queued blocks. A read anywhere else halves the window; below
+READAHEAD_MIN_BLOCKS readahead stops until the reads are sequential again.
+*/
+struct readahead_state {
+    ssize_t inum;           // 0 if the slot is empty
+    ssize_t next_block;     // logical block a sequential read continues from
+    ssize_t window;         // 0 while the reads look random
+    ssize_t ahead_until;    // logical blocks below this were queued already
+};
+
+/*
+Update the readahead state of a file after a read from its blocks, and queue the next window of blocks
+if the reads are sequential.
+
+@param node: The inode of the file (without inline data).
+@param inum: The inode number of the file.
+@param first_block: First logical block of the read.
+@param last_block: Last logical block of the read.
+*/
+void readahead_after_read(const struct inode* const node, ssize_t inum, ssize_t first_block, ssize_t last_block);
+
+#endif
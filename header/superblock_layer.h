@@ -1,7 +1,11 @@
 #ifndef __SUPERBLOCK_LAYER__
 #define __SUPERBLOCK_LAYER__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "common_includes.h"
 
@@ -15,54 +19,151 @@
 #define ALTFS_CREATE_ILIST "altfs_create_ilist"
 #define ALTFS_MAKEFS "altfs_makefs"
 #define ALTFS_SUPERBLOCK "altfs_create_superblock"
+#define SYNC_SUPERBLOCK "sync_superblock"
+
+// Longest time (in seconds) a change to the superblock stays in memory only, checked whenever the
+// superblock is changed. 0 leaves it in memory until sync or unmount. Only until the journal is
+// started: from then on every change is logged in the running transaction.
+#ifndef SUPERBLOCK_FLUSH_INTERVAL
+#define SUPERBLOCK_FLUSH_INTERVAL ((time_t) 5)
+#endif
 
 #define NUM_OF_DIRECT_BLOCKS ((ssize_t) 12)
 #define ADDRESS_SIZE ((ssize_t) 8)
 // TODO: check if all inodes have max size files, can disk handle the scenario
 #define INODE_BLOCK_COUNT ((ssize_t) (BLOCK_COUNT * 0.015)) // 1.5% blocks reserved for inodes TODO: Check if we can reduce this
-#define NUM_OF_DATA_BLOCKS ((ssize_t) (BLOCK_COUNT - INODE_BLOCK_COUNT - 1)) // -1 for superblock
+#define NUM_OF_DATA_BLOCKS ((ssize_t) (JOURNAL_FIRST_BLOCK - INODE_BLOCK_COUNT - 1)) // -1 for superblock, the journal comes after them
 #define NUM_OF_ADDRESSES_PER_BLOCK ((ssize_t) (BLOCK_SIZE / ADDRESS_SIZE)) // Assuming each address is 8B 
-#define NUM_OF_FREE_LIST_BLOCKS ((ssize_t) (NUM_OF_DATA_BLOCKS / NUM_OF_ADDRESSES_PER_BLOCK + 1)) // Num of free list blocks = data required to store that many addresses
+#define NUM_OF_INODES ((ssize_t) (INODE_BLOCK_COUNT * (BLOCK_SIZE / INODE_SIZE)))
+#define INODE_INLINE_DATA_SIZE ((ssize_t) ((NUM_OF_DIRECT_BLOCKS + 3) * ADDRESS_SIZE)) // the block pointers of an inode, reused for inline data
+
+// Inode flags (i_flags)
+#define INODE_FLAG_INLINE_DATA ((unsigned char) 0x1) // file contents are stored in i_inline_data, and the file has no data blocks
+
 
+#define INODE_SIZE ((ssize_t) 192)
+#define DISK_LAYOUT_VERSION ((ssize_t) 7) // bump whenever the on-disk layout of struct inode or struct superblock changes
+
+/*
+The data blocks and the inodes are split into allocation groups: group g owns ALLOCATION_GROUP_BLOCKS
+data blocks starting at GROUP_FIRST_BLOCK(g), with their own freelist, and INODES_PER_GROUP inodes
+starting at g * INODES_PER_GROUP. A group is a whole number of freelist blocks, and its inodes fill
+whole words of the inode bitmap. Each group has its own lock, so that allocations in different groups
+do not wait for each other.
+*/
+#define MAX_ALLOCATION_GROUPS ((ssize_t) 128)
+#define ALLOCATION_GROUP_BLOCKS ((ssize_t) (((NUM_OF_DATA_BLOCKS + MAX_ALLOCATION_GROUPS - 1) / MAX_ALLOCATION_GROUPS \
+    + NUM_OF_ADDRESSES_PER_BLOCK - 1) / NUM_OF_ADDRESSES_PER_BLOCK * NUM_OF_ADDRESSES_PER_BLOCK))
+#define NUM_OF_ALLOCATION_GROUPS ((ssize_t) ((NUM_OF_DATA_BLOCKS + ALLOCATION_GROUP_BLOCKS - 1) / ALLOCATION_GROUP_BLOCKS))
+#define INODES_PER_GROUP ((ssize_t) ((NUM_OF_INODES + NUM_OF_ALLOCATION_GROUPS - 1) / NUM_OF_ALLOCATION_GROUPS + 63) / 64 * 64)
+#define GROUP_FIRST_BLOCK(group) ((ssize_t) (INODE_BLOCK_COUNT + 1 + (group) * ALLOCATION_GROUP_BLOCKS))
+#define GROUP_END_BLOCK(group) ((ssize_t) (GROUP_FIRST_BLOCK((group) + 1) < JOURNAL_FIRST_BLOCK ? GROUP_FIRST_BLOCK((group) + 1) : JOURNAL_FIRST_BLOCK))
+#define BLOCK_TO_GROUP(block_num) ((ssize_t) (((block_num) - INODE_BLOCK_COUNT - 1) / ALLOCATION_GROUP_BLOCKS))
+#define INODE_TO_GROUP(inum) ((ssize_t) ((inum) / INODES_PER_GROUP))
 
 /* 
 Follows a structure similar to ext4.
 (https://www.kernel.org/doc/html/latest/filesystems/ext4/inodes.html?highlight=inode)
+
+This is the on-disk layout, so every field has a fixed width and an explicit offset (checked below).
+The fields used on every lookup, permission check and size check come first and share the first
+64 bytes with the start of the block pointers; the timestamps and owner are kept at the end.
 */
 struct inode 
 {
-    mode_t i_mode; // permission mode
-    id_t i_uid; // lower 16-bits of owner id
-    id_t i_gid; // lower 16-bits of group id
-    time_t i_status_change_time; // status change time
-    time_t i_atime; // last access time
-    time_t i_ctime; // last inode change time
-    time_t i_mtime; // last data modification time
-    nlink_t i_links_count; // hard link count
-    ssize_t i_file_size; // file size
-    ssize_t i_blocks_num; // num of blocks the file has
-    bool i_allocated; // flag to indicate if inode is allocated
-    // TODO: Kept number of direct blocks as 12 in sync with ext4
-    ssize_t i_direct_blocks[NUM_OF_DIRECT_BLOCKS];
-    ssize_t i_single_indirect; // stores block num for single indirect block
-    ssize_t i_double_indirect; // stores block num for double indirect block
-    ssize_t i_triple_indirect; // stores block num for triple indirect block
-    nlink_t i_child_num; // stores the current number of entries for a directory (minimum 2) or 0 for others
-    char padding;
+    uint32_t i_mode; // permission mode
+    uint8_t i_allocated; // flag to indicate if inode is allocated
+    uint8_t i_flags; // INODE_FLAG_* bits
+    uint16_t i_reserved; // zero
+    uint32_t i_links_count; // hard link count
+    uint32_t i_child_num; // stores the current number of entries for a directory (minimum 2) or 0 for others
+    int64_t i_file_size; // file size
+    int64_t i_blocks_num; // num of blocks the file has
+    // A small file with INODE_FLAG_INLINE_DATA set keeps its contents in place of the block pointers.
+    union {
+        struct {
+            // TODO: Kept number of direct blocks as 12 in sync with ext4
+            int64_t i_direct_blocks[NUM_OF_DIRECT_BLOCKS];
+            int64_t i_single_indirect; // stores block num for single indirect block
+            int64_t i_double_indirect; // stores block num for double indirect block
+            int64_t i_triple_indirect; // stores block num for triple indirect block
+        };
+        char i_inline_data[INODE_INLINE_DATA_SIZE]; // file contents, zero after i_file_size
+    };
+    union {
+        int64_t i_atime; // last access time
+        int64_t i_next_orphan; // of an orphan on the s_orphan_chain: the next inode on it, 0 at the end
+    };
+    int64_t i_mtime; // last data modification time
+    int64_t i_ctime; // last inode change time
+    int64_t i_status_change_time; // status change time
+    uint32_t i_uid; // owner id
+    uint32_t i_gid; // group id
 };
 
+_Static_assert(sizeof(struct inode) == INODE_SIZE, "struct inode does not match its on-disk size");
+_Static_assert(offsetof(struct inode, i_file_size) == 16 && offsetof(struct inode, i_blocks_num) == 24,
+    "struct inode hot fields moved");
+_Static_assert(offsetof(struct inode, i_direct_blocks) == 32 && offsetof(struct inode, i_atime) == 152,
+    "struct inode block pointers moved");
+_Static_assert(offsetof(struct inode, i_gid) + sizeof(uint32_t) == INODE_SIZE, "struct inode has padding");
+
+struct group_descriptor
+{
+    ssize_t g_freelist_head;    // data block number of the first block in the group's freelist, 0 if the group is full
+    ssize_t g_free_blocks_count; // number of data blocks on the group's freelist (including the freelist blocks)
+};
+
+#define MAX_ORPHANS ((ssize_t) 64)
+
 struct superblock
 {
     ssize_t s_inodes_count; // total number of inodes in the system
-    //ssize_t s_free_blocks_count;
     ssize_t s_first_ino; // first non-reserved inode
-    ssize_t s_freelist_head;    // data block number of the first block in freelist
-    //ssize_t s_inode_size; // ??? check if required or not
+    ssize_t s_groups_count; // number of allocation groups (NUM_OF_ALLOCATION_GROUPS)
+    ssize_t s_inode_size; // size of an on-disk inode (INODE_SIZE)
     ssize_t s_num_of_inodes_per_block;  // number of inodes in a single datablock
+    ssize_t s_layout_version; // DISK_LAYOUT_VERSION the file system was made with
+    ssize_t s_free_blocks_count; // number of data blocks on the freelists (including the freelist blocks)
+    ssize_t s_free_inodes_count; // number of unallocated inodes
+    struct group_descriptor s_groups[MAX_ALLOCATION_GROUPS];
+    ssize_t s_orphans_count; // number of entries in s_orphans
+    ssize_t s_orphans[MAX_ORPHANS]; // unlinked inodes whose blocks are still being freed (see orphan_list.h)
+    ssize_t s_orphan_chain; // first of the orphans that did not fit in s_orphans, 0 if none
 };
 
+_Static_assert(sizeof(struct superblock) <= BLOCK_SIZE, "struct superblock does not fit in block 0");
+
+/*
+Write the in-memory superblock to block 0 right away (as part of the running journal transaction).
+
+@return true if success, false if failure.
+*/
 bool altfs_write_superblock();
 
+/*
+Note that the in-memory superblock was changed. Once the journal is started it is logged here, in the
+same transaction as the blocks whose change it records. Before that it reaches the disk on the next
+sync_superblock (at sync and unmount), or here if SUPERBLOCK_FLUSH_INTERVAL seconds have passed since
+it was last written.
+*/
+void mark_superblock_dirty();
+
+/*
+Add to the free block and free inode totals of the superblock, and mark it dirty.
+
+@param blocks: Change in the number of free data blocks.
+@param inodes: Change in the number of free inodes.
+*/
+void update_superblock_free_counts(ssize_t blocks, ssize_t inodes);
+
+/*
+Write the superblock to the disk if it was changed since it was last written.
+
+@return true if success (or nothing to write), false if failure.
+*/
+bool sync_superblock();
+
 bool load_superblock();
 
 /*
@@ -85,4 +186,7 @@ void teardown();
 
 static struct superblock* altfs_superblock = NULL;
 
+// One lock per allocation group, guarding the group's freelist and descriptor and its part of the inode bitmap.
+extern pthread_mutex_t groupLocks[MAX_ALLOCATION_GROUPS];
+
 #endif
@@ -0,0 +1,109 @@
+#ifndef __WRITE_BUFFER__
+#define __WRITE_BUFFER__
+
+#include <sys/types.h>
+#include <time.h>
+
+#include "common_includes.h"
+
+#define BUFFERED_WRITE "buffered_write"
+#define FLUSH_WRITE_BUFFER "flush_write_buffer"
+
+#define WRITE_BUFFER_SLOTS ((ssize_t) 64)
+#define WRITE_BUFFER_SIZE ((ssize_t) (4 * BLOCK_SIZE))
+#ifndef WRITE_BUFFER_TIMEOUT
+#define WRITE_BUFFER_TIMEOUT 5 // seconds buffered data may wait for more writes before it is written out
+#endif
+
+/*
+Write buffer of a file opened for writing. Small writes that follow each other are collected here and
+written to the file with a single altfs_write_inum, once the buffer reaches the end of its last block
+(so that it is written as whole blocks), once it is WRITE_BUFFER_TIMEOUT seconds old, or when the file
+is synced, closed, read, truncated or stat'd by size. At most one handle of a file holds data at a time.
+
+A write out that fails after its write() call returned is reported by the next fsync or close of the
+handle.
+*/
+struct write_buffer {
+    bool in_use;
+    ssize_t inum;           // -1 once the file was deleted
+    off_t offset;           // file offset of data[0]
+    ssize_t length;         // bytes in data
+    time_t first_write;     // when the first byte in data was written
+    ssize_t error;          // -errno of a failed write out not reported yet, else 0
+    char* data;             // WRITE_BUFFER_SIZE bytes, allocated on the first write
+};
+
+/*
+Give a file that is being opened for writing a write buffer.
+
+@param inum: The inode number of the file.
+
+@return Handle of the buffer (> 0), or 0 if all buffers are in use; writes then go straight to the file.
+*/
+ssize_t open_write_buffer(ssize_t inum);
+
+/*
+Write through a file's write buffer.
+
+@param handle: The handle returned by open_write_buffer.
+@param buff: The bytes that need to be written to the file.
+@param nbytes: The number of bytes that are to be written.
+@param offset: The byte-offset in the file from where the data is supposed to be written.
+
+@return nbytes (or fewer if a write out failed part way), -errornum if failure.
+*/
+ssize_t buffered_write(ssize_t handle, const char* buff, size_t nbytes, off_t offset);
+
+/*
+Write out what a handle's buffer holds.
+
+@param handle: The handle returned by open_write_buffer.
+
+@return 0 if success, -errornum if this or an earlier write out of the handle failed.
+*/
+ssize_t flush_write_buffer(ssize_t handle);
+
+/*
+Write out the buffer of a handle and free it.
+
+@param handle: The handle returned by open_write_buffer.
+
+@return Same as flush_write_buffer.
+*/
+ssize_t close_write_buffer(ssize_t handle);
+
+/*
+Write out the buffered data of a file, whichever handle holds it.
+
+@param inum: The inode number of the file.
+
+@return True if success, false if a write out failed (the error is kept for the handle).
+*/
+bool flush_file_write_buffers(ssize_t inum);
+
+/*
+Flush the write buffers of every file.
+
+@return True if success.
+*/
+bool flush_all_write_buffers();
+
+/*
+Throw away the buffered data of a file that is being deleted. Its handles fail writes from now on.
+
+@param inum: The inode number of the file.
+*/
+void drop_file_write_buffers(ssize_t inum);
+
+/*
+Size of a file including the data in its write buffer.
+
+@param inum: The inode number of the file.
+@param file_size: Size of the file without it.
+
+@return The larger of the two sizes.
+*/
+ssize_t get_buffered_file_size(ssize_t inum, ssize_t file_size);
+
+#endif
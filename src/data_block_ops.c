@@ -2,16 +2,211 @@
 #include "../header/disk_layer.h"
 #include "../header/superblock_layer.h"
 
+static struct block_reservation blockReservations[BLOCK_RESERVATION_SLOTS];
+static ssize_t blockAllocations = 0;   // number of blocks allocated so far, the clock of the reservations
+static ssize_t heldDataBlocks = 0;     // free blocks kept for delayed writes
+static pthread_mutex_t reservationLock = PTHREAD_MUTEX_INITIALIZER;   // guards the three above
+
+/*
+Blocks freed by the running journal transaction, which still belong to their old file on disk until it
+commits. Once half the slots are used, the rest of the transaction's frees are not tracked one by one:
+the transaction is committed early, and until then no address listed in a freelist block it logged is
+handed out.
+*/
+static ssize_t freedBlocks[FREED_BLOCK_SLOTS];  // linear probing, 0 if the slot is empty
+static ssize_t freedCount = 0;
+static uint64_t freedSequence = 0;              // transaction that freed them
+static bool freedOverflow = false;              // it freed more blocks than are tracked
+static pthread_mutex_t freedLock = PTHREAD_MUTEX_INITIALIZER;  // guards the four above; taken after a group lock, before journalLock
+
+static inline struct block_reservation* get_block_reservation_slot(ssize_t owner)
+{
+    return &blockReservations[(((uint64_t)owner * 0x9e3779b97f4a7c15ull) >> 32) % BLOCK_RESERVATION_SLOTS];
+}
+
+void release_block_reservation(ssize_t owner)
+{
+    pthread_mutex_lock(&reservationLock);
+    struct block_reservation* reservation = get_block_reservation_slot(owner);
+    if(reservation->owner == owner)
+        memset(reservation, 0, sizeof(struct block_reservation));
+    pthread_mutex_unlock(&reservationLock);
+}
+
+bool hold_data_blocks(ssize_t count)
+{
+    pthread_mutex_lock(&reservationLock);
+    bool held = altfs_superblock->s_free_blocks_count - heldDataBlocks >= count;
+    if(held)
+        heldDataBlocks += count;
+    pthread_mutex_unlock(&reservationLock);
+    return held;
+}
+
+void release_held_data_blocks(ssize_t count)
+{
+    pthread_mutex_lock(&reservationLock);
+    heldDataBlocks -= count;
+    pthread_mutex_unlock(&reservationLock);
+}
+
+ssize_t get_available_data_blocks()
+{
+    pthread_mutex_lock(&reservationLock);
+    ssize_t available = altfs_superblock->s_free_blocks_count - heldDataBlocks;
+    pthread_mutex_unlock(&reservationLock);
+    return available;
+}
+
+/*
+Collect the live windows of every owner other than the given one. Call with reservationLock held.
+
+@return Number of windows written to windows.
+*/
+static ssize_t get_other_reservations(ssize_t owner, struct block_reservation* windows)
+{
+    ssize_t count = 0;
+    for(ssize_t i = 0; i < BLOCK_RESERVATION_SLOTS; i++)
+    {
+        struct block_reservation* reservation = &blockReservations[i];
+        if(reservation->owner > 0 && reservation->owner != owner &&
+            blockAllocations - reservation->last_used < BLOCK_RESERVATION_LIFETIME)
+            windows[count++] = *reservation;
+    }
+    return count;
+}
+
+static bool is_reserved(ssize_t block_num, const struct block_reservation* windows, ssize_t count)
+{
+    for(ssize_t i = 0; i < count; i++)
+    {
+        if(block_num >= windows[i].start && block_num < windows[i].end)
+            return true;
+    }
+    return false;
+}
+
 ssize_t allocate_data_block()
 {
-    if(altfs_superblock->s_freelist_head == 0)
+    return allocate_data_block_near(0, 0);
+}
+
+/*
+Group that a thread allocates from when it has no goal. Threads are given different groups in turn,
+so that they do not wait on the same group lock.
+*/
+static ssize_t get_home_group()
+{
+    static __thread ssize_t home_group = -1;
+    static ssize_t next_home_group = 0;
+    if(home_group == -1)
+        home_group = __atomic_fetch_add(&next_home_group, 1, __ATOMIC_RELAXED) % NUM_OF_ALLOCATION_GROUPS;
+    return home_group;
+}
+
+// Slot of a block in freedBlocks, or the empty slot where it goes.
+static ssize_t* find_freed_block(ssize_t block_num)
+{
+    ssize_t slot = (((uint64_t)block_num * 0x9e3779b97f4a7c15ull) >> 32) % FREED_BLOCK_SLOTS;
+    while(freedBlocks[slot] != 0 && freedBlocks[slot] != block_num)
+        slot = (slot + 1) % FREED_BLOCK_SLOTS;
+    return &freedBlocks[slot];
+}
+
+// Forget the freed blocks once the transaction that freed them has committed. Call with freedLock held.
+static void expire_freed_blocks()
+{
+    if((freedCount > 0 || freedOverflow) && altfs_journal_sequence() >= freedSequence)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : All data blocks allocated!\n", ALLOCATE_DATA_BLOCK);
-        return -1;
+        memset(freedBlocks, 0, sizeof(freedBlocks));
+        freedCount = 0;
+        freedOverflow = false;
+    }
+}
+
+/*
+Whether a block may have been freed by the running transaction. Call with freedLock held.
+
+@param list_logged: Whether the freelist block listing it (the block itself for a freelist head) was
+logged by the running transaction. Only needed once freedOverflow is set.
+*/
+static bool is_freed_uncommitted(ssize_t block_num, bool list_logged)
+{
+    return *find_freed_block(block_num) != 0 || (freedOverflow && list_logged);
+}
+
+// Track blocks just freed by the running transaction. Call with freedLock held.
+static void track_freed_blocks(const ssize_t* blocks, ssize_t count)
+{
+    expire_freed_blocks();
+    freedSequence = altfs_journal_sequence() + 1;
+    for(ssize_t i = 0; i < count && !freedOverflow; i++)
+    {
+        if(freedCount >= FREED_BLOCK_SLOTS / 2)
+        {
+            freedOverflow = true;
+            altfs_journal_request_commit();
+            break;
+        }
+        ssize_t* slot = find_freed_block(blocks[i]);
+        if(*slot == 0)
+        {
+            *slot = blocks[i];
+            freedCount++;
+        }
     }
+}
+
+/*
+Take a block freed by a committed transaction from further down a group's freelist, for when the head
+block lists none. Call with the group's lock and freedLock held.
 
+@param next: The freelist block after the head.
+
+@return Data block number, 0 if the group has no such block, or -1 on failure.
+*/
+static ssize_t allocate_committed_data_block(ssize_t next)
+{
     char buffer[BLOCK_SIZE];
-    if(!altfs_read_block(altfs_superblock->s_freelist_head, buffer))
+    ssize_t* data_block_numbers = (ssize_t*)buffer;
+    for(ssize_t list_blocks = 0; next != 0 && list_blocks < ALLOCATION_GROUP_BLOCKS; next = data_block_numbers[0], list_blocks++)
+    {
+        if(!altfs_read_block(next, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not read freelist block %ld.\n", ALLOCATE_DATA_BLOCK, next);
+            return -1;
+        }
+        bool list_logged = freedOverflow && altfs_journal_logged(next);
+        for(ssize_t i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; ++i)
+        {
+            ssize_t data_block_number = data_block_numbers[i];
+            if(data_block_number == 0 || is_freed_uncommitted(data_block_number, list_logged))
+                continue;
+            data_block_numbers[i] = 0;
+            if(!altfs_journal_block(next, buffer))
+            {
+                fuse_log(FUSE_LOG_ERR, "%s : Error writing free list block\n", ALLOCATE_DATA_BLOCK);
+                return -1;
+            }
+            return data_block_number;
+        }
+    }
+    return 0;
+}
+
+/*
+Take a block from the freelist of one group. Call with the group's lock held.
+
+@return Data block number, 0 if the group has no free blocks, or -1 on failure.
+*/
+static ssize_t allocate_data_block_in_group(ssize_t group, ssize_t goal, ssize_t owner)
+{
+    struct group_descriptor* descriptor = &altfs_superblock->s_groups[group];
+    if(descriptor->g_freelist_head == 0)
+        return 0;
+
+    char buffer[BLOCK_SIZE];
+    if(!altfs_read_block(descriptor->g_freelist_head, buffer))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Bata block not found at address.\n", ALLOCATE_DATA_BLOCK);
         return -1;
@@ -19,46 +214,129 @@ ssize_t allocate_data_block()
 
     ssize_t* data_block_numbers = (ssize_t*)buffer;
     ssize_t allocated_data_block_number = 0;
+    // A block freed by the running transaction still belongs to its old file on disk until the
+    // transaction commits: its data is written in place, so it is not handed out before that.
+    pthread_mutex_lock(&freedLock);
+    expire_freed_blocks();
+    bool head_logged = freedOverflow && altfs_journal_logged(descriptor->g_freelist_head);
+    bool uncommitted = is_freed_uncommitted(descriptor->g_freelist_head, head_logged);
 
-    // TODO: Possible optimization in policy of allocating new blocks
+    // Only the addresses in the freelist head block can be handed out without more reads, so the
+    // goal is looked for among them: the goal itself, else the closest block after it, else the
+    // closest block before it. Blocks in another file's window are taken only if nothing else is left.
+    struct block_reservation windows[BLOCK_RESERVATION_SLOTS];
+    pthread_mutex_lock(&reservationLock);
+    ssize_t window_count = get_other_reservations(owner, windows);
+    pthread_mutex_unlock(&reservationLock);
+    ssize_t best_index = 0, best_rank = 0;
     // starts from 1 because 0 is used to indicate next free node
     for(ssize_t i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; ++i)
     {
         ssize_t data_block_number = data_block_numbers[i];
         // check if data block is unallocated
-        if(data_block_number != 0)
+        if(data_block_number == 0)
+            continue;
+        if(is_freed_uncommitted(data_block_number, head_logged))
         {
-            data_block_numbers[i] = 0;
-            allocated_data_block_number = data_block_number;
+            uncommitted = true;
+            continue;
+        }
+        if(data_block_number == goal)
+        {
+            best_index = i;
             break;
         }
+        ssize_t rank = goal <= 0 ? i : (data_block_number > goal ? data_block_number - goal : goal - data_block_number + BLOCK_COUNT);
+        if(is_reserved(data_block_number, windows, window_count))
+            rank += 2 * BLOCK_COUNT;
+        if(best_index == 0 || rank < best_rank)
+        {
+            best_index = i;
+            best_rank = rank;
+        }
+    }
+    if(best_index != 0)
+    {
+        allocated_data_block_number = data_block_numbers[best_index];
+        data_block_numbers[best_index] = 0;
     }
 
-    ssize_t temp = altfs_superblock->s_freelist_head;
-    if(allocated_data_block_number == 0)
+    if(allocated_data_block_number == 0 && uncommitted)
     {
-        allocated_data_block_number = altfs_superblock->s_freelist_head;
-        altfs_superblock->s_freelist_head = data_block_numbers[0];
-        data_block_numbers[0] = 0;
-        if(!altfs_write_superblock())
+        allocated_data_block_number = allocate_committed_data_block(data_block_numbers[0]);
+        pthread_mutex_unlock(&freedLock);
+        if(allocated_data_block_number <= 0)
+            return allocated_data_block_number;
+    } else
+    {
+        ssize_t temp = descriptor->g_freelist_head;
+        if(allocated_data_block_number == 0)
         {
+            allocated_data_block_number = descriptor->g_freelist_head;
+            descriptor->g_freelist_head = data_block_numbers[0];
+            data_block_numbers[0] = 0;
+        }
+        pthread_mutex_unlock(&freedLock);
+
+        if(!altfs_journal_block(temp, buffer)) {
+            fuse_log(FUSE_LOG_ERR, "%s : Error writing free list block\n", ALLOCATE_DATA_BLOCK);
             return -1;
         }
     }
+    descriptor->g_free_blocks_count--;
+    update_superblock_free_counts(-1, 0);
+
+    pthread_mutex_lock(&reservationLock);
+    blockAllocations++;
+    if(owner > 0)
+    {
+        // Keep the blocks right after this one for the owner's next writes.
+        struct block_reservation* reservation = get_block_reservation_slot(owner);
+        reservation->owner = owner;
+        reservation->start = allocated_data_block_number + 1;
+        reservation->end = allocated_data_block_number + 1 + BLOCK_RESERVATION_WINDOW;
+        reservation->last_used = blockAllocations;
+    }
+    pthread_mutex_unlock(&reservationLock);
+    return allocated_data_block_number;
+}
 
-    if(!altfs_write_block(temp, buffer)) {
-        fuse_log(FUSE_LOG_ERR, "%s : Error writing free list block\n", ALLOCATE_DATA_BLOCK);
+ssize_t allocate_data_block_near(ssize_t goal, ssize_t owner)
+{
+    pthread_mutex_lock(&reservationLock);
+    bool available = altfs_superblock->s_free_blocks_count > heldDataBlocks;
+    pthread_mutex_unlock(&reservationLock);
+    if(!available)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : The free data blocks left are held for delayed writes.\n", ALLOCATE_DATA_BLOCK);
         return -1;
     }
 
-    memset(buffer, 0, BLOCK_SIZE);
-    altfs_write_block(allocated_data_block_number, buffer);
-    return allocated_data_block_number;
+    // Start with the group of the goal, and move on to the next groups once it is full.
+    ssize_t first_group = (goal > INODE_BLOCK_COUNT && goal < JOURNAL_FIRST_BLOCK) ? BLOCK_TO_GROUP(goal) : get_home_group();
+    for(ssize_t i = 0; i < NUM_OF_ALLOCATION_GROUPS; i++)
+    {
+        ssize_t group = (first_group + i) % NUM_OF_ALLOCATION_GROUPS;
+        pthread_mutex_lock(&groupLocks[group]);
+        ssize_t allocated_data_block_number = allocate_data_block_in_group(group, goal, owner);
+        pthread_mutex_unlock(&groupLocks[group]);
+        if(allocated_data_block_number == -1)
+            return -1;
+        if(allocated_data_block_number != 0)
+        {
+            char buffer[BLOCK_SIZE];
+            memset(buffer, 0, BLOCK_SIZE);
+            altfs_write_block(allocated_data_block_number, buffer);
+            return allocated_data_block_number;
+        }
+    }
+    fuse_log(FUSE_LOG_ERR, "%s : All data blocks allocated!\n", ALLOCATE_DATA_BLOCK);
+    return -1;
 }
 
 char* read_data_block(ssize_t index)
 {
-    if(index <= INODE_BLOCK_COUNT || index > BLOCK_COUNT)
+    if(index <= INODE_BLOCK_COUNT || index >= JOURNAL_FIRST_BLOCK)
     {
         fuse_log(FUSE_LOG_ERR, "%s : Invalid block index for read: %ld\n", READ_DATA_BLOCK, index);
         return NULL;
@@ -74,7 +352,7 @@ char* read_data_block(ssize_t index)
 
 bool write_data_block(ssize_t index, char* buffer)
 {
-    if(index <= INODE_BLOCK_COUNT || index > BLOCK_COUNT)
+    if(index <= INODE_BLOCK_COUNT || index >= JOURNAL_FIRST_BLOCK)
     {
         fuse_log(FUSE_LOG_ERR, "%s : Invalid block index for write: %ld\n", WRITE_DATA_BLOCK, index);
         return false;
@@ -82,73 +360,196 @@ bool write_data_block(ssize_t index, char* buffer)
     return altfs_write_block(index, buffer);
 }
 
-bool free_data_block(ssize_t index) {
-    if(index <= INODE_BLOCK_COUNT || index > BLOCK_COUNT)
+bool write_metadata_block(ssize_t index, char* buffer)
+{
+    if(index <= INODE_BLOCK_COUNT || index >= JOURNAL_FIRST_BLOCK)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Invalid block index to free: %ld\n", FREE_DATA_BLOCK, index);
+        fuse_log(FUSE_LOG_ERR, "%s : Invalid block index for write: %ld\n", WRITE_DATA_BLOCK, index);
         return false;
     }
+    return altfs_journal_block(index, buffer);
+}
 
-    char buffer[BLOCK_SIZE];
-    memset(buffer, 0, BLOCK_SIZE);
-    // altfs_write_block(index, buffer);    // Write the block to 0 during allocation instead of freeing
+/*
+Put blocks of one group on its freelist, with the group's lock held. The empty slots of the head block
+are filled first, and the head block is written once; the blocks left over become new head blocks,
+each listing the blocks that follow it.
 
-    // fuse_log(FUSE_LOG_DEBUG, "%s Superblock freelist head: %ld ; datablock being freed: %ld.\n", FREE_DATA_BLOCK, altfs_superblock->s_freelist_head, index);
+@return Number of blocks freed (the first ones of blocks).
+*/
+static ssize_t free_data_blocks_in_group(ssize_t group, const ssize_t* blocks, ssize_t count)
+{
+    struct group_descriptor* descriptor = &altfs_superblock->s_groups[group];
+    char buffer[BLOCK_SIZE];
+    ssize_t* data_block_numbers = (ssize_t*)buffer;
+    ssize_t freed = 0;
+    // If all blocks of the group were allocated, the first block being free'd starts a new freelist.
+    if(descriptor->g_freelist_head != 0)
+    {
+        if(!altfs_read_block(descriptor->g_freelist_head, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error in reading superblock block at freelist head.\n", FREE_DATA_BLOCK);
+            return 0;
+        }
+        for(ssize_t i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK && freed < count; ++i)
+        {
+            if(data_block_numbers[i] == 0)
+                data_block_numbers[i] = blocks[freed++];
+        }
+        if(freed > 0 && !altfs_journal_block(descriptor->g_freelist_head, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error in writing number of the block freed to the freelist head.\n", FREE_DATA_BLOCK);
+            return 0;
+        }
+    }
 
-    // If all blocks were full, make the block being free'd the freelist head.
-    if(altfs_superblock->s_freelist_head == 0)
+    while(freed < count)
     {
-        altfs_superblock->s_freelist_head = index;
-        if(!altfs_write_superblock())
+        ssize_t new_head = blocks[freed];
+        memset(buffer, 0, BLOCK_SIZE);
+        data_block_numbers[0] = descriptor->g_freelist_head;
+        ssize_t listed = 1;
+        for(; listed < NUM_OF_ADDRESSES_PER_BLOCK && freed + listed < count; listed++)
+            data_block_numbers[listed] = blocks[freed + listed];
+        fuse_log(FUSE_LOG_DEBUG, "%s : Adding freelist data block (new head): %ld.\n", FREE_DATA_BLOCK, new_head);
+        if(!altfs_journal_block(new_head, buffer))
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Error in writing superblock after freelist head update.\n", FREE_DATA_BLOCK);
-            return false;
+            fuse_log(FUSE_LOG_ERR, "%s : Error in writing next free block number to the block that was freed.\n", FREE_DATA_BLOCK);
+            break;
         }
-        fuse_log(FUSE_LOG_DEBUG, "%s : Superblock freelist head was 0, updated to %ld.\n", FREE_DATA_BLOCK, altfs_superblock->s_freelist_head);
+        descriptor->g_freelist_head = new_head;
+        freed += listed;
+    }
+    descriptor->g_free_blocks_count += freed;
+    if(freed > 0 && altfs_journal_enabled())
+    {
+        pthread_mutex_lock(&freedLock);
+        track_freed_blocks(blocks, freed);
+        pthread_mutex_unlock(&freedLock);
     }
+    return freed;
+}
 
-    if(!altfs_read_block(altfs_superblock->s_freelist_head, buffer))
+bool free_data_block(ssize_t index) {
+    if(index <= INODE_BLOCK_COUNT || index >= JOURNAL_FIRST_BLOCK)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error in reading superblock block at freelist head.\n", FREE_DATA_BLOCK);
+        fuse_log(FUSE_LOG_ERR, "%s : Invalid block index to free: %ld\n", FREE_DATA_BLOCK, index);
         return false;
     }
 
-    ssize_t* data_block_numbers = (ssize_t*)buffer;
-    ssize_t added = 0;
-    for(ssize_t i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; ++i)
+    // A block always goes back to the freelist of its own group.
+    // (The block is zeroed when it is allocated rather than here.)
+    ssize_t group = BLOCK_TO_GROUP(index);
+    pthread_mutex_lock(&groupLocks[group]);
+    bool res = free_data_blocks_in_group(group, &index, 1) == 1;
+    pthread_mutex_unlock(&groupLocks[group]);
+
+    if(res)
+        update_superblock_free_counts(1, 0);
+    return res;
+}
+
+static int compare_block_numbers(const void* a, const void* b)
+{
+    ssize_t x = *(const ssize_t*)a, y = *(const ssize_t*)b;
+    return (x > y) - (x < y);
+}
+
+bool free_data_blocks(const ssize_t* blocks, ssize_t count)
+{
+    if(count <= 0)
+        return true;
+    ssize_t* sorted = (ssize_t*) malloc(count * sizeof(ssize_t));
+    if(sorted == NULL)
+    {
+        bool res = true;
+        for(ssize_t i = 0; i < count; i++)
+            res = free_data_block(blocks[i]) && res;
+        return res;
+    }
+
+    bool res = true;
+    ssize_t valid = 0;
+    for(ssize_t i = 0; i < count; i++)
     {
-        if(data_block_numbers[i] == 0)
+        if(blocks[i] <= INODE_BLOCK_COUNT || blocks[i] >= JOURNAL_FIRST_BLOCK)
         {
-            data_block_numbers[i] = index;
-            added = 1;
-            break;
+            fuse_log(FUSE_LOG_ERR, "%s : Invalid block index to free: %ld\n", FREE_DATA_BLOCKS, blocks[i]);
+            res = false;
+            continue;
         }
+        sorted[valid++] = blocks[i];
     }
-
-    // If the freed data block is not added to the freelist head block
-    if(added == 0)
+    // Sorted, the blocks of a group are next to each other: each group is locked and updated once.
+    qsort(sorted, valid, sizeof(ssize_t), compare_block_numbers);
+    ssize_t total = 0;
+    for(ssize_t start = 0, end = 0; start < valid; start = end)
     {
-        ssize_t temp = altfs_superblock->s_freelist_head;
-        altfs_superblock->s_freelist_head = index;
+        ssize_t group = BLOCK_TO_GROUP(sorted[start]);
+        while(end < valid && BLOCK_TO_GROUP(sorted[end]) == group)
+            end++;
+        pthread_mutex_lock(&groupLocks[group]);
+        ssize_t freed = free_data_blocks_in_group(group, sorted + start, end - start);
+        pthread_mutex_unlock(&groupLocks[group]);
+        if(freed != end - start)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Freed %ld of %ld blocks in group %ld.\n", FREE_DATA_BLOCKS, freed, end - start, group);
+            res = false;
+        }
+        total += freed;
+    }
+    altfs_free_memory(sorted);
+
+    if(total > 0)
+        update_superblock_free_counts(total, 0);
+    return res;
+}
 
-        if(!altfs_write_superblock()) {
-            fuse_log(FUSE_LOG_ERR, "%s : Error in writing superblock after freelist head update (2).\n", FREE_DATA_BLOCK);
-            return false;
+/*
+Count the free blocks of one group by walking its freelist. Call with the group's lock held.
+
+@return Number of free data blocks, or -1 on failure.
+*/
+static ssize_t count_free_data_blocks_in_group(ssize_t group)
+{
+    ssize_t count = 0;
+    ssize_t list_blocks = 0;
+    char buffer[BLOCK_SIZE];
+    for(ssize_t block_num = altfs_superblock->s_groups[group].g_freelist_head; block_num != 0; block_num = ((ssize_t*)buffer)[0])
+    {
+        // A cycle would be a corrupt freelist: stop instead of walking it forever.
+        if(++list_blocks > ALLOCATION_GROUP_BLOCKS || !altfs_read_block(block_num, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not walk the freelist of group %ld at block %ld.\n", COUNT_FREE_DATA_BLOCKS, group, block_num);
+            return -1;
         }
-        memset(buffer, 0, BLOCK_SIZE);
-        memcpy(buffer, &temp, ADDRESS_SIZE);
-        fuse_log(FUSE_LOG_DEBUG, "%s : Adding freelist data block (new head): %ld.\n", FREE_DATA_BLOCK, index);
-        if(!altfs_write_block(index, buffer))
+        // The freelist block itself is free too: it is handed out once its addresses run out.
+        count++;
+        ssize_t* data_block_numbers = (ssize_t*)buffer;
+        for(ssize_t i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; i++)
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Error in writing next free block number to the block that was freed.\n", FREE_DATA_BLOCK);
-            return false;
+            if(data_block_numbers[i] != 0)
+                count++;
         }
-    } else
+    }
+    return count;
+}
+
+ssize_t count_free_data_blocks(bool repair)
+{
+    ssize_t total = 0;
+    for(ssize_t group = 0; group < NUM_OF_ALLOCATION_GROUPS; group++)
     {
-        if(!altfs_write_block(altfs_superblock->s_freelist_head, buffer)) {
-            fuse_log(FUSE_LOG_ERR, "%s : Error in writing number of the block freed to the freelist head.\n", FREE_DATA_BLOCK);
-            return false;
-        }
+        pthread_mutex_lock(&groupLocks[group]);
+        ssize_t count = count_free_data_blocks_in_group(group);
+        if(count >= 0 && repair)
+            altfs_superblock->s_groups[group].g_free_blocks_count = count;
+        pthread_mutex_unlock(&groupLocks[group]);
+        if(count < 0)
+            return -1;
+        total += count;
     }
-    return true;
+    if(repair)
+        update_superblock_free_counts(total - altfs_superblock->s_free_blocks_count, 0);
+    return total;
 }
@@ -0,0 +1,156 @@
+#include "../header/data_block_ops.h"
+#include "../header/delayed_alloc.h"
+#include "../header/inode_data_block_ops.h"
+#include "../header/inode_ops.h"
+
+static struct delayed_file delayedFiles[DELAYED_ALLOC_SLOTS];
+
+static inline struct delayed_file* get_delayed_slot(ssize_t inum)
+{
+    return &delayedFiles[(((uint64_t)inum * 0x9e3779b97f4a7c15ull) >> 32) % DELAYED_ALLOC_SLOTS];
+}
+
+static void clear_delayed_file(struct delayed_file* entry)
+{
+    release_held_data_blocks(entry->reserved);
+    altfs_free_memory(entry->data);
+    memset(entry, 0, sizeof(struct delayed_file));
+}
+
+bool prepare_delayed_write(const struct inode* const node, ssize_t inum, off_t offset, size_t nbytes)
+{
+    struct delayed_file* entry = get_delayed_slot(inum);
+    if(entry->inum != inum && entry->inum != 0 && !flush_delayed_blocks(entry->inum, NULL))
+        return false;
+
+    bool is_new = entry->inum != inum;
+    ssize_t first_block = is_new ? node->i_blocks_num : entry->first_block;
+    ssize_t num_blocks = (ssize_t)((offset + nbytes - 1) / BLOCK_SIZE) + 1 - first_block;
+    if(num_blocks > DELAYED_ALLOC_MAX_BLOCKS)
+        return false;
+
+    ssize_t to_hold = is_new ? num_blocks + DELAYED_ALLOC_METADATA_BLOCKS : num_blocks - entry->num_blocks;
+    if(to_hold > 0 && !hold_data_blocks(to_hold))
+        return false;
+    if(is_new)
+    {
+        entry->data = (char*) calloc(DELAYED_ALLOC_MAX_BLOCKS, BLOCK_SIZE);
+        if(entry->data == NULL)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not allocate a write buffer for inode %ld.\n", PREPARE_DELAYED_WRITE, inum);
+            release_held_data_blocks(to_hold);
+            return false;
+        }
+        entry->inum = inum;
+        entry->first_block = first_block;
+        entry->file_size = node->i_file_size;
+    }
+    if(to_hold > 0)
+        entry->reserved += to_hold;
+    if(num_blocks > entry->num_blocks)
+        entry->num_blocks = num_blocks;
+    return true;
+}
+
+void write_delayed_blocks(ssize_t inum, const char* buff, size_t nbytes, off_t offset)
+{
+    struct delayed_file* entry = get_delayed_slot(inum);
+    memcpy(entry->data + (offset - entry->first_block * BLOCK_SIZE), buff, nbytes);
+    if(offset + (ssize_t)nbytes > entry->file_size)
+        entry->file_size = offset + nbytes;
+}
+
+bool flush_delayed_blocks(ssize_t inum, struct inode* node)
+{
+    struct delayed_file* entry = get_delayed_slot(inum);
+    if(entry->inum != inum)
+        return true;
+
+    struct inode* file_inode = node != NULL ? node : get_inode(inum);
+    if(file_inode == NULL)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not read inode %ld.\n", FLUSH_DELAYED_BLOCKS, inum);
+        return false;
+    }
+    if(file_inode->i_blocks_num != entry->first_block)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Inode %ld has %ld blocks, its buffer starts at block %ld.\n",
+            FLUSH_DELAYED_BLOCKS, inum, file_inode->i_blocks_num, entry->first_block);
+        if(node == NULL)
+            altfs_free_memory(file_inode);
+        // The buffer can never be flushed: drop it, so that its blocks and its slot are not held for good.
+        clear_delayed_file(entry);
+        return false;
+    }
+
+    // The blocks held for the buffer are handed out now, all of them after the file's last block.
+    release_held_data_blocks(entry->reserved);
+    entry->reserved = 0;
+    bool res = true;
+    ssize_t goal = get_allocation_goal(file_inode, inum);
+    ssize_t flushed = 0;
+    for(; flushed < entry->num_blocks; flushed++)
+    {
+        ssize_t block_num = allocate_data_block_near(goal, inum);
+        if(block_num <= 0 || !add_datablock_to_inode(file_inode, block_num))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not allocate block %ld of %ld for inode %ld.\n",
+                FLUSH_DELAYED_BLOCKS, flushed, entry->num_blocks, inum);
+            if(block_num > 0)
+                free_data_block(block_num);
+            res = false;
+            break;
+        }
+        if(!write_data_block(block_num, entry->data + flushed * BLOCK_SIZE))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not write data block %ld for inode %ld.\n", FLUSH_DELAYED_BLOCKS, block_num, inum);
+            res = false;
+            break;
+        }
+        goal = block_num + 1;
+    }
+
+    // Only the data that got a block becomes part of the file on disk.
+    ssize_t flushed_size = (entry->first_block + flushed) * BLOCK_SIZE;
+    ssize_t new_size = entry->file_size < flushed_size ? entry->file_size : flushed_size;
+    if(new_size > file_inode->i_file_size)
+        file_inode->i_file_size = new_size;
+    if(node == NULL)
+    {
+        if(!write_inode(inum, file_inode))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not write inode %ld.\n", FLUSH_DELAYED_BLOCKS, inum);
+            res = false;
+        }
+        altfs_free_memory(file_inode);
+    }
+    clear_delayed_file(entry);
+    fuse_log(FUSE_LOG_DEBUG, "%s : Flushed %ld buffered blocks of inode %ld.\n", FLUSH_DELAYED_BLOCKS, flushed, inum);
+    return res;
+}
+
+bool flush_all_delayed_blocks()
+{
+    bool res = true;
+    for(ssize_t i = 0; i < DELAYED_ALLOC_SLOTS; i++)
+    {
+        if(delayedFiles[i].inum != 0 && !flush_delayed_blocks(delayedFiles[i].inum, NULL))
+            res = false;
+    }
+    return res;
+}
+
+void drop_delayed_blocks(ssize_t inum)
+{
+    struct delayed_file* entry = get_delayed_slot(inum);
+    if(entry->inum == inum)
+        clear_delayed_file(entry);
+}
+
+ssize_t get_delayed_file_size(ssize_t inum, ssize_t disk_file_size)
+{
+    struct delayed_file* entry = get_delayed_slot(inum);
+    if(entry->inum == inum && entry->file_size > disk_file_size)
+        return entry->file_size;
+    return disk_file_size;
+}
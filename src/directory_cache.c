@@ -0,0 +1,305 @@
+#include "../header/data_block_ops.h"
+#include "../header/directory_cache.h"
+#include "../header/directory_ops.h"
+#include "../header/inode_cache.h"
+#include "../header/inode_ops.h"
+
+static struct dir_cache_entry dirCache[DIR_CACHE_SETS][DIR_CACHE_WAYS];
+static uint64_t dirCacheClock = 0;  // number of times an entry was used, the clock of last_used
+
+static inline struct dir_cache_entry* get_dir_cache_set(ssize_t key)
+{
+    // Fibonacci hashing spreads consecutive block numbers over the sets.
+    return dirCache[(((uint64_t)key * 0x9e3779b97f4a7c15ull) >> 32) % DIR_CACHE_SETS];
+}
+
+/*
+@return The entry of the directory with this key, marked as just used, or NULL if it is not cached.
+*/
+static struct dir_cache_entry* find_dir_cache_entry(ssize_t key)
+{
+    struct dir_cache_entry* set = get_dir_cache_set(key);
+    for(ssize_t way = 0; way < DIR_CACHE_WAYS; way++)
+    {
+        if(set[way].key == key)
+        {
+            set[way].last_used = ++dirCacheClock;
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+static inline ssize_t get_dir_cache_key(const struct inode* const dir_inode)
+{
+    return dir_inode->i_blocks_num > 0 ? dir_inode->i_direct_blocks[0] : 0;
+}
+
+static void clear_dir_cache_entry(struct dir_cache_entry* entry)
+{
+    altfs_free_memory(entry->free_bytes);
+    entry->free_bytes = NULL;
+    altfs_free_memory(entry->bloom);
+    entry->bloom = NULL;
+    entry->bloom_bits = 0;
+    entry->key = 0;
+    entry->num_blocks = 0;
+    entry->capacity = 0;
+}
+
+/*
+Allocate an empty filter big enough for a directory of the given number of blocks.
+*/
+static bool reset_dir_cache_bloom(struct dir_cache_entry* entry, ssize_t num_blocks)
+{
+    ssize_t bloom_bits = DIR_BLOOM_BITS_PER_BLOCK;
+    while(bloom_bits < num_blocks * DIR_BLOOM_BITS_PER_BLOCK)
+        bloom_bits *= 2;
+    altfs_free_memory(entry->bloom);
+    entry->bloom = (uint64_t*) calloc(bloom_bits / 64, sizeof(uint64_t));
+    entry->bloom_bits = entry->bloom == NULL ? 0 : bloom_bits;
+    return entry->bloom != NULL;
+}
+
+static void add_to_dir_cache_bloom(struct dir_cache_entry* entry, const char* const name, ssize_t name_len)
+{
+    // Double hashing: probe i is h1 + i*h2.
+    uint64_t hash = path_hash_component(PATH_HASH_SEED, name, name_len);
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for(int i = 0; i < DIR_BLOOM_PROBES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (entry->bloom_bits - 1);
+        entry->bloom[bit / 64] |= (uint64_t) 1 << (bit % 64);
+    }
+}
+
+static bool test_dir_cache_bloom(const struct dir_cache_entry* entry, const char* const name, ssize_t name_len)
+{
+    uint64_t hash = path_hash_component(PATH_HASH_SEED, name, name_len);
+    uint64_t h1 = hash, h2 = (hash >> 32) | 1;
+    for(int i = 0; i < DIR_BLOOM_PROBES; i++)
+    {
+        uint64_t bit = (h1 + i * h2) & (entry->bloom_bits - 1);
+        if((entry->bloom[bit / 64] & ((uint64_t) 1 << (bit % 64))) == 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+Make room for a directory in its set: an empty entry if there is one, else the least recently used
+entry, which is dropped. The entry returned is empty and marked as just used.
+*/
+static struct dir_cache_entry* evict_dir_cache_entry(ssize_t key)
+{
+    struct dir_cache_entry* set = get_dir_cache_set(key);
+    struct dir_cache_entry* victim = &set[0];
+    for(ssize_t way = 0; way < DIR_CACHE_WAYS && victim->key != 0; way++)
+    {
+        if(set[way].key == 0 || set[way].last_used < victim->last_used)
+            victim = &set[way];
+    }
+    clear_dir_cache_entry(victim);
+    victim->last_used = ++dirCacheClock;
+    return victim;
+}
+
+static bool reserve_dir_cache_entry(struct dir_cache_entry* entry, ssize_t num_blocks)
+{
+    if(num_blocks <= entry->capacity)
+        return true;
+
+    ssize_t capacity = entry->capacity > 0 ? entry->capacity : 16;
+    while(capacity < num_blocks)
+        capacity *= 2;
+    unsigned short* free_bytes = (unsigned short*) realloc(entry->free_bytes, capacity * sizeof(unsigned short));
+    if(free_bytes == NULL)
+        return false;
+    entry->free_bytes = free_bytes;
+    entry->capacity = capacity;
+    return true;
+}
+
+ssize_t get_dir_block_free_space(const char* const dblock)
+{
+    ssize_t curr_pos = 0, longest_deleted = 0;
+    while(curr_pos <= LAST_POSSIBLE_RECORD)
+    {
+        unsigned short record_len = ((unsigned short*)(dblock + curr_pos))[0];
+        if(record_len == 0)
+            break;
+        if(((ssize_t*)(dblock + curr_pos + RECORD_LENGTH))[0] == RECORD_DELETED_INUM && record_len > longest_deleted)
+            longest_deleted = record_len;
+        curr_pos += record_len;
+    }
+    return BLOCK_SIZE - curr_pos > longest_deleted ? BLOCK_SIZE - curr_pos : longest_deleted;
+}
+
+/*
+Read every block of the directory to fill its free space table and its filter.
+*/
+static struct dir_cache_entry* build_dir_cache_entry(const struct inode* const dir_inode, ssize_t key)
+{
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry != NULL)
+        clear_dir_cache_entry(entry);
+    else
+        entry = evict_dir_cache_entry(key);
+    if(!reserve_dir_cache_entry(entry, dir_inode->i_blocks_num) || !reset_dir_cache_bloom(entry, dir_inode->i_blocks_num))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not allocate free space table for %ld blocks.\n", DIR_CACHE_BUILD, dir_inode->i_blocks_num);
+        clear_dir_cache_entry(entry);
+        return NULL;
+    }
+
+    ssize_t prev_block = 0;
+    for(ssize_t l_block_num = 0; l_block_num < dir_inode->i_blocks_num; l_block_num++)
+    {
+        ssize_t p_block_num = get_disk_block_from_inode_block(dir_inode, l_block_num, &prev_block);
+        if(p_block_num <= 0)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to fetch physical block for logical block %ld.\n", DIR_CACHE_BUILD, l_block_num);
+            clear_dir_cache_entry(entry);
+            return NULL;
+        }
+        char* dblock = read_data_block(p_block_num);
+        ssize_t curr_pos = 0;
+        while(curr_pos <= LAST_POSSIBLE_RECORD)
+        {
+            char* record = dblock + curr_pos;
+            unsigned short record_len = ((unsigned short*)record)[0];
+            if(record_len == 0)
+                break;
+            if(((ssize_t*)(record + RECORD_LENGTH))[0] != RECORD_DELETED_INUM)
+                add_to_dir_cache_bloom(entry, record + RECORD_FIXED_LEN, strnlen(record + RECORD_FIXED_LEN, record_len - RECORD_FIXED_LEN));
+            curr_pos += record_len;
+        }
+        entry->free_bytes[l_block_num] = get_dir_block_free_space(dblock);
+        altfs_free_memory(dblock);
+    }
+    entry->key = key;
+    entry->num_blocks = dir_inode->i_blocks_num;
+    return entry;
+}
+
+ssize_t dir_cache_find_space(const struct inode* const dir_inode, ssize_t record_len)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return -1;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry == NULL || entry->num_blocks != dir_inode->i_blocks_num)
+    {
+        entry = build_dir_cache_entry(dir_inode, key);
+        if(entry == NULL)
+            return -1;
+    }
+
+    // First fit, the same placement a scan of the blocks would choose.
+    for(ssize_t l_block_num = 0; l_block_num < entry->num_blocks; l_block_num++)
+    {
+        if(entry->free_bytes[l_block_num] >= record_len)
+            return l_block_num;
+    }
+    return -1;
+}
+
+void dir_cache_update_space(const struct inode* const dir_inode, ssize_t l_block_num, ssize_t free_bytes)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry == NULL)
+    {
+        // A directory's first block: nothing else to read, so start its table right away.
+        if(dir_inode->i_blocks_num != 1 || l_block_num != 0)
+            return;
+        entry = evict_dir_cache_entry(key);
+        entry->key = key;
+        // The filter can only start out empty if the block held no live records before this change
+        // (i_child_num is updated after the table); otherwise it is built on the next lookup.
+        if(dir_inode->i_child_num == 0)
+            reset_dir_cache_bloom(entry, 1);
+    }
+
+    if(l_block_num == entry->num_blocks && dir_inode->i_blocks_num == entry->num_blocks + 1 &&
+        reserve_dir_cache_entry(entry, entry->num_blocks + 1))
+    {
+        entry->num_blocks++;
+        if(entry->bloom_bits < entry->num_blocks * DIR_BLOOM_BITS_PER_BLOCK)
+        {
+            // Too small to stay selective: rebuild it at the right size on the next lookup.
+            altfs_free_memory(entry->bloom);
+            entry->bloom = NULL;
+            entry->bloom_bits = 0;
+        }
+    }
+
+    if(entry->num_blocks != dir_inode->i_blocks_num || l_block_num >= entry->num_blocks)
+    {
+        clear_dir_cache_entry(entry);
+        return;
+    }
+    entry->free_bytes[l_block_num] = free_bytes;
+}
+
+void dir_cache_add_name(const struct inode* const dir_inode, const char* const name, ssize_t name_len)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry != NULL && entry->bloom != NULL)
+        add_to_dir_cache_bloom(entry, name, name_len);
+}
+
+bool dir_cache_may_contain(const struct inode* const dir_inode, const char* const name, ssize_t name_len)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return true;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry == NULL || entry->num_blocks != dir_inode->i_blocks_num || entry->bloom == NULL)
+    {
+        entry = build_dir_cache_entry(dir_inode, key);
+        if(entry == NULL)
+            return true;
+    }
+    return test_dir_cache_bloom(entry, name, name_len);
+}
+
+void dir_cache_truncate(const struct inode* const dir_inode)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry != NULL && entry->num_blocks >= dir_inode->i_blocks_num)
+        entry->num_blocks = dir_inode->i_blocks_num;
+}
+
+void dir_cache_invalidate(const struct inode* const dir_inode)
+{
+    ssize_t key = get_dir_cache_key(dir_inode);
+    if(key <= 0)
+        return;
+
+    struct dir_cache_entry* entry = find_dir_cache_entry(key);
+    if(entry != NULL)
+        clear_dir_cache_entry(entry);
+}
+
+void flush_dir_cache()
+{
+    for(ssize_t set = 0; set < DIR_CACHE_SETS; set++)
+    {
+        for(ssize_t way = 0; way < DIR_CACHE_WAYS; way++)
+            clear_dir_cache_entry(&dirCache[set][way]);
+    }
+}
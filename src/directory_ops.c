@@ -3,6 +3,7 @@
 #include "../header/superblock_layer.h"
 #include "../header/inode_ops.h"
 #include "../header/data_block_ops.h"
+#include "../header/directory_cache.h"
 #include "../header/directory_ops.h"
 #include "../header/inode_cache.h"
 #include "../header/inode_data_block_ops.h"
@@ -61,22 +62,164 @@ bool copy_file_name(char* const buffer, const char* const path, ssize_t path_len
     return true;
 }
 
+unsigned short get_name_tag(const char* const name, ssize_t name_len)
+{
+    // FNV-1a, folded to 16 bits
+    uint32_t hash = 2166136261u;
+    for(ssize_t i = 0; i < name_len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return (unsigned short)((hash >> 16) ^ hash);
+}
+
 /*
 ALGORTIHM:
 
-If directory entry has allocated datablocks:
-    Iterate over logical data blocks serially [i]:
-        Read data block, and set curr_pos to 0
-        While curr_pos < (BLOCK_SIZE - RECORD_FIXED_SIZE):
-            Read the record_len bytes
-            If record_len == 0:  // means we are past existing records for the data block
-                Add new record here if enough space left, and return
-            Increment curr_pos by record_len
+While the directory's free space table (see directory_cache.h) names a block with enough room [i]:
+    Read data block, and walk its records to the first record_len of 0
+    If enough space is left there:
+        Add new record here, update the table, and return
+    Else:
+        Correct the table entry for the block
 Add new datablock to the inode
 Write the reord to the new block
 Return
 */
-bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, char* file_name)
+/*
+Fill in a record at the given position.
+*/
+static void write_directory_record(char* record, unsigned short record_length, ssize_t child_inum, mode_t child_mode, const char* file_name, ssize_t file_name_len)
+{
+    // Add record length
+    ((unsigned short*)record)[0] = record_length;
+    // Add child INUM
+    ((ssize_t*)(record + RECORD_LENGTH))[0] = child_inum;
+    // Add file type
+    record[RECORD_LENGTH + RECORD_INUM] = MODE_TO_RECORD_TYPE(child_mode);
+    // Add name tag
+    ((unsigned short*)(record + RECORD_TAG_OFFSET))[0] = get_name_tag(file_name, file_name_len - 1);
+    // Add file name
+    strncpy((char*)(record + RECORD_FIXED_LEN), file_name, file_name_len);
+}
+
+ssize_t get_directory_block_count(const struct inode* const dir_inode)
+{
+    return (dir_inode->i_flags & INODE_FLAG_INLINE_DATA) ? 1 : dir_inode->i_blocks_num;
+}
+
+char* read_directory_block(const struct inode* const dir_inode, ssize_t l_block_num, ssize_t* prev_block, ssize_t* p_block_num)
+{
+    if(dir_inode->i_flags & INODE_FLAG_INLINE_DATA)
+    {
+        // The records are followed by zeros, as in a data block.
+        *p_block_num = INLINE_DIR_BLOCK_NUM;
+        char* dblock = (char*) calloc(1, BLOCK_SIZE);
+        if(dblock != NULL)
+            memcpy(dblock, dir_inode->i_inline_data, INODE_INLINE_DATA_SIZE);
+        return dblock;
+    }
+
+    *p_block_num = get_disk_block_from_inode_block(dir_inode, l_block_num, prev_block);
+    if(*p_block_num <= 0)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to fetch physical data block number corresponfing to file's logical block number.\n", GET_FILE_POS_IN_DIR);
+        return NULL;
+    }
+    return read_data_block(*p_block_num);
+}
+
+bool reload_file_position(const struct inode* const dir_inode, struct fileposition* file_pos)
+{
+    altfs_free_memory(file_pos->p_block);
+    ssize_t prev_block = 0;
+    file_pos->p_block = read_directory_block(dir_inode, file_pos->l_block_num, &prev_block, &file_pos->p_plock_num);
+    return file_pos->p_block != NULL;
+}
+
+/*
+Write back the block holding a located record. The records of an inline directory are copied back
+into the inode, which the caller writes.
+*/
+static bool write_directory_position(struct inode* dir_inode, const struct fileposition* const file_pos)
+{
+    if(file_pos->p_plock_num == INLINE_DIR_BLOCK_NUM)
+    {
+        memcpy(dir_inode->i_inline_data, file_pos->p_block, INODE_INLINE_DATA_SIZE);
+        return true;
+    }
+    return write_metadata_block(file_pos->p_plock_num, file_pos->p_block);
+}
+
+/*
+Move the records of an inline directory to the start of a new first data block. Records keep their
+offsets, so positions and readdir offsets taken before the move stay valid.
+*/
+static bool spill_inline_directory(struct inode* dir_inode)
+{
+    char data_block[BLOCK_SIZE];
+    memset(data_block, 0, BLOCK_SIZE);
+    memcpy(data_block, dir_inode->i_inline_data, INODE_INLINE_DATA_SIZE);
+
+    ssize_t data_block_num = allocate_data_block();
+    if(data_block_num <= 0)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error allocating data block for the records of an inline directory.\n", ADD_DIRECTORY_ENTRY);
+        return false;
+    }
+    if(!write_metadata_block(data_block_num, data_block))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", ADD_DIRECTORY_ENTRY, data_block_num);
+        free_data_block(data_block_num);
+        return false;
+    }
+
+    memset(dir_inode->i_inline_data, 0, INODE_INLINE_DATA_SIZE);
+    dir_inode->i_flags &= ~INODE_FLAG_INLINE_DATA;
+    dir_inode->i_blocks_num = 0;
+    add_datablock_to_inode(dir_inode, data_block_num);
+    dir_inode->i_file_size = BLOCK_SIZE;
+
+    // The block may have belonged to a directory that has since been freed.
+    dir_cache_invalidate(dir_inode);
+    dir_cache_update_space(dir_inode, 0, get_dir_block_free_space(data_block));
+    return true;
+}
+
+/*
+Put a new record in a directory data block: in the first deleted record long enough for it, else after
+the last record. The rest of a deleted record that is reused is left as a shorter deleted record when
+it can hold one. Call only if get_dir_block_free_space allows the record.
+*/
+static void insert_directory_record(char* dblock, unsigned short record_length, ssize_t child_inum, mode_t child_mode, const char* file_name, ssize_t file_name_len)
+{
+    ssize_t curr_pos = 0;
+    while(curr_pos <= LAST_POSSIBLE_RECORD)
+    {
+        char* record = dblock + curr_pos;
+        unsigned short record_len = ((unsigned short*)record)[0];
+        if(record_len == 0)
+            break;
+        if(((ssize_t*)(record + RECORD_LENGTH))[0] == RECORD_DELETED_INUM && record_len >= record_length)
+        {
+            unsigned short rest = record_len - record_length;
+            if(rest < RECORD_FIXED_LEN + 1)
+            {
+                write_directory_record(record, record_len, child_inum, child_mode, file_name, file_name_len);
+                return;
+            }
+            write_directory_record(record, record_length, child_inum, child_mode, file_name, file_name_len);
+            ((unsigned short*)(record + record_length))[0] = rest;
+            ((ssize_t*)(record + record_length + RECORD_LENGTH))[0] = RECORD_DELETED_INUM;
+            return;
+        }
+        curr_pos += record_len;
+    }
+    write_directory_record(dblock + curr_pos, record_length, child_inum, child_mode, file_name, file_name_len);
+}
+
+bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, mode_t child_mode, char* file_name)
 {
     // Check if dir_inode is actually a directory
     if(!S_ISDIR((*dir_inode)->i_mode))
@@ -95,64 +238,63 @@ bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, char* fil
     file_name_len++; // add \0
 
     unsigned short short_name_length = file_name_len;
+    unsigned short record_length = RECORD_FIXED_LEN + short_name_length;
 
-    // If the directory inode has datablocks allocated, try to find space in them to add the entry.
-    if((*dir_inode)->i_blocks_num > 0)
+    if((*dir_inode)->i_flags & INODE_FLAG_INLINE_DATA)
+    {
+        char records[BLOCK_SIZE];
+        memset(records, 0, BLOCK_SIZE);
+        memcpy(records, (*dir_inode)->i_inline_data, INODE_INLINE_DATA_SIZE);
+        ssize_t free_space = get_dir_block_free_space(records) - (BLOCK_SIZE - INODE_INLINE_DATA_SIZE);
+        if(free_space >= record_length)
+        {
+            write_directory_record((*dir_inode)->i_inline_data + INODE_INLINE_DATA_SIZE - free_space, record_length, child_inum, child_mode, file_name, file_name_len);
+            (*dir_inode)->i_child_num++;
+            return true;
+        }
+
+        // The directory has outgrown its inode.
+        if(!spill_inline_directory(*dir_inode))
+            return false;
+    }
+
+    // Go straight to a block the free space table says has room. The table is only a hint, so the
+    // block is checked before writing and the table corrected if it was wrong.
+    ssize_t l_block_num;
+    while((l_block_num = dir_cache_find_space(*dir_inode, record_length)) != -1)
     {
         ssize_t prev_block = 0;
-        for(ssize_t l_block_num = 0; l_block_num < (*dir_inode)->i_blocks_num; l_block_num++)
+        ssize_t p_block_num = get_disk_block_from_inode_block((*dir_inode), l_block_num, &prev_block);
+        if(p_block_num <= 0)
         {
-            ssize_t p_block_num = get_disk_block_from_inode_block((*dir_inode), l_block_num, &prev_block);
-            if(p_block_num <= 0)
-            {
-                fuse_log(FUSE_LOG_ERR, "%s : Failed to fetch physical data block number corresponfing to file's logical block number.\n", ADD_DIRECTORY_ENTRY);
-                return false;
-            }
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to fetch physical data block number corresponfing to file's logical block number.\n", ADD_DIRECTORY_ENTRY);
+            return false;
+        }
 
-            char* dblock = read_data_block(p_block_num);
-            ssize_t curr_pos = 0;
-            while(curr_pos <= LAST_POSSIBLE_RECORD)
-            {
-                unsigned short record_len = ((unsigned short*)(dblock + curr_pos))[0];
-
-                // Indicates a record has never been allocated at (and from) this position
-                if(record_len == 0)
-                {
-                    // Check if there is enough space left in the data block
-                    ssize_t rem_block_space = BLOCK_SIZE - curr_pos - RECORD_FIXED_LEN;
-                    if(rem_block_space >= file_name_len)
-                    {
-                        // UNCOMMENT
-                        // fuse_log(FUSE_LOG_DEBUG, "%s : Space found in data block %ld (physical block #%ld) of directory for entry.\n", ADD_DIRECTORY_ENTRY, l_block_num, p_block_num);
-                        unsigned short record_length = RECORD_FIXED_LEN + short_name_length;
-                        char* record = dblock + curr_pos;
-                        // Add record length
-                        ((unsigned short*)record)[0] = record_length;
-                        // Add child INUM
-                        ((ssize_t*)(record + RECORD_LENGTH))[0] = child_inum;
-                        // Add file name
-                        strncpy((char*)(record + RECORD_FIXED_LEN), file_name, file_name_len);
-
-                        if(!write_data_block(p_block_num, dblock)){
-                            fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", ADD_DIRECTORY_ENTRY, p_block_num);
-                            altfs_free_memory(dblock);
-                            return false;
-                        }
-
-                        (*dir_inode)->i_child_num++;
-                        altfs_free_memory(dblock);
-                        return true;
-                    } else
-                    {
-                        break;
-                    }
-                }
+        char* dblock = read_data_block(p_block_num);
+        ssize_t free_space = get_dir_block_free_space(dblock);
+        if(free_space < record_length)
+        {
+            dir_cache_update_space(*dir_inode, l_block_num, free_space);
+            altfs_free_memory(dblock);
+            continue;
+        }
 
-                curr_pos += record_len;
-            }
+        // UNCOMMENT
+        // fuse_log(FUSE_LOG_DEBUG, "%s : Space found in data block %ld (physical block #%ld) of directory for entry.\n", ADD_DIRECTORY_ENTRY, l_block_num, p_block_num);
+        insert_directory_record(dblock, record_length, child_inum, child_mode, file_name, file_name_len);
 
+        if(!write_metadata_block(p_block_num, dblock)){
+            fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", ADD_DIRECTORY_ENTRY, p_block_num);
             altfs_free_memory(dblock);
+            return false;
         }
+
+        dir_cache_update_space(*dir_inode, l_block_num, get_dir_block_free_space(dblock));
+        dir_cache_add_name(*dir_inode, file_name, file_name_len - 1);
+        (*dir_inode)->i_child_num++;
+        altfs_free_memory(dblock);
+        return true;
     }
     // fuse_log(FUSE_LOG_DEBUG, "%s : No space found in existing data blocks for directory entry, allocating a new block.\n", ADD_DIRECTORY_ENTRY);
 
@@ -167,15 +309,9 @@ bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, char* fil
     char data_block[BLOCK_SIZE];
     memset(data_block, 0, BLOCK_SIZE);
 
-    unsigned short record_length = RECORD_FIXED_LEN + short_name_length;
-    // Add record length
-    ((unsigned short*)data_block)[0] = record_length;
-    // Add child INUM
-    ((ssize_t*)(data_block + RECORD_LENGTH))[0] = child_inum;
-    // Add file name
-    strncpy((char*)(data_block + RECORD_FIXED_LEN), file_name, file_name_len);
+    write_directory_record(data_block, record_length, child_inum, child_mode, file_name, file_name_len);
 
-    if(!write_data_block(data_block_num, data_block))
+    if(!write_metadata_block(data_block_num, data_block))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", ADD_DIRECTORY_ENTRY, data_block_num);
         return false;
@@ -188,6 +324,11 @@ bool add_directory_entry(struct inode** dir_inode, ssize_t child_inum, char* fil
     }
 
     (*dir_inode)->i_file_size += BLOCK_SIZE;   // TODO: Should this be in the add datablock to inode function?
+    // The first block of a directory may have belonged to a directory that has since been freed.
+    if((*dir_inode)->i_blocks_num == 1)
+        dir_cache_invalidate(*dir_inode);
+    dir_cache_update_space(*dir_inode, (*dir_inode)->i_blocks_num - 1, BLOCK_SIZE - record_length);
+    dir_cache_add_name(*dir_inode, file_name, file_name_len - 1);
     (*dir_inode)->i_child_num++;
     return true;
 }
@@ -198,26 +339,177 @@ bool remove_directory_entry(struct inode** dir_inode, char* file_name)
     if(file_pos.offset == -1)
     {
         fuse_log(FUSE_LOG_ERR, "remove_directory_entry : No entry found for child %s.\n", file_name);
+        altfs_free_memory(file_pos.p_block);
         return false;
     }
 
-    // Rewrite block with child entry deleted
+    bool res = remove_directory_entry_at(dir_inode, &file_pos);
+    altfs_free_memory(file_pos.p_block);
+    return res;
+}
+
+/*
+Squeeze the tombstones (and any slack after names) out of a directory block: live records are moved
+to the front, in order, and the rest of the block is zeroed.
+*/
+static void compact_directory_block(char* dblock)
+{
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, BLOCK_SIZE);
-    memcpy(buffer, file_pos.p_block, file_pos.offset);
-    unsigned short rec_len = ((unsigned short*)(file_pos.p_block + file_pos.offset))[0];
-    ssize_t next_offset = file_pos.offset + rec_len;
-    if(next_offset < BLOCK_SIZE)
+    ssize_t curr_pos = 0, new_pos = 0;
+    while(curr_pos <= LAST_POSSIBLE_RECORD)
     {
-        memcpy(buffer + file_pos.offset, file_pos.p_block + next_offset, BLOCK_SIZE - next_offset);
+        char* record = dblock + curr_pos;
+        unsigned short record_len = ((unsigned short*)record)[0];
+        if(record_len == 0)
+            break;
+        if(((ssize_t*)(record + RECORD_LENGTH))[0] != RECORD_DELETED_INUM)
+        {
+            unsigned short new_len = RECORD_FIXED_LEN + strnlen(record + RECORD_FIXED_LEN, record_len - RECORD_FIXED_LEN) + 1;
+            memcpy(buffer + new_pos, record, new_len);
+            ((unsigned short*)(buffer + new_pos))[0] = new_len;
+            new_pos += new_len;
+        }
+        curr_pos += record_len;
     }
-    write_data_block(file_pos.p_plock_num, buffer);
-    altfs_free_memory(file_pos.p_block);
+    memcpy(dblock, buffer, BLOCK_SIZE);
+}
+
+/*
+Join each run of deleted records in a directory block into one, so that it can take a longer record.
+A run at the end of the block becomes free space again. Live records never move: a readdir resumed
+from an offset in the block sees all of them.
+
+@return True if no live records are left.
+*/
+static bool merge_deleted_records(char* dblock)
+{
+    ssize_t curr_pos = 0, run_start = -1;
+    bool empty = true;
+    while(curr_pos <= LAST_POSSIBLE_RECORD)
+    {
+        unsigned short record_len = ((unsigned short*)(dblock + curr_pos))[0];
+        if(record_len == 0)
+            break;
+        if(((ssize_t*)(dblock + curr_pos + RECORD_LENGTH))[0] != RECORD_DELETED_INUM)
+        {
+            empty = false;
+            run_start = -1;
+        }
+        else if(run_start == -1)
+            run_start = curr_pos;
+        else
+            ((unsigned short*)(dblock + run_start))[0] += record_len;
+        curr_pos += record_len;
+    }
+    if(run_start != -1)
+        memset(dblock + run_start, 0, curr_pos - run_start);
+    return empty;
+}
+
+/*
+Free the empty blocks at the end of a directory. The first block is always kept.
+*/
+static bool shrink_directory(struct inode* dir_inode)
+{
+    ssize_t new_num_blocks = dir_inode->i_blocks_num;
+    ssize_t prev_block = 0;
+    while(new_num_blocks > 1)
+    {
+        ssize_t p_block_num = get_disk_block_from_inode_block(dir_inode, new_num_blocks - 1, &prev_block);
+        if(p_block_num <= 0)
+            break;
+        char* dblock = read_data_block(p_block_num);
+        bool empty = merge_deleted_records(dblock);
+        altfs_free_memory(dblock);
+        if(!empty)
+            break;
+        new_num_blocks--;
+        prev_block = 0;
+    }
+    if(new_num_blocks == dir_inode->i_blocks_num)
+        return true;
+
+    if(!remove_datablocks_from_inode(dir_inode, new_num_blocks))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to free empty directory blocks from block %ld.\n", REMOVE_DIRECTORY_ENTRY, new_num_blocks);
+        return false;
+    }
+    dir_inode->i_file_size = dir_inode->i_blocks_num * BLOCK_SIZE;
+    dir_cache_truncate(dir_inode);
+    return true;
+}
+
+bool remove_directory_entry_at(struct inode** dir_inode, const struct fileposition* const file_pos)
+{
+    // Mark the record deleted, keeping its length so the records after it stay where they are.
+    char* dblock = file_pos->p_block;
+    ((ssize_t*)(dblock + file_pos->offset + RECORD_LENGTH))[0] = RECORD_DELETED_INUM;
+    bool is_inline = (file_pos->p_plock_num == INLINE_DIR_BLOCK_NUM);
+
+    // An inline directory has no room to spare for holes, and is compacted. In a data block the
+    // holes are only joined, and filled again by add_directory_entry.
+    bool empty;
+    if(is_inline)
+    {
+        compact_directory_block(dblock);
+        empty = ((unsigned short*)dblock)[0] == 0;
+    }
+    else
+        empty = merge_deleted_records(dblock);
+
+    if(!write_directory_position(*dir_inode, file_pos))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", REMOVE_DIRECTORY_ENTRY, file_pos->p_plock_num);
+        return false;
+    }
+    if(!is_inline)
+        dir_cache_update_space(*dir_inode, file_pos->l_block_num, get_dir_block_free_space(dblock));
 
     time_t curr_time = time(NULL);
     (*dir_inode)->i_ctime = curr_time;
     (*dir_inode)->i_mtime = curr_time;
     (*dir_inode)->i_child_num--;
+
+    if(!is_inline && empty && file_pos->l_block_num == (*dir_inode)->i_blocks_num - 1)
+    {
+        return shrink_directory(*dir_inode);
+    }
+    return true;
+}
+
+bool rename_directory_entry_in_place(struct inode* dir_inode, const struct fileposition* const file_pos, const char* const new_name)
+{
+    char* record = file_pos->p_block + file_pos->offset;
+    unsigned short rec_len = ((unsigned short*)record)[0];
+    ssize_t new_name_len = strlen(new_name) + 1;  // add \0
+    if(new_name_len > MAX_FILE_NAME_LENGTH + 1 || new_name_len > rec_len - RECORD_FIXED_LEN)
+    {
+        return false;
+    }
+
+    // Zero the whole name area so that no part of the old name is left behind the new \0.
+    memset(record + RECORD_FIXED_LEN, 0, rec_len - RECORD_FIXED_LEN);
+    memcpy(record + RECORD_FIXED_LEN, new_name, new_name_len);
+    ((unsigned short*)(record + RECORD_TAG_OFFSET))[0] = get_name_tag(new_name, new_name_len - 1);
+    if(!write_directory_position(dir_inode, file_pos))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", RENAME_DIRECTORY_ENTRY, file_pos->p_plock_num);
+        return false;
+    }
+    dir_cache_add_name(dir_inode, new_name, new_name_len - 1);
+    return true;
+}
+
+bool set_directory_entry_inum(struct inode* dir_inode, const struct fileposition* const file_pos, ssize_t child_inum, mode_t child_mode)
+{
+    ((ssize_t*)(file_pos->p_block + file_pos->offset + RECORD_LENGTH))[0] = child_inum;
+    file_pos->p_block[file_pos->offset + RECORD_LENGTH + RECORD_INUM] = MODE_TO_RECORD_TYPE(child_mode);
+    if(!write_directory_position(dir_inode, file_pos))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error writing data block %ld to disk.\n", SET_DIRECTORY_ENTRY_INUM, file_pos->p_plock_num);
+        return false;
+    }
     return true;
 }
 
@@ -228,6 +520,7 @@ struct fileposition get_file_position_in_dir(const char* const file_name, const
     filepos.offset = -1;
     filepos.p_block = NULL;
     filepos.p_plock_num = -1;
+    filepos.l_block_num = -1;
 
     if (!S_ISDIR(parent_inode->i_mode))
     {
@@ -241,36 +534,51 @@ struct fileposition get_file_position_in_dir(const char* const file_name, const
         fuse_log(FUSE_LOG_ERR, "%s : File name is > 255 bytes.\n", GET_FILE_POS_IN_DIR);
         return filepos;
     }
+    // Most lookups of names that are not there end here, without reading any block.
+    if(!dir_cache_may_contain(parent_inode, file_name, file_name_len))
+    {
+        return filepos;
+    }
+    unsigned short file_name_tag = get_name_tag(file_name, file_name_len);
 
     ssize_t prev_block = 0;
-    for(ssize_t l_block_num = 0; l_block_num < parent_inode->i_blocks_num; l_block_num++)
+    ssize_t num_blocks = get_directory_block_count(parent_inode);
+    for(ssize_t l_block_num = 0; l_block_num < num_blocks; l_block_num++)
     {
-        filepos.p_plock_num = get_disk_block_from_inode_block(parent_inode, l_block_num, &prev_block);
-
-        if(filepos.p_plock_num <= 0)
+        filepos.l_block_num = l_block_num;
+        altfs_free_memory(filepos.p_block);
+        filepos.p_block = read_directory_block(parent_inode, l_block_num, &prev_block, &filepos.p_plock_num);
+        if(filepos.p_block == NULL)
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Failed to fetch physical data block number corresponfing to file's logical block number.\n", GET_FILE_POS_IN_DIR);
             return filepos;
         }
 
-        filepos.p_block = read_data_block(filepos.p_plock_num);
-
         // traverse the data block to find an inode entry with the given file name
         ssize_t curr_pos = 0;
         while(curr_pos <= LAST_POSSIBLE_RECORD)
         {
-            unsigned short record_len = ((unsigned short*)(filepos.p_block + curr_pos))[0];
-            char* curr_file_name = filepos.p_block + curr_pos + RECORD_FIXED_LEN;
-            unsigned short curr_file_name_len = ((unsigned short)(record_len - RECORD_FIXED_LEN - 1));  // adjust for \0
-            // fuse_log(FUSE_LOG_ERR, "%s : Current record => file name: %s, rec_len: %d.\n", GET_FILE_POS_IN_DIR, curr_file_name, record_len);
+            char* record = filepos.p_block + curr_pos;
+            unsigned short record_len = ((unsigned short*)record)[0];
 
             // If record len = 0 => we are past existing records for the data block, we can move to the next data block
             if (record_len == 0)
                 break;
 
+            // Only a record with the same tag can hold the name. Deleted records are skipped too.
+            if (((unsigned short*)(record + RECORD_TAG_OFFSET))[0] != file_name_tag ||
+                ((ssize_t*)(record + RECORD_LENGTH))[0] == RECORD_DELETED_INUM) {
+                curr_pos += record_len;
+                continue;
+            }
+
+            // A record may have slack after its name (see rename_directory_entry_in_place), so the
+            // name length comes from the terminating \0 rather than from the record length.
+            char* curr_file_name = record + RECORD_FIXED_LEN;
+            ssize_t curr_file_name_len = strnlen(curr_file_name, record_len - RECORD_FIXED_LEN);
+
             // If the file name matches the input file name => we have found our file
-            if (curr_file_name_len == strlen(file_name) && 
-                strncmp(curr_file_name, file_name, curr_file_name_len) == 0) {
+            if (curr_file_name_len == file_name_len &&
+                memcmp(curr_file_name, file_name, curr_file_name_len) == 0) {
                 // fuse_log(FUSE_LOG_ERR, "%s : Match for file name: %s in physical block %ld.\n", GET_FILE_POS_IN_DIR, curr_file_name, filepos.p_plock_num);
                 filepos.offset = curr_pos;
                 return filepos;
@@ -283,57 +591,93 @@ struct fileposition get_file_position_in_dir(const char* const file_name, const
     return filepos;
 }
 
+/*
+ALGORITHM:
+
+Walk the path once, front to back, noting where each component ends and the hash of the path up to there.
+Probe the cache from the full path back towards the root; the deepest cached prefix is the starting point.
+From there, look up each remaining component in its parent directory, and cache each prefix resolved.
+*/
 ssize_t name_i(const char* const file_path)
 {
+    if (file_path == NULL || file_path[0] != '/')
+        return -1;
+
+    // Trailing '/'s do not change what a path names.
     ssize_t file_path_len = strlen(file_path);
+    while (file_path_len > 1 && file_path[file_path_len - 1] == '/')
+        file_path_len--;
 
-    if (file_path_len == 1 && file_path[0] == '/')
+    if (file_path_len == 1)
     {
         // fuse_log(FUSE_LOG_DEBUG, "%s : Path is /. Returning root inum\n", NAME_I);
         return ROOT_INODE_NUM;
     }
 
-    // Check for presence in cache
-    ssize_t inum_from_cache = get_cache_entry(inodeCache, file_path);
-    if (inum_from_cache > 0)
+    // Component i is file_path[starts[i], ends[i]), and hashes[i] = path_hash(file_path, ends[i]).
+    ssize_t max_components = file_path_len / 2 + 1;
+    ssize_t starts[max_components];
+    ssize_t ends[max_components];
+    uint64_t hashes[max_components];
+    ssize_t num_components = 0;
+    uint64_t hash = PATH_HASH_SEED;
+    ssize_t start = 0;
+    for (ssize_t i = 0; i <= file_path_len; i++)
     {
-        fuse_log(FUSE_LOG_DEBUG, "%s : Returning inum %ld for %s from cache.\n", NAME_I, inum_from_cache, file_path);
-        return inum_from_cache;
+        if (i < file_path_len && file_path[i] != '/')
+            continue;
+        hash = path_hash_component(hash, file_path + start, i - start);
+        // Empty components (from "//") are part of the hash but name nothing.
+        if (i > start)
+        {
+            if (i - start > MAX_FILE_NAME_LENGTH)
+                return -1;
+            starts[num_components] = start;
+            ends[num_components] = i;
+            hashes[num_components] = hash;
+            num_components++;
+        }
+        start = i + 1;
     }
 
-    // Recursively get inum from parent
-    char parent_path[file_path_len + 1];
-    if (!copy_parent_path(parent_path, file_path, file_path_len))
-        return -1;
-    
-    ssize_t parent_inum = name_i(parent_path);
-    if (parent_inum == -1)
+    // Start from the deepest cached prefix.
+    ssize_t inum = ROOT_INODE_NUM;
+    ssize_t first_uncached = 0;
+    for (ssize_t i = num_components - 1; i >= 0; i--)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Parent %s not found.\n", NAME_I, parent_path);
-        return -1;
+        ssize_t inum_from_cache = get_cache_entry_hashed(inodeCache, file_path, ends[i], hashes[i]);
+        if (inum_from_cache > 0)
+        {
+            inum = inum_from_cache;
+            first_uncached = i + 1;
+            break;
+        }
     }
 
-    struct inode* inodeObj = get_inode(parent_inum);
-    char child_path[file_path_len + 1];
-    if(!copy_file_name(child_path, file_path, file_path_len)){
-        altfs_free_memory(inodeObj);
-        return -1;
-    }
+    struct inode dir_inode;
+    char child_name[MAX_FILE_NAME_LENGTH + 1];
+    for (ssize_t i = first_uncached; i < num_components; i++)
+    {
+        if (!get_inodes(&inum, 1, &dir_inode))
+            return -1;
 
-    // find the position of the file in the dir
-    struct fileposition filepos = get_file_position_in_dir(child_path, inodeObj);
-    altfs_free_memory(inodeObj);
-    
-    if(filepos.offset == -1){
+        ssize_t child_name_len = ends[i] - starts[i];
+        memcpy(child_name, file_path + starts[i], child_name_len);
+        child_name[child_name_len] = '\0';
+
+        // find the position of the file in the dir
+        struct fileposition filepos = get_file_position_in_dir(child_name, &dir_inode);
+        if (filepos.offset == -1)
+        {
+            altfs_free_memory(filepos.p_block);
+            return -1;
+        }
+        inum = ((ssize_t*) (filepos.p_block + filepos.offset + RECORD_LENGTH))[0];
         altfs_free_memory(filepos.p_block);
-        return -1;
-    }
 
-    ssize_t inum = ((ssize_t*) (filepos.p_block + filepos.offset + RECORD_LENGTH))[0];
-    
-    altfs_free_memory(filepos.p_block);
-    set_cache_entry(inodeCache, file_path, inum);
-    // fuse_log(FUSE_LOG_DEBUG, "%s : Added cache entry %ld for %s.\n", NAME_I, inum, file_path);
+        set_cache_entry_hashed(inodeCache, file_path, ends[i], hashes[i], inum);
+        // fuse_log(FUSE_LOG_DEBUG, "%s : Added cache entry %ld for %s.\n", NAME_I, inum, file_path);
+    }
     return inum;
 }
 
@@ -346,6 +690,15 @@ bool setup_filesystem()
         return false;
     }
 
+    // Hints left over from a previous mount (or format) may not describe this disk.
+    flush_dir_cache();
+
+    if(!load_inode_bitmap())
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not build the inode bitmap, aborting initialization!\n", SETUP_FILESYSTEM);
+        return false;
+    }
+
     // Create a cache that can be used to implement namei
     inodeCache = create_inode_cache(CACHE_CAPACITY);
     if(inodeCache == NULL)
@@ -390,7 +743,7 @@ bool setup_filesystem()
     root_dir->i_child_num = 0;
 
     char* dir_name = ".";
-    if(!add_directory_entry(&root_dir, ROOT_INODE_NUM, dir_name)){
+    if(!add_directory_entry(&root_dir, ROOT_INODE_NUM, S_IFDIR, dir_name)){
         fuse_log(FUSE_LOG_ERR, "%s : Failed to add . entry for root directory\n", SETUP_FILESYSTEM);
         teardown();
         return false;
@@ -399,7 +752,7 @@ bool setup_filesystem()
     fuse_log(FUSE_LOG_DEBUG, "%s : Successfully added . entry for root directory\n", SETUP_FILESYSTEM);
 
     dir_name = "..";
-    if(!add_directory_entry(&root_dir, ROOT_INODE_NUM, dir_name)){
+    if(!add_directory_entry(&root_dir, ROOT_INODE_NUM, S_IFDIR, dir_name)){
         fuse_log(FUSE_LOG_ERR, "%s : Failed to add .. entry for root directory\n", SETUP_FILESYSTEM);
         teardown();
         return false;
@@ -432,6 +785,7 @@ bool remove_from_inode_cache(const char* path)
 void flush_inode_cache(bool create)
 {
     free_inode_cache(inodeCache);
+    inodeCache = NULL;
     if(create)
         inodeCache = create_inode_cache(CACHE_CAPACITY);
 }
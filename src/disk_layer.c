@@ -9,6 +9,70 @@
     static char *mem_ptr;
 #endif 
 
+/*
+Prefetch cache: direct-mapped on the block id. A slot is QUEUED while the worker thread reads its
+block, and VALID once it holds the block's contents. A write to the block empties the slot, so that
+the worker drops the contents it read if the write came in between.
+*/
+enum prefetch_state { PREFETCH_EMPTY, PREFETCH_QUEUED, PREFETCH_VALID };
+
+struct prefetch_slot {
+    ssize_t blockid;
+    enum prefetch_state state;
+    char* data;     // BLOCK_SIZE bytes, allocated when the slot is first used
+};
+
+static struct prefetch_slot prefetchCache[PREFETCH_CACHE_SLOTS];
+static ssize_t prefetchQueue[PREFETCH_QUEUE_SIZE];
+static ssize_t prefetchQueueHead = 0;      // next block for the worker
+static ssize_t prefetchQueueLength = 0;
+static bool prefetchWorkerRunning = false;
+static bool prefetchWorkerStop = false;
+static pthread_t prefetchWorker;
+static pthread_mutex_t prefetchLock = PTHREAD_MUTEX_INITIALIZER;   // guards all of the above
+static pthread_cond_t prefetchQueued = PTHREAD_COND_INITIALIZER;
+
+static inline struct prefetch_slot* get_prefetch_slot(ssize_t blockid)
+{
+    return &prefetchCache[blockid % PREFETCH_CACHE_SLOTS];
+}
+
+/*
+Running transaction of the journal: the blocks logged since the last commit, in the order they were
+first logged, with their newest contents. journalBlocks is laid out as the descriptor blocks.
+*/
+static bool journalEnabled = false;
+static ssize_t journalHandles = 0;         // operations between altfs_journal_start and altfs_journal_stop
+static uint64_t journalSequence = 0;       // number of the last committed transaction
+static ssize_t journalCount = 0;           // blocks in the running transaction
+static time_t journalStarted = 0;          // when its first block was logged
+static int64_t journalBlocks[JOURNAL_DESCRIPTOR_BLOCKS * JOURNAL_IDS_PER_BLOCK];
+static char* journalImages = NULL;         // JOURNAL_MAX_BLOCKS * BLOCK_SIZE, contents of journalBlocks
+static ssize_t journalIndex[JOURNAL_INDEX_SLOTS];   // position + 1 in journalBlocks, 0 if the slot is empty
+static bool journalCommitWaiting = false;  // the transaction waits for its operations to end, new ones wait for it
+static bool journalCommitterWaiting = false;   // ... and a caller of commit_journal commits it, not the last operation
+static pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER;    // guards all of the above; taken before prefetchLock
+static pthread_cond_t journalIdle = PTHREAD_COND_INITIALIZER;      // journalHandles dropped to 0
+static pthread_cond_t journalCommitted = PTHREAD_COND_INITIALIZER; // journalCommitWaiting was cleared
+static __thread ssize_t threadJournalHandles = 0;  // operations the thread is in
+
+// Batched syncs: the syncs asked for while one is running share the next one.
+static uint64_t syncRequested = 0;          // number of syncs asked for
+static uint64_t syncCompleted = 0;          // syncs asked for up to this number are done
+static bool syncRunning = false;
+static bool syncResult = true;              // result of the last sync
+static pthread_mutex_t syncLock = PTHREAD_MUTEX_INITIALIZER;   // guards the four above
+static pthread_cond_t syncDone = PTHREAD_COND_INITIALIZER;
+
+// Slot of a block in journalIndex (linear probing), or the empty slot where it goes.
+static ssize_t* find_journal_index(ssize_t blockid)
+{
+    ssize_t slot = (((uint64_t)blockid * 0x9e3779b97f4a7c15ull) >> 32) % JOURNAL_INDEX_SLOTS;
+    while(journalIndex[slot] != 0 && journalBlocks[journalIndex[slot] - 1] != blockid)
+        slot = (slot + 1) % JOURNAL_INDEX_SLOTS;
+    return &journalIndex[slot];
+}
+
 bool altfs_alloc_memory(bool erase)
 {
     #ifdef DISK_MEMORY
@@ -75,8 +139,34 @@ bool altfs_open_volume()
     return true;
 }
 
+static void stop_prefetch_worker()
+{
+    pthread_mutex_lock(&prefetchLock);
+    bool running = prefetchWorkerRunning;
+    prefetchWorkerStop = true;
+    pthread_cond_signal(&prefetchQueued);
+    pthread_mutex_unlock(&prefetchLock);
+    if(running)
+        pthread_join(prefetchWorker, NULL);
+
+    pthread_mutex_lock(&prefetchLock);
+    for(ssize_t i = 0; i < PREFETCH_CACHE_SLOTS; i++)
+    {
+        altfs_free_memory(prefetchCache[i].data);
+        memset(&prefetchCache[i], 0, sizeof(struct prefetch_slot));
+    }
+    prefetchQueueLength = 0;
+    prefetchWorkerRunning = false;
+    prefetchWorkerStop = false;
+    pthread_mutex_unlock(&prefetchLock);
+}
+
+static bool close_journal();
+
 bool altfs_dealloc_memory()
 {
+    close_journal();
+    stop_prefetch_worker();
     #ifdef DISK_MEMORY
         if (close(mem_ptr) != 0)
         {
@@ -101,6 +191,23 @@ bool isBlockOutOfRange(ssize_t blockid)
     return (blockid < 0 || blockid >= BLOCK_COUNT);
 }
 
+// Read a block from the device, without looking at the prefetch cache.
+static bool read_block_from_volume(ssize_t blockid, char *buffer)
+{
+    #ifdef DISK_MEMORY
+        off_t offset = (unsigned long) BLOCK_SIZE * blockid;
+        if(pread(mem_ptr, buffer, BLOCK_SIZE, offset) != BLOCK_SIZE)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s: Reading contents of disk failed for block id %zd\n", ALTFS_READ_BLOCK, blockid);
+            return false;
+        }
+    #else
+        ssize_t offset = blockid * BLOCK_SIZE;
+        memcpy(buffer, mem_ptr+offset, BLOCK_SIZE);
+    #endif // DISK_MEMORY
+    return true;
+}
+
 bool altfs_read_block(ssize_t blockid, char *buffer)
 {
     if (!buffer)
@@ -110,23 +217,68 @@ bool altfs_read_block(ssize_t blockid, char *buffer)
         fuse_log(FUSE_LOG_ERR, "%s : Error reading block from disk. Block id out of range: %ld\n", ALTFS_READ_BLOCK, blockid);
         return false;
     }
+    pthread_mutex_lock(&journalLock);
+    if(journalEnabled)
+    {
+        ssize_t* index = find_journal_index(blockid);
+        if(*index != 0)
+        {
+            memcpy(buffer, journalImages + (*index - 1) * BLOCK_SIZE, BLOCK_SIZE);
+            pthread_mutex_unlock(&journalLock);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&journalLock);
+
+    pthread_mutex_lock(&prefetchLock);
+    struct prefetch_slot* slot = get_prefetch_slot(blockid);
+    if(slot->blockid == blockid && slot->state == PREFETCH_VALID)
+    {
+        memcpy(buffer, slot->data, BLOCK_SIZE);
+        pthread_mutex_unlock(&prefetchLock);
+        return true;
+    }
+    pthread_mutex_unlock(&prefetchLock);
+    return read_block_from_volume(blockid, buffer);
+}
+
+// Write a block to the device, without looking at the journal or the prefetch cache.
+static bool write_block_to_volume(ssize_t blockid, char *buffer)
+{
     #ifdef DISK_MEMORY
         off_t offset = (unsigned long) BLOCK_SIZE * blockid;
-        off_t lseek_status = lseek(mem_ptr, offset, SEEK_SET);
-        if(lseek_status == -1)
+        if(pwrite(mem_ptr, buffer, BLOCK_SIZE, offset) != BLOCK_SIZE)
         {
-            fuse_log(FUSE_LOG_ERR, "%s : lseek to offset %jd failed for block id %zd\n", ALTFS_READ_BLOCK, offset, blockid);
+            fuse_log(FUSE_LOG_ERR, "%s : Writing contents to disk failed for block id %zd\n", ALTFS_WRITE_BLOCK, blockid);
             return false;
         }
-        if(read(mem_ptr, buffer, BLOCK_SIZE) != BLOCK_SIZE)
+    #else
+        ssize_t offset = BLOCK_SIZE * blockid;
+        memcpy(mem_ptr+offset, buffer, BLOCK_SIZE);
+    #endif
+    return true;
+}
+
+// Call after the block was written: a prefetch that read the old contents in the meantime is thrown away.
+static void drop_prefetched_block(ssize_t blockid)
+{
+    pthread_mutex_lock(&prefetchLock);
+    struct prefetch_slot* slot = get_prefetch_slot(blockid);
+    if(slot->blockid == blockid)
+        slot->state = PREFETCH_EMPTY;
+    pthread_mutex_unlock(&prefetchLock);
+}
+
+// Wait for the writes to the device to be on it.
+static bool flush_volume()
+{
+    #ifdef DISK_MEMORY
+        if(fsync(mem_ptr) != 0)
         {
-            fuse_log(FUSE_LOG_ERR, "%s: Reading contents of disk failed\n", ALTFS_READ_BLOCK);
+            fuse_log(FUSE_LOG_ERR, "%s : Flushing the device failed.\n", ALTFS_JOURNAL);
             return false;
         }
-    #else
-        ssize_t offset = blockid * BLOCK_SIZE;
-        memcpy(buffer, mem_ptr+offset, BLOCK_SIZE);
-    #endif // DISK_MEMORY
+    #endif
     return true;
 }
 
@@ -139,24 +291,483 @@ bool altfs_write_block(ssize_t blockid, char *buffer)
         fuse_log(FUSE_LOG_ERR, "%s : Error writing block to disk. Block id is out of range\n",ALTFS_WRITE_BLOCK);
         return false;
     }
-    
-    #ifdef DISK_MEMORY
-        off_t offset = (unsigned long) BLOCK_SIZE * blockid;
-        off_t lseek_status = lseek(mem_ptr, offset, SEEK_SET);
-        if(lseek_status == -1)
+
+    // A block of the running transaction is newer there than at home: it goes home with the transaction.
+    pthread_mutex_lock(&journalLock);
+    if(journalEnabled)
+    {
+        ssize_t* index = find_journal_index(blockid);
+        if(*index != 0)
         {
-            fuse_log(FUSE_LOG_ERR, "%s : lseek to offset %jd failed for block id %zd\n", ALTFS_WRITE_BLOCK, offset, blockid);
-            return false;
+            memcpy(journalImages + (*index - 1) * BLOCK_SIZE, buffer, BLOCK_SIZE);
+            pthread_mutex_unlock(&journalLock);
+            return true;
+        }
+    }
+    pthread_mutex_unlock(&journalLock);
+
+    if(!write_block_to_volume(blockid, buffer))
+        return false;
+    drop_prefetched_block(blockid);
+    return true;
+}
+
+static void* run_prefetch_worker(void* arg)
+{
+    char buffer[BLOCK_SIZE];
+    pthread_mutex_lock(&prefetchLock);
+    while(true)
+    {
+        while(prefetchQueueLength == 0 && !prefetchWorkerStop)
+            pthread_cond_wait(&prefetchQueued, &prefetchLock);
+        if(prefetchWorkerStop)
+            break;
+        ssize_t blockid = prefetchQueue[prefetchQueueHead];
+        prefetchQueueHead = (prefetchQueueHead + 1) % PREFETCH_QUEUE_SIZE;
+        prefetchQueueLength--;
+        pthread_mutex_unlock(&prefetchLock);
+
+        bool res = read_block_from_volume(blockid, buffer);
+
+        pthread_mutex_lock(&prefetchLock);
+        struct prefetch_slot* slot = get_prefetch_slot(blockid);
+        if(slot->blockid == blockid && slot->state == PREFETCH_QUEUED)
+        {
+            if(res)
+            {
+                memcpy(slot->data, buffer, BLOCK_SIZE);
+                slot->state = PREFETCH_VALID;
+            }
+            else
+                slot->state = PREFETCH_EMPTY;
+        }
+    }
+    pthread_mutex_unlock(&prefetchLock);
+    return NULL;
+}
+
+ssize_t altfs_prefetch_blocks(const ssize_t* blockids, ssize_t count)
+{
+    ssize_t queued = 0;
+    pthread_mutex_lock(&prefetchLock);
+    if(!prefetchWorkerRunning)
+    {
+        if(pthread_create(&prefetchWorker, NULL, run_prefetch_worker, NULL) != 0)
+        {
+            pthread_mutex_unlock(&prefetchLock);
+            fuse_log(FUSE_LOG_ERR, "%s : Could not start the prefetch thread.\n", ALTFS_PREFETCH_BLOCKS);
+            return 0;
+        }
+        prefetchWorkerRunning = true;
+    }
+    for(ssize_t i = 0; i < count && prefetchQueueLength < PREFETCH_QUEUE_SIZE; i++)
+    {
+        if(isBlockOutOfRange(blockids[i]))
+            continue;
+        struct prefetch_slot* slot = get_prefetch_slot(blockids[i]);
+        if(slot->blockid == blockids[i] && slot->state != PREFETCH_EMPTY)
+            continue;
+        if(slot->data == NULL && (slot->data = (char*) malloc(BLOCK_SIZE)) == NULL)
+            break;
+        // A block queued earlier in this slot is dropped when the worker gets to it.
+        slot->blockid = blockids[i];
+        slot->state = PREFETCH_QUEUED;
+        prefetchQueue[(prefetchQueueHead + prefetchQueueLength) % PREFETCH_QUEUE_SIZE] = blockids[i];
+        prefetchQueueLength++;
+        queued++;
+    }
+    if(queued > 0)
+        pthread_cond_signal(&prefetchQueued);
+    pthread_mutex_unlock(&prefetchLock);
+    return queued;
+}
+
+static uint64_t fnv_hash(uint64_t hash, const char* data, ssize_t length)
+{
+    for(ssize_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+static uint64_t journal_checksum(const char* descriptors, const char* images, ssize_t count)
+{
+    ssize_t descriptor_blocks = (count + JOURNAL_IDS_PER_BLOCK - 1) / JOURNAL_IDS_PER_BLOCK;
+    uint64_t hash = fnv_hash(0xcbf29ce484222325ull, descriptors, descriptor_blocks * BLOCK_SIZE);
+    return fnv_hash(hash, images, count * BLOCK_SIZE);
+}
+
+static bool write_journal_header(uint64_t sequence, ssize_t count, uint64_t checksum)
+{
+    char buffer[BLOCK_SIZE];
+    memset(buffer, 0, BLOCK_SIZE);
+    struct journal_header* header = (struct journal_header*) buffer;
+    header->j_magic = JOURNAL_MAGIC;
+    header->j_sequence = sequence;
+    header->j_count = count;
+    header->j_checksum = checksum;
+    return write_block_to_volume(JOURNAL_FIRST_BLOCK, buffer);
+}
+
+// Call with journalLock held.
+static bool commit_journal_locked()
+{
+    if(journalCount == 0)
+        return true;
+
+    ssize_t descriptor_blocks = (journalCount + JOURNAL_IDS_PER_BLOCK - 1) / JOURNAL_IDS_PER_BLOCK;
+    char* descriptors = (char*) journalBlocks;
+    bool logged = true;
+    for(ssize_t i = 0; logged && i < descriptor_blocks; i++)
+        logged = write_block_to_volume(JOURNAL_FIRST_BLOCK + 1 + i, descriptors + i * BLOCK_SIZE);
+    for(ssize_t i = 0; logged && i < journalCount; i++)
+        logged = write_block_to_volume(JOURNAL_FIRST_LOG_BLOCK + i, journalImages + i * BLOCK_SIZE);
+    // The single flush of the commit: the header only counts with the blocks it was written with.
+    logged = logged && write_journal_header(journalSequence + 1, journalCount, journal_checksum(descriptors, journalImages, journalCount))
+        && flush_volume();
+    if(logged)
+        journalSequence++;
+    else
+        fuse_log(FUSE_LOG_ERR, "%s : Could not log transaction %lu, writing its %ld blocks without it.\n",
+            ALTFS_JOURNAL, journalSequence + 1, journalCount);
+
+    bool res = logged;
+    for(ssize_t i = 0; i < journalCount; i++)
+    {
+        if(!write_block_to_volume(journalBlocks[i], journalImages + i * BLOCK_SIZE))
+            res = false;
+        drop_prefetched_block(journalBlocks[i]);
+    }
+    // Left with its count if a block did not make it home, so that the next mount writes it again.
+    if(res && !(flush_volume() && write_journal_header(journalSequence, 0, 0)))
+        res = false;
+    if(!res)
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write transaction %lu home.\n", ALTFS_JOURNAL, journalSequence);
+    else
+        fuse_log(FUSE_LOG_DEBUG, "%s : Committed transaction %lu with %ld blocks.\n", ALTFS_JOURNAL, journalSequence, journalCount);
+
+    memset(journalBlocks, 0, sizeof(journalBlocks));
+    memset(journalIndex, 0, sizeof(journalIndex));
+    journalCount = 0;
+    return res;
+}
+
+bool altfs_format_journal()
+{
+    if(!write_journal_header(0, 0, 0))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write the journal header.\n", ALTFS_JOURNAL);
+        return false;
+    }
+    return true;
+}
+
+// Write the blocks of a committed transaction home, if the log holds all of them.
+static bool replay_transaction(const struct journal_header* header)
+{
+    if(header->j_count < 0 || header->j_count > JOURNAL_MAX_BLOCKS)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Journal header has %ld blocks, ignoring it.\n", ALTFS_JOURNAL, (ssize_t)header->j_count);
+        return true;
+    }
+    ssize_t count = header->j_count;
+    ssize_t descriptor_blocks = (count + JOURNAL_IDS_PER_BLOCK - 1) / JOURNAL_IDS_PER_BLOCK;
+    char* descriptors = (char*) calloc(descriptor_blocks, BLOCK_SIZE);
+    char* images = (char*) malloc(count * BLOCK_SIZE);
+    if(descriptors == NULL || images == NULL)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not allocate memory to replay transaction %lu.\n", ALTFS_JOURNAL, header->j_sequence);
+        altfs_free_memory(descriptors);
+        altfs_free_memory(images);
+        return false;
+    }
+
+    bool res = true;
+    for(ssize_t i = 0; res && i < descriptor_blocks; i++)
+        res = read_block_from_volume(JOURNAL_FIRST_BLOCK + 1 + i, descriptors + i * BLOCK_SIZE);
+    for(ssize_t i = 0; res && i < count; i++)
+        res = read_block_from_volume(JOURNAL_FIRST_LOG_BLOCK + i, images + i * BLOCK_SIZE);
+
+    if(res && journal_checksum(descriptors, images, count) != header->j_checksum)
+    {
+        // The commit did not finish: none of the transaction reached home.
+        fuse_log(FUSE_LOG_ERR, "%s : Transaction %lu was not fully logged, dropping it.\n", ALTFS_JOURNAL, header->j_sequence);
+    }
+    else if(res)
+    {
+        // Every block is checked before any goes home, so that a bad log leaves the volume untouched.
+        // Block 0 is the superblock, which is logged like any other metadata block.
+        int64_t* blockids = (int64_t*) descriptors;
+        for(ssize_t i = 0; res && i < count; i++)
+        {
+            if(isBlockOutOfRange(blockids[i]) || blockids[i] >= JOURNAL_FIRST_BLOCK)
+            {
+                fuse_log(FUSE_LOG_ERR, "%s : Transaction %lu logs block %ld outside the file system.\n",
+                    ALTFS_JOURNAL, header->j_sequence, (ssize_t)blockids[i]);
+                res = false;
+            }
         }
-        if(write(mem_ptr, buffer, BLOCK_SIZE) != BLOCK_SIZE)
+        for(ssize_t i = 0; res && i < count; i++)
+            res = write_block_to_volume(blockids[i], images + i * BLOCK_SIZE);
+        res = res && flush_volume();
+        if(res)
+            fuse_log(FUSE_LOG_DEBUG, "%s : Replayed transaction %lu with %ld blocks.\n", ALTFS_JOURNAL, header->j_sequence, count);
+    }
+    altfs_free_memory(descriptors);
+    altfs_free_memory(images);
+    return res;
+}
+
+bool altfs_replay_journal()
+{
+    char buffer[BLOCK_SIZE];
+    if(!read_block_from_volume(JOURNAL_FIRST_BLOCK, buffer))
+        return false;
+    struct journal_header header;
+    memcpy(&header, buffer, sizeof(struct journal_header));
+    if(header.j_magic != JOURNAL_MAGIC)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : No journal found. Run mkfs again.\n", ALTFS_JOURNAL);
+        return false;
+    }
+    if(header.j_count != 0)
+    {
+        if(!replay_transaction(&header))
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Writing contents to disk failed\n", ALTFS_WRITE_BLOCK);
+            fuse_log(FUSE_LOG_ERR, "%s : Could not replay transaction %lu.\n", ALTFS_JOURNAL, header.j_sequence);
             return false;
         }
-    #else
-        ssize_t offset = BLOCK_SIZE * blockid;
-        memcpy(mem_ptr+offset, buffer, BLOCK_SIZE);
-    #endif
+        if(!write_journal_header(header.j_sequence, 0, 0) || !flush_volume())
+            return false;
+    }
+
+    pthread_mutex_lock(&journalLock);
+    if(journalImages == NULL)
+        journalImages = (char*) malloc(JOURNAL_MAX_BLOCKS * BLOCK_SIZE);
+    bool res = journalImages != NULL;
+    if(res)
+    {
+        memset(journalBlocks, 0, sizeof(journalBlocks));
+        memset(journalIndex, 0, sizeof(journalIndex));
+        journalCount = 0;
+        journalHandles = 0;
+        journalSequence = header.j_sequence;
+        journalEnabled = true;
+    }
+    else
+        fuse_log(FUSE_LOG_ERR, "%s : Could not allocate memory for the journal.\n", ALTFS_JOURNAL);
+    pthread_mutex_unlock(&journalLock);
+    return res;
+}
+
+bool altfs_journal_enabled()
+{
+    pthread_mutex_lock(&journalLock);
+    bool enabled = journalEnabled;
+    pthread_mutex_unlock(&journalLock);
+    return enabled;
+}
+
+uint64_t altfs_journal_sequence()
+{
+    pthread_mutex_lock(&journalLock);
+    uint64_t sequence = journalSequence;
+    pthread_mutex_unlock(&journalLock);
+    return sequence;
+}
+
+bool altfs_journal_logged(ssize_t blockid)
+{
+    if(isBlockOutOfRange(blockid))
+        return false;
+    pthread_mutex_lock(&journalLock);
+    bool logged = journalEnabled && *find_journal_index(blockid) != 0;
+    pthread_mutex_unlock(&journalLock);
+    return logged;
+}
+
+void altfs_journal_request_commit()
+{
+    pthread_mutex_lock(&journalLock);
+    if(journalEnabled && journalCount > 0)
+    {
+        // The last running operation commits the transaction.
+        if(journalHandles > 0)
+            journalCommitWaiting = true;
+        else if(!commit_journal_locked())
+            fuse_log(FUSE_LOG_ERR, "%s : Could not commit the transaction on request.\n", ALTFS_JOURNAL);
+    }
+    pthread_mutex_unlock(&journalLock);
+}
 
+bool altfs_journal_block(ssize_t blockid, char *buffer)
+{
+    if(!buffer)
+        return false;
+    if(isBlockOutOfRange(blockid))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Block id out of range: %ld\n", ALTFS_JOURNAL, blockid);
+        return false;
+    }
+
+    pthread_mutex_lock(&journalLock);
+    if(!journalEnabled)
+    {
+        pthread_mutex_unlock(&journalLock);
+        return altfs_write_block(blockid, buffer);
+    }
+    ssize_t* index = find_journal_index(blockid);
+    if(*index == 0 && journalCount == JOURNAL_MAX_BLOCKS)
+    {
+        // Only writes made outside of operations get here: the operations fit in what they reserved.
+        if(journalHandles > 0)
+            fuse_log(FUSE_LOG_ERR, "%s : Transaction full with %ld operations running, committing them unfinished.\n",
+                ALTFS_JOURNAL, journalHandles);
+        if(!commit_journal_locked())
+        {
+            pthread_mutex_unlock(&journalLock);
+            fuse_log(FUSE_LOG_ERR, "%s : Could not commit the full transaction to log block %ld.\n", ALTFS_JOURNAL, blockid);
+            return false;
+        }
+        index = find_journal_index(blockid);
+    }
+    if(*index == 0)
+    {
+        if(journalCount == 0)
+            journalStarted = time(NULL);
+        journalBlocks[journalCount] = blockid;
+        *index = ++journalCount;
+    }
+    memcpy(journalImages + (*index - 1) * BLOCK_SIZE, buffer, BLOCK_SIZE);
+    pthread_mutex_unlock(&journalLock);
     return true;
 }
+
+void altfs_journal_start()
+{
+    pthread_mutex_lock(&journalLock);
+    // Room is kept for every running operation to log JOURNAL_OPERATION_BLOCKS blocks.
+    while(journalCommitWaiting ||
+        (journalEnabled && journalCount + (journalHandles + 1) * JOURNAL_OPERATION_BLOCKS > JOURNAL_MAX_BLOCKS))
+    {
+        if(!journalCommitWaiting && journalHandles == 0)
+        {
+            commit_journal_locked();
+            continue;
+        }
+        // The last running operation commits the transaction.
+        journalCommitWaiting = true;
+        pthread_cond_wait(&journalCommitted, &journalLock);
+    }
+    journalHandles++;
+    threadJournalHandles++;
+    pthread_mutex_unlock(&journalLock);
+}
+
+bool altfs_journal_stop()
+{
+    bool res = true;
+    pthread_mutex_lock(&journalLock);
+    journalHandles--;
+    threadJournalHandles--;
+    if(journalHandles == 0 && journalCommitterWaiting)
+        pthread_cond_signal(&journalIdle);
+    else if(journalHandles == 0 && (journalCommitWaiting || (journalCount > 0 &&
+        (journalCount >= JOURNAL_COMMIT_BLOCKS || time(NULL) - journalStarted >= JOURNAL_COMMIT_INTERVAL))))
+    {
+        res = commit_journal_locked();
+        journalCommitWaiting = false;
+        pthread_cond_broadcast(&journalCommitted);
+    }
+    pthread_mutex_unlock(&journalLock);
+    return res;
+}
+
+bool altfs_journal_restart()
+{
+    if(threadJournalHandles == 0)
+        return true;
+    bool res = altfs_journal_stop();
+    altfs_journal_start();
+    return res;
+}
+
+/*
+Commit the running transaction once the operations in it have ended, holding back new ones.
+
+@param flush: Flush the device even if there is nothing to commit.
+*/
+static bool commit_journal(bool flush)
+{
+    pthread_mutex_lock(&journalLock);
+    while(journalCommitWaiting)
+        pthread_cond_wait(&journalCommitted, &journalLock);
+    journalCommitWaiting = true;
+    journalCommitterWaiting = true;
+    while(journalHandles > 0)
+        pthread_cond_wait(&journalIdle, &journalLock);
+    // A commit flushes the device after the blocks went home, and with them everything written before.
+    bool res = journalCount > 0 ? commit_journal_locked() : (!flush || flush_volume());
+    journalCommitWaiting = false;
+    journalCommitterWaiting = false;
+    pthread_cond_broadcast(&journalCommitted);
+    pthread_mutex_unlock(&journalLock);
+    return res;
+}
+
+bool altfs_journal_commit()
+{
+    return commit_journal(false);
+}
+
+bool altfs_sync_volume()
+{
+    return commit_journal(true);
+}
+
+bool altfs_sync_volume_batched()
+{
+    pthread_mutex_lock(&syncLock);
+    uint64_t ticket = ++syncRequested;
+    while(syncCompleted < ticket)
+    {
+        if(syncRunning)
+        {
+            pthread_cond_wait(&syncDone, &syncLock);
+            continue;
+        }
+        syncRunning = true;
+        pthread_mutex_unlock(&syncLock);
+        // Gives the syncs of other threads the time to join this one.
+        usleep(SYNC_BATCH_WINDOW);
+        pthread_mutex_lock(&syncLock);
+        uint64_t covered = syncRequested;
+        pthread_mutex_unlock(&syncLock);
+
+        bool res = altfs_sync_volume();
+
+        pthread_mutex_lock(&syncLock);
+        syncCompleted = covered;
+        syncResult = res;
+        syncRunning = false;
+        pthread_cond_broadcast(&syncDone);
+    }
+    bool res = syncResult;
+    pthread_mutex_unlock(&syncLock);
+    return res;
+}
+
+// Commit what is left and stop journaling. Part of unmount.
+static bool close_journal()
+{
+    pthread_mutex_lock(&journalLock);
+    bool res = true;
+    if(journalEnabled)
+    {
+        res = commit_journal_locked();
+        altfs_free_memory(journalImages);
+        journalImages = NULL;
+        journalEnabled = false;
+    }
+    pthread_mutex_unlock(&journalLock);
+    return res;
+}
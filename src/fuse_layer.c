@@ -16,9 +16,14 @@
 #include "../src/inode_ops.c"
 #include "../src/data_block_ops.c"
 #include "../src/inode_data_block_ops.c"
+#include "../src/delayed_alloc.c"
+#include "../src/readahead.c"
+#include "../src/orphan_list.c"
 #include "../src/inode_cache.c"
+#include "../src/directory_cache.c"
 #include "../src/directory_ops.c"
 #include "../src/interface_layer.c"
+#include "../src/write_buffer.c"
 
 static int my_access(const char* path, int mode)
 {
@@ -35,13 +40,17 @@ static int my_chown(const char* path, uid_t uid, gid_t gid, struct fuse_file_inf
 static int my_chmod(const char* path, mode_t mode, struct fuse_file_info *fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nCHMOD %s %d\n", path, mode);
-    return altfs_chmod(path, mode);
+    altfs_journal_start();
+    int res = altfs_chmod(path, mode);
+    altfs_journal_stop();
+    return res;
 } 
 
 static int my_create(const char* path, mode_t mode, struct fuse_file_info* fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nCREATE %s\n", path);
     bool status = false;
+    altfs_journal_start();
     if(fi->flags & O_CREAT)
     {
         status = altfs_mknod(path, S_IFREG|mode, -1);
@@ -50,11 +59,13 @@ static int my_create(const char* path, mode_t mode, struct fuse_file_info* fi)
     {
         status = altfs_mknod(path, S_IFREG|0775, -1);
     }
+    altfs_journal_stop();
 
     if(!status)
     {
         return -1;
     }
+    fi->fh = open_write_buffer(name_i(path));
     return 0;
 }
 
@@ -67,40 +78,51 @@ static int my_getattr(const char* path, struct stat* st, struct fuse_file_info *
 static int my_open(const char* path, struct fuse_file_info* fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nOPEN %s\n", path);
+    altfs_journal_start();
     ssize_t inum = altfs_open(path, fi->flags);
+    altfs_journal_stop();
     if(inum <= -1)
     {
         return inum;
     }
+    // Small writes through this open file are collected in a buffer.
+    fi->fh = (fi->flags & (O_WRONLY | O_RDWR)) ? open_write_buffer(inum) : 0;
     return 0;
 }
 
 static int my_read(const char* path, char* buff, size_t size, off_t offset, struct fuse_file_info* fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\n");
+    // A read first writes out the file's buffered data.
+    altfs_journal_start();
     ssize_t nbytes = altfs_read(path, buff, size, offset);
+    altfs_journal_stop();
     return nbytes;
 }
 
 static int my_readdir(const char* path, void* buff, fuse_fill_dir_t filler, off_t offset,
-                        struct fuse_file_info* fi, enum fuse_readdir_flags)
+                        struct fuse_file_info* fi, enum fuse_readdir_flags flags)
 {
     fuse_log(FUSE_LOG_DEBUG, "\n");
-    (void) offset;
     (void) fi;
-    return altfs_readdir(path, buff, filler);
+    return altfs_readdir(path, buff, filler, offset, flags);
 }
 
 static int my_rmdir(const char* path)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nRMDIR %s\n", path);
-    return altfs_unlink(path);
+    altfs_journal_start();
+    int res = altfs_unlink(path);
+    altfs_journal_stop();
+    return res;
 }
 
 static int my_mkdir(const char* path, mode_t mode)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nMKDIR %s\n", path);
+    altfs_journal_start();
     bool status = altfs_mkdir(path, mode);
+    altfs_journal_stop();
     if(!status)
     {
         return -1;
@@ -111,7 +133,9 @@ static int my_mkdir(const char* path, mode_t mode)
 static int my_mknod(const char* path, mode_t mode, dev_t dev)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nMKNOD %s\n", path);
+    altfs_journal_start();
     bool status = altfs_mknod(path, mode, dev);
+    altfs_journal_stop();
     if(!status)
     {
         return -1;
@@ -128,25 +152,87 @@ static int my_utimens(const char* path, const struct timespec time_spec[2], stru
 static int my_truncate(const char* path, off_t offset, struct fuse_file_info *fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\n");
-    return altfs_truncate(path, offset);
+    altfs_journal_start();
+    int res = altfs_truncate(path, offset);
+    altfs_journal_stop();
+    return res;
 }
 
 static int my_unlink(const char* path)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nUNLINK %s\n", path);
-    return altfs_unlink(path);
+    altfs_journal_start();
+    int res = altfs_unlink(path);
+    altfs_journal_stop();
+    return res;
 }
 
 static int my_write(const char* path, const char* buff, size_t size, off_t offset, struct fuse_file_info* fi)
 {
     fuse_log(FUSE_LOG_DEBUG, "\n");
-    return altfs_write(path, buff, size, offset);
+    altfs_journal_start();
+    int res;
+    if(fi != NULL && fi->fh != 0)
+        res = buffered_write(fi->fh, buff, size, offset);
+    else
+        res = altfs_write(path, buff, size, offset);
+    altfs_journal_stop();
+    return res;
+}
+
+static int my_fsync(const char* path, int datasync, struct fuse_file_info* fi)
+{
+    fuse_log(FUSE_LOG_DEBUG, "\nFSYNC %s\n", path);
+    altfs_journal_start();
+    int res = altfs_flush(path, fi != NULL ? fi->fh : 0);
+    altfs_journal_stop();
+    // The commit waits for the running operations, so it is made after ours ended.
+    if(res == 0)
+        res = altfs_sync();
+    return res;
+}
+
+static int my_flush(const char* path, struct fuse_file_info* fi)
+{
+    fuse_log(FUSE_LOG_DEBUG, "\nFLUSH %s\n", path);
+    if(fi == NULL || fi->fh == 0)
+        return 0;
+    // Reported to close(): the buffer is written out on every close of the file, not only the last.
+    altfs_journal_start();
+    int res = altfs_flush(path, fi->fh);
+    altfs_journal_stop();
+    return res;
+}
+
+static int my_release(const char* path, struct fuse_file_info* fi)
+{
+    fuse_log(FUSE_LOG_DEBUG, "\nRELEASE %s\n", path);
+    altfs_journal_start();
+    int res = altfs_close(fi->fh);
+    altfs_journal_stop();
+    return res;
 }
 
 static int my_rename(const char *from, const char *to, unsigned int flags)
 {
     fuse_log(FUSE_LOG_DEBUG, "\nRENAME %s %s\n", from , to);
-    return altfs_rename(from, to);
+    altfs_journal_start();
+    int res = altfs_rename(from, to);
+    altfs_journal_stop();
+    return res;
+}
+
+static int my_statfs(const char* path, struct statvfs* st)
+{
+    fuse_log(FUSE_LOG_DEBUG, "\n");
+    return altfs_statfs(st);
+}
+
+static void* my_init(struct fuse_conn_info* conn, struct fuse_config* cfg)
+{
+    // Started here rather than in main: fuse_main forks into the background after altfs_init.
+    start_orphan_worker();
+    return NULL;
 }
 
 static void my_destroy(void *private_data)
@@ -169,18 +255,70 @@ static const struct fuse_operations my_ops = {
     .open     = my_open,
     .read     = my_read,
     .write    = my_write,
+    .fsync    = my_fsync,
+    .flush    = my_flush,
+    .release  = my_release,
     .utimens  = my_utimens,
     .rename   = my_rename,
+    .statfs   = my_statfs,
+    .init     = my_init,
     .destroy = my_destroy,
 };
 
+// Options of our own, given with -o next to the fuse ones.
+struct altfs_mount_options
+{
+    int recount;    // -o recount: recount free data blocks at mount
+    char* durability;   // -o durability=strict|batched|none: what fsync does (see enum durability_mode)
+};
+
+static const struct fuse_opt altfs_mount_opts[] = {
+    { "recount", offsetof(struct altfs_mount_options, recount), 1 },
+    { "durability=%s", offsetof(struct altfs_mount_options, durability), 0 },
+    FUSE_OPT_END
+};
+
+static bool parse_durability(const char* name, enum durability_mode* mode)
+{
+    if(name == NULL || strcmp(name, "strict") == 0)
+        *mode = DURABILITY_STRICT;
+    else if(strcmp(name, "batched") == 0)
+        *mode = DURABILITY_BATCHED;
+    else if(strcmp(name, "none") == 0)
+        *mode = DURABILITY_NONE;
+    else
+        return false;
+    return true;
+}
+
 int main(int argc, char* argv[])
 {
-    if(!altfs_init())
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct altfs_mount_options options = { 0 };
+    if(fuse_opt_parse(&args, &options, altfs_mount_opts, NULL) == -1)
+    {
+        printf("AltFS could not parse mount options!\n");
+        return 1;
+    }
+    // Without -o durability the default (strict) is kept.
+    enum durability_mode durability = DURABILITY_STRICT;
+    if(options.durability != NULL && !parse_durability(options.durability, &durability))
+    {
+        printf("AltFS durability must be strict, batched or none, not %s!\n", options.durability);
+        free(options.durability);
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+    free(options.durability);
+    altfs_set_durability(durability);
+    if(!altfs_init(options.recount))
     {
         printf("AltFS initialization failed!\n");
+        fuse_opt_free_args(&args);
         return 0;
     }
     umask(0000);
-    return fuse_main(argc, argv, &my_ops, NULL);
+    int ret = fuse_main(args.argc, args.argv, &my_ops, NULL);
+    fuse_opt_free_args(&args);
+    return ret;
 }
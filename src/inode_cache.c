@@ -1,37 +1,140 @@
-#include<ctype.h>
 #include "../header/inode_cache.h"
 
-// source - https://stackoverflow.com/questions/64699597/how-to-write-djb2-hashing-function-in-c
-unsigned long int hash_func(const char *str)
+/*
+wyhash (https://github.com/wangyi-fudan/wyhash, public domain).
+Reads the key 8 bytes at a time and mixes with 64x64->128 multiplies.
+*/
+static const uint64_t wy_secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+static inline void wy_mum(uint64_t* a, uint64_t* b)
+{
+    __uint128_t r = *a;
+    r *= *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+}
+
+static inline uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t wy_r8(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t wy_r4(const uint8_t* p)
 {
-    unsigned long int hash = 5381;
-    int c;
-    while ((c = *str++))
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint64_t wy_r3(const uint8_t* p, size_t k)
+{
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+static uint64_t wy_hash_bytes(const char* key, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t seed = wy_mix(wy_secret[0], wy_secret[1]);
+    uint64_t a, b;
+    if(len <= 16)
     {
-        if (isupper(c))
+        if(len >= 4)
+        {
+            a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+            b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if(len > 0)
+        {
+            a = wy_r3(p, len);
+            b = 0;
+        }
+        else
         {
-            c = c + 32;
-            hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if(i > 48)
+        {
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = wy_mix(wy_r8(p) ^ wy_secret[1], wy_r8(p + 8) ^ seed);
+                see1 = wy_mix(wy_r8(p + 16) ^ wy_secret[2], wy_r8(p + 24) ^ see1);
+                see2 = wy_mix(wy_r8(p + 32) ^ wy_secret[3], wy_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while(i > 16)
+        {
+            seed = wy_mix(wy_r8(p) ^ wy_secret[1], wy_r8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
+    }
+    a ^= wy_secret[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    return wy_mix(a ^ wy_secret[0] ^ len, b ^ wy_secret[1]);
+}
+
+uint64_t path_hash_component(uint64_t hash, const char* component, size_t len)
+{
+    return wy_mix(hash ^ wy_secret[2], wy_hash_bytes(component, len) ^ wy_secret[3]);
+}
+
+uint64_t path_hash(const char* key, size_t len)
+{
+    uint64_t hash = PATH_HASH_SEED;
+    size_t start = 0;
+    for(size_t i = 0; i <= len; i++)
+    {
+        if(i == len || key[i] == '/')
+        {
+            hash = path_hash_component(hash, key + start, i - start);
+            start = i + 1;
         }
     }
     return hash;
 }
 
+static inline ssize_t bucket_index(const struct inode_cache* cache, uint64_t hash)
+{
+    return (ssize_t)(hash & (uint64_t)(cache->num_buckets - 1));
+}
+
 struct inode_cache* create_inode_cache(ssize_t capacity) {
     struct inode_cache* cache = (struct inode_cache*) malloc(sizeof(struct inode_cache));
     cache->head = NULL;
     cache->tail = NULL;
     cache->size = 0;
     cache->capacity = capacity;
-    cache->map = (struct cache_entry**) calloc(capacity, sizeof(struct cache_entry**));
+    cache->num_orphans = 0;
+    cache->orphans = NULL;
+    cache->num_buckets = CACHE_MIN_BUCKETS;
+    cache->map = (struct cache_entry**) calloc(cache->num_buckets, sizeof(struct cache_entry*));
     return cache;
 }
 
 void free_cache_entry(struct cache_entry* node) {
     if(node != NULL)
     {
-        if (node->key != NULL)
-            free(node->key);
         free(node);
         node = NULL;
     }
@@ -53,131 +156,325 @@ void free_inode_cache(struct inode_cache* cache) {
         free(cache->map);
         cache->map = NULL;
         cache->tail = NULL;
+        free(cache);
         cache = NULL;
     }
 }
 
-void delete_node(struct inode_cache* cache, struct cache_entry* node) {
-    // if node == tail or head of cache, update tail/head pointers
-    if (node == cache->head) 
+/*
+Double the bucket array once the load factor crosses CACHE_MAX_LOAD_NUM / CACHE_MAX_LOAD_DEN.
+Entries keep their stored hash, so rehashing only relinks chains.
+*/
+static void grow_buckets(struct inode_cache* cache)
+{
+    ssize_t new_num_buckets = cache->num_buckets * 2;
+    struct cache_entry** new_map = (struct cache_entry**) calloc(new_num_buckets, sizeof(struct cache_entry*));
+    if(new_map == NULL)
     {
-        cache->head = node->next;
-    } 
-    else if (node == cache->tail) 
+        return; // keep running with longer chains
+    }
+
+    for(ssize_t i = 0; i < cache->num_buckets; i++)
     {
-        cache->tail = node->prev;
+        struct cache_entry* curr = cache->map[i];
+        while(curr != NULL)
+        {
+            struct cache_entry* next = curr->hash_next;
+            ssize_t idx = (ssize_t)(curr->hash & (uint64_t)(new_num_buckets - 1));
+            curr->hash_next = new_map[idx];
+            new_map[idx] = curr;
+            curr = next;
+        }
     }
-    if (node->prev != NULL) {
-        node->prev->next = node->next;
+    free(cache->map);
+    cache->map = new_map;
+    cache->num_buckets = new_num_buckets;
+}
+
+static void unlink_from_bucket(struct inode_cache* cache, struct cache_entry* node)
+{
+    struct cache_entry** link = &cache->map[bucket_index(cache, node->hash)];
+    while(*link != NULL)
+    {
+        if(*link == node)
+        {
+            *link = node->hash_next;
+            return;
+        }
+        link = &(*link)->hash_next;
     }
+}
 
-    if (node->next != NULL) {
+static void unlink_from_lru(struct inode_cache* cache, struct cache_entry* node)
+{
+    if(node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        cache->head = node->next;
+
+    if(node->next != NULL)
         node->next->prev = node->prev;
+    else
+        cache->tail = node->prev;
+
+    node->prev = NULL;
+    node->next = NULL;
+}
+
+static void push_lru_front(struct inode_cache* cache, struct cache_entry* node)
+{
+    node->prev = NULL;
+    node->next = cache->head;
+    if(cache->head != NULL)
+        cache->head->prev = node;
+    cache->head = node;
+    if(cache->tail == NULL)
+        cache->tail = node;
+}
+
+static void link_child(struct cache_entry* parent, struct cache_entry* node)
+{
+    node->parent = parent;
+    node->prev_sibling = NULL;
+    node->next_sibling = parent->first_child;
+    if(parent->first_child != NULL)
+        parent->first_child->prev_sibling = node;
+    parent->first_child = node;
+}
+
+static void push_orphan(struct inode_cache* cache, struct cache_entry* node)
+{
+    node->parent = NULL;
+    node->orphan = true;
+    node->prev_sibling = NULL;
+    node->next_sibling = cache->orphans;
+    if(cache->orphans != NULL)
+        cache->orphans->prev_sibling = node;
+    cache->orphans = node;
+    cache->num_orphans++;
+}
+
+/*
+Detach an entry from its parent's child list, or from the orphan list.
+*/
+static void unlink_child(struct inode_cache* cache, struct cache_entry* node)
+{
+    if(node->prev_sibling != NULL)
+        node->prev_sibling->next_sibling = node->next_sibling;
+    else if(node->parent != NULL)
+        node->parent->first_child = node->next_sibling;
+    else if(node->orphan)
+        cache->orphans = node->next_sibling;
+    if(node->next_sibling != NULL)
+        node->next_sibling->prev_sibling = node->prev_sibling;
+    if(node->orphan)
+        cache->num_orphans--;
+    node->parent = NULL;
+    node->orphan = false;
+    node->prev_sibling = NULL;
+    node->next_sibling = NULL;
+}
+
+/*
+Move an entry and then each of its ancestors to the front of the LRU list,
+so that the ancestors end up ahead of the entry.
+*/
+static void touch_entry(struct inode_cache* cache, struct cache_entry* node)
+{
+    while(node != NULL)
+    {
+        if(node != cache->head)
+        {
+            unlink_from_lru(cache, node);
+            push_lru_front(cache, node);
+        }
+        node = node->parent;
+    }
+}
+
+/*
+Free a single entry. Its children (if any) lose their parent and become orphans.
+*/
+void delete_node(struct inode_cache* cache, struct cache_entry* node) {
+    struct cache_entry* child = node->first_child;
+    while(child != NULL)
+    {
+        struct cache_entry* next = child->next_sibling;
+        push_orphan(cache, child);
+        child = next;
     }
+    node->first_child = NULL;
+
+    unlink_child(cache, node);
+    unlink_from_bucket(cache, node);
+    unlink_from_lru(cache, node);
+    cache->size--;
     free_cache_entry(node);
 }
 
+static ssize_t delete_subtree(struct inode_cache* cache, struct cache_entry* node)
+{
+    ssize_t removed = 0;
+    while(node->first_child != NULL)
+    {
+        removed += delete_subtree(cache, node->first_child);
+    }
+    delete_node(cache, node);
+    return removed + 1;
+}
+
+static struct cache_entry* find_entry(const struct inode_cache* cache, const char* key, size_t key_len, uint64_t hash)
+{
+    struct cache_entry* curr = cache->map[bucket_index(cache, hash)];
+    while(curr != NULL)
+    {
+        if(curr->hash == hash && curr->key_len == key_len && memcmp(curr->key, key, key_len) == 0)
+            return curr;
+        curr = curr->hash_next;
+    }
+    return NULL;
+}
+
+/*
+Length of the parent path of key, or 0 if the parent is the root (or there is none).
+*/
+static size_t parent_key_len(const char* key, size_t key_len)
+{
+    for(size_t i = key_len; i > 1; i--)
+    {
+        if(key[i - 1] == '/' && i != key_len)
+            return i - 1;
+    }
+    return 0;
+}
+
+static bool is_under_prefix(const struct cache_entry* node, const char* prefix, size_t prefix_len)
+{
+    if(node->key_len < prefix_len || memcmp(node->key, prefix, prefix_len) != 0)
+        return false;
+    return node->key_len == prefix_len || node->key[prefix_len] == '/' || prefix[prefix_len - 1] == '/';
+}
+
 bool remove_cache_entry(struct inode_cache* cache, const char* key)
 {
-    if (cache == NULL || key == NULL) {
-        return -1;
+    if (cache == NULL || key == NULL || key[0] == '\0') {
+        return false;
     }
-    // Find the node with the given key
-    unsigned long int hash = hash_func(key);
-    ssize_t hash_index = hash % cache->capacity;
-    struct cache_entry* curr = cache->map[hash_index];
-    while (curr != NULL) {
-        if (strcmp(curr->key, key) == 0) {
-            delete_node(cache, curr);
-            cache->map[hash_index] = NULL;
-            return true;
+    size_t key_len = strlen(key);
+    ssize_t removed = 0;
+    struct cache_entry* node = find_entry(cache, key, key_len, path_hash(key, key_len));
+    if(node != NULL)
+    {
+        removed += delete_subtree(cache, node);
+    }
+
+    // Orphans are not reachable through the parent links, look for them by prefix.
+    // Deleting an orphan's subtree never touches another orphan, so next stays valid.
+    struct cache_entry* curr = cache->orphans;
+    while(curr != NULL)
+    {
+        struct cache_entry* next = curr->next_sibling;
+        if(is_under_prefix(curr, key, key_len))
+        {
+            removed += delete_subtree(cache, curr);
         }
-        curr = curr->next;
+        curr = next;
     }
-    // If key is not present in cache, return false
-    return false; 
+    return removed > 0;
 }
 
-void set_cache_entry(struct inode_cache* cache, const char* key, ssize_t value) 
+void set_cache_entry(struct inode_cache* cache, const char* key, ssize_t value)
 {
-    if (cache == NULL || key == NULL || strlen(key) == 0) {
+    if (cache == NULL || key == NULL || key[0] == '\0') {
         return;
     }
-   
-    unsigned long int hash = hash_func(key);
-    ssize_t hash_index = hash % cache->capacity;
-    struct cache_entry* curr = cache->map[hash_index];
-
-    while (curr != NULL) {
-        if (strcmp(curr->key, key) == 0) {
-            curr->value = value;
-            // Move the new node to front of the cache
-            if (curr != cache->head) {
-                curr->prev->next = curr->next;
-                if (curr == cache->tail) {
-                    cache->tail = curr->prev;
-                } else {
-                    curr->next->prev = curr->prev;
-                }
-                curr->prev = NULL;
-                curr->next = cache->head;
-                cache->head->prev = curr;
-                cache->head = curr;
-            }
-            return;
-        }
-        curr = curr->next;
+    size_t key_len = strlen(key);
+    set_cache_entry_hashed(cache, key, key_len, path_hash(key, key_len), value);
+}
+
+void set_cache_entry_hashed(struct inode_cache* cache, const char* key, size_t key_len, uint64_t hash, ssize_t value)
+{
+    if (cache == NULL || key == NULL || key_len == 0) {
+        return;
     }
 
-    struct cache_entry* node = (struct cache_entry*) malloc(sizeof(struct cache_entry));
-    node->key = (char*) malloc(strlen(key) + 1);
-    strcpy(node->key, key);
-    node->value = value;
-    node->prev = NULL;
-    node->next = cache->head;
+    struct cache_entry* node = find_entry(cache, key, key_len, hash);
+    if(node != NULL)
+    {
+        node->value = value;
+        // Move the node to front of the cache
+        touch_entry(cache, node);
+        return;
+    }
 
-    if (cache->head != NULL) {
-        cache->head->prev = node;
+    node = (struct cache_entry*) malloc(sizeof(struct cache_entry) + key_len + 1);
+    if(node == NULL)
+    {
+        return;
     }
-    cache->head = node;
-    if (cache->tail == NULL) {
-        cache->tail = node;
+    memcpy(node->key, key, key_len);
+    node->key[key_len] = '\0';
+    node->key_len = key_len;
+    node->hash = hash;
+    node->value = value;
+    node->parent = NULL;
+    node->first_child = NULL;
+    node->prev_sibling = NULL;
+    node->next_sibling = NULL;
+    node->orphan = false;
+
+    size_t p_len = parent_key_len(key, key_len);
+    if(p_len > 0)
+    {
+        struct cache_entry* parent = find_entry(cache, key, p_len, path_hash(key, p_len));
+        if(parent != NULL)
+        {
+            link_child(parent, node);
+        } else
+        {
+            push_orphan(cache, node);
+        }
     }
+
+    ssize_t idx = bucket_index(cache, hash);
+    node->hash_next = cache->map[idx];
+    cache->map[idx] = node;
+    node->prev = NULL;
+    node->next = NULL;
+    push_lru_front(cache, node);
+    touch_entry(cache, node->parent);
     cache->size++;
-    // If cache is full, remove the LRU cache entry
+
+    // If cache is full, remove the LRU cache entry (always a leaf, see touch_entry)
     if (cache->size > cache->capacity) {
         delete_node(cache, cache->tail);
-        cache->size--;
     }
-    cache->map[hash_index] = node;
+
+    if(cache->size * CACHE_MAX_LOAD_DEN > cache->num_buckets * CACHE_MAX_LOAD_NUM)
+    {
+        grow_buckets(cache);
+    }
 }
 
 ssize_t get_cache_entry(struct inode_cache* cache, const char* key){
-    if (cache == NULL || key == NULL || strlen(key) == 0) {
+    if (cache == NULL || key == NULL || key[0] == '\0') {
         return -1;
     }
+    size_t key_len = strlen(key);
+    return get_cache_entry_hashed(cache, key, key_len, path_hash(key, key_len));
+}
 
-    unsigned long int hash = hash_func(key);
-    ssize_t hash_index = hash % cache->capacity;
-    struct cache_entry* curr = cache->map[hash_index];
-
-    while (curr != NULL) {
-        if (strcmp(curr->key, key) == 0) {
-            if (curr != cache->head) {
-                curr->prev->next = curr->next;
-                if (curr == cache->tail) {
-                    cache->tail = curr->prev;
-                } else {
-                    curr->next->prev = curr->prev;
-                }
-                curr->prev = NULL;
-                curr->next = cache->head;
-                cache->head->prev = curr;
-                cache->head = curr;
-            }
-            return curr->value;
-        }
-        curr = curr->next;
+ssize_t get_cache_entry_hashed(struct inode_cache* cache, const char* key, size_t key_len, uint64_t hash)
+{
+    if (cache == NULL || key == NULL || key_len == 0) {
+        return -1;
+    }
+
+    struct cache_entry* node = find_entry(cache, key, key_len, hash);
+    if(node == NULL)
+    {
+        return -1;
     }
-    return -1;
+    touch_entry(cache, node);
+    return node->value;
 }
@@ -24,7 +24,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         // If data block == 12 => new single indirect block needs to be added
         if(logical_block_num == 0)
         {
-            ssize_t single_indirect_block_num = allocate_data_block();
+            ssize_t single_indirect_block_num = allocate_data_block_near(data_block_num + 1, 0);
             if(single_indirect_block_num == -1)
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate new data block for single indirect data block. Exiting\n", ADD_DATABLOCK_TO_INODE);
@@ -37,7 +37,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(inodeObj->i_single_indirect);
         single_indirect_block_arr[logical_block_num] = data_block_num;
         
-        if(!write_data_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
+        if(!write_metadata_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Failed to write data to single indirect block\n", ADD_DATABLOCK_TO_INODE);
             return false;
@@ -57,7 +57,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         // if file block num == 12 + 512 => need a new double indirect block
         if(logical_block_num == 0)
         {
-            ssize_t double_indirect_data_block_num = allocate_data_block();
+            ssize_t double_indirect_data_block_num = allocate_data_block_near(data_block_num + 1, 0);
             if(double_indirect_data_block_num == -1)
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate new data block for double indirect data block with file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
@@ -75,7 +75,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         // This is to create the first indirect block in the single indirect block
         if(inner_idx == 0)
         { 
-            ssize_t single_indirect_block_num = allocate_data_block();
+            ssize_t single_indirect_block_num = allocate_data_block_near(data_block_num + 1, 0);
             if(single_indirect_block_num == -1)
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate new data block for single indirect data block with file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
@@ -85,7 +85,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
             double_indirect_block_arr[double_i_idx] = single_indirect_block_num;
             fuse_log(FUSE_LOG_DEBUG, "%s : Added data block in single indirect block with file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
             
-            if(!write_data_block(inodeObj->i_double_indirect, (char*)double_indirect_block_arr))
+            if(!write_metadata_block(inodeObj->i_double_indirect, (char*)double_indirect_block_arr))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to write data to double indirect block for file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
                 return false;
@@ -104,7 +104,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(single_indirect_block_num);
         single_indirect_block_arr[inner_idx] = data_block_num;
         
-        if(!write_data_block(single_indirect_block_num, (char*)single_indirect_block_arr))
+        if(!write_metadata_block(single_indirect_block_num, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Failed to write data to single indirect block for file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
             return false;
@@ -122,7 +122,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
     if (logical_block_num < NUM_OF_TRIPLE_INDIRECT_BLOCK_ADDR)
     {
         if(logical_block_num == 0){
-            ssize_t triple_data_block_num = allocate_data_block();
+            ssize_t triple_data_block_num = allocate_data_block_near(data_block_num + 1, 0);
             if(triple_data_block_num == -1)
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate new data block for triple indirect data block with file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
@@ -139,7 +139,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         ssize_t inner_idx = logical_block_num % NUM_OF_ADDRESSES_PER_BLOCK;
         
         if(logical_block_num % NUM_OF_DOUBLE_INDIRECT_BLOCK_ADDR == 0){
-            ssize_t double_indirect_data_block_num = allocate_data_block();
+            ssize_t double_indirect_data_block_num = allocate_data_block_near(data_block_num + 1, 0);
             
             if(double_indirect_data_block_num == -1)
             {
@@ -149,7 +149,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
             
             triple_indirect_block_arr[triple_i_idx] = double_indirect_data_block_num;
             
-            if(!write_data_block(inodeObj->i_triple_indirect, (char *)triple_indirect_block_arr))
+            if(!write_metadata_block(inodeObj->i_triple_indirect, (char *)triple_indirect_block_arr))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to write data to triple indirect block for file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
                 return false;
@@ -159,7 +159,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         ssize_t* double_indirect_block_arr = (ssize_t*) read_data_block(triple_indirect_block_arr[triple_i_idx]);
         
         if(inner_idx == 0){
-            ssize_t single_indirect_block_num = allocate_data_block();
+            ssize_t single_indirect_block_num = allocate_data_block_near(data_block_num + 1, 0);
             if(single_indirect_block_num == -1)
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate block for single indirect block for file block number %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
@@ -168,7 +168,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
             
             double_indirect_block_arr[double_i_idx] = single_indirect_block_num;
             
-            if(!write_data_block(triple_indirect_block_arr[triple_i_idx], (char*)double_indirect_block_arr))
+            if(!write_metadata_block(triple_indirect_block_arr[triple_i_idx], (char*)double_indirect_block_arr))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to write data to double indirect block for file block num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
                 return false;
@@ -188,7 +188,7 @@ bool add_datablock_to_inode(struct inode *inodeObj, const ssize_t data_block_num
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(single_indirect_block_num);
         single_indirect_block_arr[inner_idx] = data_block_num;
 
-        if(!write_data_block(single_indirect_block_num, (char*)single_indirect_block_arr))
+        if(!write_metadata_block(single_indirect_block_num, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Failed to write to single indirect block for file bloxk num %zd\n", ADD_DATABLOCK_TO_INODE, logical_block_num);
             return false;
@@ -233,7 +233,7 @@ bool overwrite_datablock_to_inode(struct inode *inodeObj, ssize_t logical_block_
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(inodeObj->i_single_indirect);
         single_indirect_block_arr[logical_block_num] = data_block_num;
 
-        if (!write_data_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
+        if (!write_metadata_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Writing to single indirect block failed for logical block %zd\n", OVERWRITE_DATABLOCK_TO_INODE, logical_block_num);
             return false;
@@ -263,7 +263,7 @@ bool overwrite_datablock_to_inode(struct inode *inodeObj, ssize_t logical_block_
             ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(*prev_indirect_block);
             single_indirect_block_arr[inner_idx] = data_block_num;
 
-            if (!write_data_block(data_block_num, (char*)single_indirect_block_arr))
+            if (!write_metadata_block(data_block_num, (char*)single_indirect_block_arr))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Writing to single double block failed for file block %zd\n", OVERWRITE_DATABLOCK_TO_INODE, logical_block_num);
                 return false;
@@ -287,7 +287,7 @@ bool overwrite_datablock_to_inode(struct inode *inodeObj, ssize_t logical_block_
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(single_data_block_num);
         single_indirect_block_arr[inner_idx] = data_block_num;
 
-        if (!write_data_block(single_data_block_num, (char*)single_indirect_block_arr))
+        if (!write_metadata_block(single_data_block_num, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Writing to single indirect block failed for file block %zd\n", OVERWRITE_DATABLOCK_TO_INODE, logical_block_num);
             return false;
@@ -316,7 +316,7 @@ bool overwrite_datablock_to_inode(struct inode *inodeObj, ssize_t logical_block_
         ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(*prev_indirect_block);
         single_indirect_block_arr[inner_idx] = data_block_num;
         
-        if (!write_data_block(data_block_num, (char*)single_indirect_block_arr))
+        if (!write_metadata_block(data_block_num, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Writing to triple indirect block failed for file block %zd\n", OVERWRITE_DATABLOCK_TO_INODE, logical_block_num);
             return false;
@@ -349,7 +349,7 @@ bool overwrite_datablock_to_inode(struct inode *inodeObj, ssize_t logical_block_
     ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(single_data_block_num);
     single_indirect_block_arr[inner_idx] = data_block_num;
     
-    if (!write_data_block(single_data_block_num, (char*)single_indirect_block_arr))
+    if (!write_metadata_block(single_data_block_num, (char*)single_indirect_block_arr))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Writing to triple indirect block failed for file block %zd\n", OVERWRITE_DATABLOCK_TO_INODE, logical_block_num);
         return false;
@@ -369,20 +369,26 @@ bool remove_datablocks_utility(struct inode* inodeObj, ssize_t p_block_num, ssiz
     }
 
     ssize_t *buffer = (ssize_t*) read_data_block(p_block_num);
-    for(ssize_t i = 0; i < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR; i++)
+    // we stop at the end of the data in the block
+    ssize_t count = 0;
+    while (count < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR && buffer[count] != 0)
+        count++;
+    if (indirectionlevel == 1)
     {
-        // we have reached the end of the data in the block 
-        if (buffer[i] == 0)
-            break;
-        switch (indirectionlevel)
+        // The data blocks are freed together, with this block when it fits.
+        if (count < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR)
         {
-            case 1:
-                free_data_block(buffer[i]);
-                break;
-            default: 
-                remove_datablocks_utility(inodeObj, buffer[i], indirectionlevel-1);
-                break;
+            buffer[count] = p_block_num;
+            free_data_blocks(buffer, count + 1);
+            altfs_free_memory(buffer);
+            return true;
         }
+        free_data_blocks(buffer, count);
+    }
+    else
+    {
+        for (ssize_t i = 0; i < count; i++)
+            remove_datablocks_utility(inodeObj, buffer[i], indirectionlevel-1);
     }
     free_data_block(p_block_num);
     altfs_free_memory(buffer);
@@ -408,14 +414,15 @@ bool remove_datablocks_from_inode(struct inode* inodeObj, ssize_t logical_block_
     // The same applies <= operator used for single, double and triple indirect conditions as well
     if (logical_block_num <= NUM_OF_DIRECT_BLOCKS)
     {
-        for (ssize_t i = logical_block_num; i < NUM_OF_DIRECT_BLOCKS && i < ending_block_num; i++)
+        ssize_t direct_end = ending_block_num < NUM_OF_DIRECT_BLOCKS ? ending_block_num : NUM_OF_DIRECT_BLOCKS;
+        if (logical_block_num < direct_end)
         {
-            if (!free_data_block(inodeObj->i_direct_blocks[i]))
+            if (!free_data_blocks((const ssize_t*)&inodeObj->i_direct_blocks[logical_block_num], direct_end - logical_block_num))
             {
-                fuse_log(FUSE_LOG_ERR, "%s : Failed to free direct block %zd starting deletion from logical block %zd\n", REMOVE_DATABLOCKS_FROM_INODE, i, logical_block_num);
+                fuse_log(FUSE_LOG_ERR, "%s : Failed to free direct blocks starting deletion from logical block %zd\n", REMOVE_DATABLOCKS_FROM_INODE, logical_block_num);
                 return false;
             }
-            inodeObj->i_direct_blocks[i] = 0;
+            memset(&inodeObj->i_direct_blocks[logical_block_num], 0, (direct_end - logical_block_num) * ADDRESS_SIZE);
         }
 
         // <= is used here since ending_block_num is initialized to number of blocks allocated for the inode
@@ -485,17 +492,19 @@ bool remove_datablocks_from_inode(struct inode* inodeObj, ssize_t logical_block_
         // Adjusting for single indirect block
         ending_block_num -= NUM_OF_DIRECT_BLOCKS;
 
-        for(ssize_t i = logical_block_num; i < ending_block_num && i < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR; i++)
+        ssize_t single_end = ending_block_num < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR ? ending_block_num : NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR;
+        if (logical_block_num < single_end)
         {
-            if (!free_data_block(single_indirect_block_arr[i]))
+            if (!free_data_blocks(&single_indirect_block_arr[logical_block_num], single_end - logical_block_num))
             {
-                fuse_log(FUSE_LOG_ERR, "%s : Failed to free single indirect block %zd starting deletion from logical block %zd\n", REMOVE_DATABLOCKS_FROM_INODE, i, logical_block_num);
+                fuse_log(FUSE_LOG_ERR, "%s : Failed to free single indirect blocks starting deletion from logical block %zd\n", REMOVE_DATABLOCKS_FROM_INODE, logical_block_num);
                 return false;
             }
-            single_indirect_block_arr[i] = 0; // To ensure the i_single_indirect is updated based on free nodes
+            // To ensure the i_single_indirect is updated based on free nodes
+            memset(&single_indirect_block_arr[logical_block_num], 0, (single_end - logical_block_num) * ADDRESS_SIZE);
         }
 
-        if(!write_data_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
+        if(!write_metadata_block(inodeObj->i_single_indirect, (char*)single_indirect_block_arr))
         {
             fuse_log(FUSE_LOG_ERR, "%s : Failed to write modified single indirect block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, inodeObj->i_single_indirect);
             return false;
@@ -574,43 +583,53 @@ bool remove_datablocks_from_inode(struct inode* inodeObj, ssize_t logical_block_
 
             ssize_t* single_indirect_block_arr = (ssize_t*) read_data_block(data_block_num);
 
-            for(;j < ending_block_num && j < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR; j++) 
+            ssize_t j_end = ending_block_num < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR ? ending_block_num : NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR;
+            if (j < j_end)
             {
-                if (!free_data_block(single_indirect_block_arr[j]))
+                if (!free_data_blocks(&single_indirect_block_arr[j], j_end - j))
                 {
-                    fuse_log(FUSE_LOG_ERR, "%s : Failed to free block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, single_indirect_block_arr[j]);
+                    fuse_log(FUSE_LOG_ERR, "%s : Failed to free blocks listed in block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, data_block_num);
                     return false;
                 }
-                single_indirect_block_arr[j] = 0; // To ensure the i_double_indirect's indirect block is updated based on free nodes
+                // To ensure the i_double_indirect's indirect block is updated based on free nodes
+                memset(&single_indirect_block_arr[j], 0, (j_end - j) * ADDRESS_SIZE);
+                j = j_end;
             }
 
-            if(!write_data_block(data_block_num, (char*)single_indirect_block_arr))
+            if(!write_metadata_block(data_block_num, (char*)single_indirect_block_arr))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Failed to write modified double indirect block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, inodeObj->i_single_indirect);
                 return false;
             }
 
             altfs_free_memory(single_indirect_block_arr);
-            
-            // if ending_block_num is reached, break out of loop
-            if (j == ending_block_num)
-                break;
-
-            // Suppose ending_block_num was 520, after first iteration, 512 blocks are removed
-            ending_block_num -= NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR;
 
             // We should not free the data block if there are elements in it
             // This can happen in the first block we are starting the deletion from
             // For example - Delete from block 526 => delete from logical number 2 onwards
             // The single indirect corresponding to this should not be freed
-            if (!(i == double_i_idx && j > 0))
+            if (!(i == double_i_idx && inner_idx > 0))
             {
                 if (!free_data_block(data_block_num))
                 {
                     fuse_log(FUSE_LOG_ERR, "%s : Failed to free block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, data_block_num);
                     return false;
                 }
+                // So that a later removal does not free it again
+                double_indirect_block_arr[i] = 0;
             }
+
+            // if ending_block_num is reached, break out of loop
+            if (j == ending_block_num)
+                break;
+
+            // Suppose ending_block_num was 520, after first iteration, 512 blocks are removed
+            ending_block_num -= NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR;
+        }
+        if(!write_metadata_block(inodeObj->i_double_indirect, (char*)double_indirect_block_arr))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to write modified double indirect block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, inodeObj->i_double_indirect);
+            return false;
         }
         altfs_free_memory(double_indirect_block_arr);
 
@@ -687,17 +706,21 @@ bool remove_datablocks_from_inode(struct inode* inodeObj, ssize_t logical_block_
                 // free single level indirect block only if all blocks from 0 have been removed i.e k != inner_idx
                 should_free_single_indirect = (k == inner_idx) ? false : true;
 
-                for(; k < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR && k < ending_block_num; k++) // TODO: Check if the bounds checking for i,j,k, are right
+                // TODO: Check if the bounds checking for i,j,k, are right
+                ssize_t k_end = ending_block_num < NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR ? ending_block_num : NUM_OF_SINGLE_INDIRECT_BLOCK_ADDR;
+                if (k < k_end)
                 {
-                    if (!free_data_block(single_indirect_block_arr[k]))
+                    if (!free_data_blocks(&single_indirect_block_arr[k], k_end - k))
                     {
-                        fuse_log(FUSE_LOG_ERR, "%s : Failed to free block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, single_indirect_block_arr[k]);
+                        fuse_log(FUSE_LOG_ERR, "%s : Failed to free blocks listed in block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, single_indirect_data_block_num);
                         return false;
                     }
-                    single_indirect_block_arr[k] = 0; // To ensure the i_triple_indirect's indirect block is updated based on free nodes
+                    // To ensure the i_triple_indirect's indirect block is updated based on free nodes
+                    memset(&single_indirect_block_arr[k], 0, (k_end - k) * ADDRESS_SIZE);
+                    k = k_end;
                 }
 
-                if(!write_data_block(single_indirect_data_block_num, (char*)single_indirect_block_arr))
+                if(!write_metadata_block(single_indirect_data_block_num, (char*)single_indirect_block_arr))
                 {
                     fuse_log(FUSE_LOG_ERR, "%s : Failed to write modified triple indirect block %zd \n", REMOVE_DATABLOCKS_FROM_INODE, inodeObj->i_single_indirect);
                     return false;
@@ -747,3 +770,79 @@ bool remove_datablocks_from_inode(struct inode* inodeObj, ssize_t logical_block_
     }
     return false;
 }
+
+ssize_t get_allocation_goal(const struct inode* const inodeObj, ssize_t inum)
+{
+    if(inodeObj->i_blocks_num > 0 && !(inodeObj->i_flags & INODE_FLAG_INLINE_DATA))
+    {
+        ssize_t prev_block = 0;
+        ssize_t last_block = get_disk_block_from_inode_block(inodeObj, inodeObj->i_blocks_num - 1, &prev_block);
+        if(last_block > 0)
+            return last_block + 1;
+    }
+    // Keep a file's blocks in its inode's allocation group, and spread the files of a group over it.
+    ssize_t group = INODE_TO_GROUP(inum);
+    ssize_t goal = GROUP_FIRST_BLOCK(group) + ((inum % INODES_PER_GROUP) * ALLOCATION_GROUP_BLOCKS) / INODES_PER_GROUP;
+    return goal < GROUP_END_BLOCK(group) ? goal : GROUP_FIRST_BLOCK(group);
+}
+
+bool move_inline_data_to_block(struct inode* inodeObj, ssize_t inum)
+{
+    char data_block[BLOCK_SIZE];
+    memset(data_block, 0, BLOCK_SIZE);
+    memcpy(data_block, inodeObj->i_inline_data, INODE_INLINE_DATA_SIZE);
+    memset(inodeObj->i_inline_data, 0, INODE_INLINE_DATA_SIZE);
+    inodeObj->i_flags &= ~INODE_FLAG_INLINE_DATA;
+    inodeObj->i_blocks_num = 0;
+
+    // An empty file needs no block yet.
+    if(inodeObj->i_file_size == 0)
+    {
+        return true;
+    }
+
+    ssize_t data_block_num = allocate_data_block_near(get_allocation_goal(inodeObj, inum), inum);
+    if(data_block_num <= 0)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to allocate data block for inline data.\n", MOVE_INLINE_DATA_TO_BLOCK);
+        memcpy(inodeObj->i_inline_data, data_block, INODE_INLINE_DATA_SIZE);
+        inodeObj->i_flags |= INODE_FLAG_INLINE_DATA;
+        return false;
+    }
+    if(!write_data_block(data_block_num, data_block) || !add_datablock_to_inode(inodeObj, data_block_num))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to move inline data to data block %ld.\n", MOVE_INLINE_DATA_TO_BLOCK, data_block_num);
+        free_data_block(data_block_num);
+        memcpy(inodeObj->i_inline_data, data_block, INODE_INLINE_DATA_SIZE);
+        inodeObj->i_blocks_num = 0;
+        inodeObj->i_flags |= INODE_FLAG_INLINE_DATA;
+        return false;
+    }
+    return true;
+}
+
+bool move_data_inline(struct inode* inodeObj, ssize_t length)
+{
+    char inline_data[INODE_INLINE_DATA_SIZE];
+    memset(inline_data, 0, INODE_INLINE_DATA_SIZE);
+    if(length > 0)
+    {
+        char* data_block = read_data_block(inodeObj->i_direct_blocks[0]);
+        if(data_block == NULL)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to read data block %ld.\n", MOVE_DATA_INLINE, inodeObj->i_direct_blocks[0]);
+            return false;
+        }
+        memcpy(inline_data, data_block, length);
+        altfs_free_memory(data_block);
+    }
+
+    if(inodeObj->i_blocks_num > 0 && !remove_datablocks_from_inode(inodeObj, 0))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to free data blocks of the file.\n", MOVE_DATA_INLINE);
+        return false;
+    }
+    memcpy(inodeObj->i_inline_data, inline_data, INODE_INLINE_DATA_SIZE);
+    inodeObj->i_flags |= INODE_FLAG_INLINE_DATA;
+    return true;
+}
@@ -21,96 +21,280 @@ void inum_to_block_pos(ssize_t inum, ssize_t* block, ssize_t* offset)
     *offset = inum % tmp;
 }
 
-ssize_t allocate_inode()
+// Bit i of word i/64 is set if inode i is allocated (or reserved, or past the last inode).
+// Each allocation group's part of the bitmap and its counts are guarded by the group's lock.
+static uint64_t* inodeBitmap = NULL;
+static ssize_t* inodeGroupFree = NULL;   // number of free inodes in each allocation group
+static ssize_t* inodeGroupDirs = NULL;   // number of directories in each allocation group
+static ssize_t inodeGroupCount = 0;
+static pthread_mutex_t firstInodeLock = PTHREAD_MUTEX_INITIALIZER;   // guards s_first_ino
+// Held from reading an inode block to writing it back, so that updates of inodes that share a block
+// (from the orphan thread and the file system calls) do not undo each other. Taken after a group lock.
+static pthread_mutex_t inodeTableLock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void set_inode_bit(ssize_t inum)
 {
-    // fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to allocate a new inode.\n", ALLOCATE_INODE);
-    // Get the next free inode number
-    ssize_t inum_to_allocate = altfs_superblock->s_first_ino;
-    if(inum_to_allocate == altfs_superblock->s_inodes_count)
-    {
-        fuse_log(FUSE_LOG_ERR, "%s : All inodes are allocated.", ALLOCATE_INODE);
+    inodeBitmap[inum / 64] |= (uint64_t) 1 << (inum % 64);
+    inodeGroupFree[INODE_TO_GROUP(inum)]--;
+}
+
+static inline void clear_inode_bit(ssize_t inum)
+{
+    inodeBitmap[inum / 64] &= ~((uint64_t) 1 << (inum % 64));
+    inodeGroupFree[INODE_TO_GROUP(inum)]++;
+}
+
+void free_inode_bitmap()
+{
+    altfs_free_memory(inodeBitmap);
+    inodeBitmap = NULL;
+    altfs_free_memory(inodeGroupFree);
+    inodeGroupFree = NULL;
+    altfs_free_memory(inodeGroupDirs);
+    inodeGroupDirs = NULL;
+    inodeGroupCount = 0;
+}
+
+/*
+Lowest free inode number of a group that is at least start, or -1 if there is none.
+Call with the group's lock held.
+*/
+static ssize_t find_free_inode_in_group(ssize_t group, ssize_t start)
+{
+    if(inodeGroupFree[group] == 0)
         return -1;
+    ssize_t first = group * INODES_PER_GROUP;
+    for(ssize_t word = (first > start ? first : start) / 64; word < (first + INODES_PER_GROUP) / 64; word++)
+    {
+        uint64_t bits = inodeBitmap[word];
+        if(word == start / 64)
+            bits |= ((uint64_t) 1 << (start % 64)) - 1;  // bits below start count as taken
+        if(bits != ~(uint64_t) 0)
+            return word * 64 + __builtin_ctzll(~bits);
     }
+    return -1;
+}
+
+/*
+Move s_first_ino up after an allocation, unless an inode was freed below it in the meantime.
+*/
+static void advance_first_inode(ssize_t from, ssize_t to)
+{
+    pthread_mutex_lock(&firstInodeLock);
+    bool changed = altfs_superblock->s_first_ino == from;
+    if(changed)
+        altfs_superblock->s_first_ino = to;
+    pthread_mutex_unlock(&firstInodeLock);
+    if(changed)
+        mark_superblock_dirty();
+}
 
-    if(!is_valid_inode_number(inum_to_allocate))
+bool load_inode_bitmap()
+{
+    free_inode_bitmap();
+    inodeGroupCount = NUM_OF_ALLOCATION_GROUPS;
+    inodeBitmap = (uint64_t*) calloc(inodeGroupCount * (INODES_PER_GROUP / 64), sizeof(uint64_t));
+    inodeGroupFree = (ssize_t*) calloc(inodeGroupCount, sizeof(ssize_t));
+    inodeGroupDirs = (ssize_t*) calloc(inodeGroupCount, sizeof(ssize_t));
+    if(inodeBitmap == NULL || inodeGroupFree == NULL || inodeGroupDirs == NULL)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Invalid inode number provided for allocation:%ld\n", ALLOCATE_INODE, altfs_superblock->s_first_ino);
-        return -1;
+        fuse_log(FUSE_LOG_ERR, "%s : Could not allocate the inode bitmap for %ld inodes.\n", LOAD_INODE_BITMAP, altfs_superblock->s_inodes_count);
+        free_inode_bitmap();
+        return false;
     }
+    for(ssize_t group = 0; group < inodeGroupCount; group++)
+        inodeGroupFree[group] = INODES_PER_GROUP;
+
+    // The reserved inode numbers and the inodes past the last one are never handed out.
+    for(ssize_t inum = 0; inum <= ROOT_INODE_NUM; inum++)
+        set_inode_bit(inum);
+    for(ssize_t inum = altfs_superblock->s_inodes_count; inum < inodeGroupCount * INODES_PER_GROUP; inum++)
+        set_inode_bit(inum);
 
-    // Get block number and offset for the inode number, and read the block.
-    ssize_t block_num, offset;
-    inum_to_block_pos(inum_to_allocate, &block_num, &offset);
     char buffer[BLOCK_SIZE];
-    if(!altfs_read_block(block_num, buffer))
+    ssize_t inum = 0;
+    for(ssize_t block_num = 1; block_num <= INODE_BLOCK_COUNT; block_num++)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", ALLOCATE_INODE, block_num);
-        return -1;
+        if(!altfs_read_block(block_num, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", LOAD_INODE_BITMAP, block_num);
+            free_inode_bitmap();
+            return false;
+        }
+        struct inode* nodes_in_block = (struct inode*)buffer;
+        for(ssize_t offset = 0; offset < altfs_superblock->s_num_of_inodes_per_block; offset++, inum++)
+        {
+            if(!nodes_in_block[offset].i_allocated)
+                continue;
+            if(inum > ROOT_INODE_NUM)
+                set_inode_bit(inum);
+            if(S_ISDIR(nodes_in_block[offset].i_mode))
+                inodeGroupDirs[INODE_TO_GROUP(inum)]++;
+        }
     }
 
-    struct inode* nodes_in_block = NULL;
-    struct inode* node = NULL;
+    ssize_t first_free = -1;
+    for(ssize_t group = 0; group < inodeGroupCount && first_free == -1; group++)
+        first_free = find_free_inode_in_group(group, 0);
+    altfs_superblock->s_first_ino = first_free == -1 ? altfs_superblock->s_inodes_count : first_free;
+    // The bitmap is exact, so it also repairs the free inode count.
+    ssize_t free_inodes = 0;
+    for(ssize_t group = 0; group < inodeGroupCount; group++)
+        free_inodes += inodeGroupFree[group];
+    if(altfs_superblock->s_free_inodes_count != free_inodes)
+        update_superblock_free_counts(0, free_inodes - altfs_superblock->s_free_inodes_count);
+    fuse_log(FUSE_LOG_DEBUG, "%s : Loaded inode bitmap, first free inode: %ld.\n", LOAD_INODE_BITMAP, altfs_superblock->s_first_ino);
+    return true;
+}
+
+/*
+Allocate the lowest free inode of a group that is at least start.
 
-    nodes_in_block = (struct inode*)buffer;
-    node = nodes_in_block + offset;
-    // Some error in updating next free inode previously.
-    if(node->i_allocated)
+@return Inode number, 0 if the group has no free inode from start on, or -1 on failure.
+*/
+static ssize_t allocate_inode_in_group(ssize_t group, ssize_t start, bool is_dir)
+{
+    char buffer[BLOCK_SIZE];
+    pthread_mutex_lock(&groupLocks[group]);
+    ssize_t inum_to_allocate = find_free_inode_in_group(group, start);
+    while(inum_to_allocate != -1)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Inode %ld is already allocated.\n", ALLOCATE_INODE, inum_to_allocate);
-        return -1;
+        // Get block number and offset for the inode number, and read the block.
+        ssize_t block_num, offset;
+        inum_to_block_pos(inum_to_allocate, &block_num, &offset);
+        pthread_mutex_lock(&inodeTableLock);
+        if(!altfs_read_block(block_num, buffer))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", ALLOCATE_INODE, block_num);
+            pthread_mutex_unlock(&inodeTableLock);
+            pthread_mutex_unlock(&groupLocks[group]);
+            return -1;
+        }
+
+        struct inode* node = ((struct inode*)buffer) + offset;
+        // The bitmap is out of date (the disk was changed under it): record it and move on.
+        if(node->i_allocated)
+        {
+            pthread_mutex_unlock(&inodeTableLock);
+            fuse_log(FUSE_LOG_ERR, "%s : Inode %ld is already allocated.\n", ALLOCATE_INODE, inum_to_allocate);
+            set_inode_bit(inum_to_allocate);
+            update_superblock_free_counts(0, -1);
+            inum_to_allocate = find_free_inode_in_group(group, inum_to_allocate + 1);
+            continue;
+        }
+        // Mark the inode as allocated.
+        node->i_allocated = true;
+        node->i_links_count = 0;
+        bool written = altfs_journal_block(block_num, buffer);
+        pthread_mutex_unlock(&inodeTableLock);
+        if(!written)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error writing data block number %ld\n", ALLOCATE_INODE, block_num);
+            pthread_mutex_unlock(&groupLocks[group]);
+            return -1;
+        }
+        set_inode_bit(inum_to_allocate);
+        if(is_dir)
+            inodeGroupDirs[group]++;
+        pthread_mutex_unlock(&groupLocks[group]);
+
+        update_superblock_free_counts(0, -1);
+        fuse_log(FUSE_LOG_DEBUG, "%s : Allocated inode: %ld (block: %ld; offset: %ld, group: %ld)\n",
+            ALLOCATE_INODE, inum_to_allocate, block_num, offset, group);
+        return inum_to_allocate;
     }
-    // Mark the inode as allocated.
-    node->i_allocated = true;
-    node->i_links_count = 0;
-    if(!altfs_write_block(block_num, buffer))
+    pthread_mutex_unlock(&groupLocks[group]);
+    return 0;
+}
+
+ssize_t allocate_inode()
+{
+    // fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to allocate a new inode.\n", ALLOCATE_INODE);
+    if(inodeBitmap == NULL && !load_inode_bitmap())
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error writing data block number %ld\n", ALLOCATE_INODE, block_num);
+        fuse_log(FUSE_LOG_ERR, "%s : No inode bitmap to allocate from.\n", ALLOCATE_INODE);
         return -1;
     }
 
-    fuse_log(FUSE_LOG_DEBUG, "%s : Allocated inode: %ld (block: %ld; offset: %ld)\n",
-        ALLOCATE_INODE, inum_to_allocate, block_num, offset);
-
-    // Search for the next smallest inode number that is unallocated.
-    ssize_t visited = 0;
-    offset++;
-    ssize_t inodes_left = altfs_superblock->s_inodes_count - inum_to_allocate + 1;
-    while(visited != inodes_left)
+    pthread_mutex_lock(&firstInodeLock);
+    ssize_t first_ino = altfs_superblock->s_first_ino;
+    pthread_mutex_unlock(&firstInodeLock);
+    for(ssize_t group = INODE_TO_GROUP(first_ino); group < inodeGroupCount; group++)
     {
-        while(offset < altfs_superblock->s_num_of_inodes_per_block)
+        ssize_t inum = allocate_inode_in_group(group, first_ino, false);
+        if(inum == -1)
+            return -1;
+        if(inum != 0)
         {
-            node = nodes_in_block + offset;
-            visited++;
-            if(!node->i_allocated)
-            {
-                altfs_superblock->s_first_ino = inum_to_allocate + visited;
-                fuse_log(FUSE_LOG_DEBUG, "%s : Marking inode %ld as next free inode.\n",
-                    ALLOCATE_INODE, altfs_superblock->s_first_ino);
-                altfs_write_superblock();
-                return inum_to_allocate;
-            }
-            offset++;
+            // Nothing below the allocated inode is free.
+            advance_first_inode(first_ino, inum + 1);
+            return inum;
         }
+    }
 
-        offset = 0;
-        block_num++;
-        if(block_num > INODE_BLOCK_COUNT)
-        {
-            break;
-        }
+    fuse_log(FUSE_LOG_ERR, "%s : All inodes are allocated.\n", ALLOCATE_INODE);
+    advance_first_inode(first_ino, altfs_superblock->s_inodes_count);
+    return -1;
+}
 
-        if(!altfs_read_block(block_num, buffer))
-        {
-            fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", ALLOCATE_INODE, block_num);
-            break;
-        }
-        nodes_in_block = (struct inode*)buffer;
+/*
+Group for a new directory made in the root directory: among the groups with at least the average
+number of free inodes and free blocks, the one with the fewest directories (Orlov).
+Falls back to the group with the most free inodes.
+*/
+static ssize_t find_group_for_top_directory()
+{
+    ssize_t inode_groups = 0, free_inodes = 0, free_blocks = 0;
+    for(ssize_t group = 0; group < inodeGroupCount; group++)
+    {
+        if(group * INODES_PER_GROUP < altfs_superblock->s_inodes_count)
+            inode_groups++;
+        free_inodes += inodeGroupFree[group];
+        free_blocks += altfs_superblock->s_groups[group].g_free_blocks_count;
     }
+    ssize_t avg_free_inodes = free_inodes / inode_groups;
+    ssize_t avg_free_blocks = free_blocks / inodeGroupCount;
 
-    // fuse_log(FUSE_LOG_DEBUG, "%s : All inodes allocated.\n", ALLOCATE_INODE);
-    altfs_superblock->s_first_ino = altfs_superblock->s_inodes_count;
-    altfs_write_superblock();
-    return inum_to_allocate;
+    // Counts are read without the group locks: they only steer the choice.
+    ssize_t best_group = -1, fallback_group = 0;
+    for(ssize_t group = 0; group < inodeGroupCount; group++)
+    {
+        if(inodeGroupFree[group] > inodeGroupFree[fallback_group])
+            fallback_group = group;
+        if(inodeGroupFree[group] == 0 || inodeGroupFree[group] < avg_free_inodes ||
+            altfs_superblock->s_groups[group].g_free_blocks_count < avg_free_blocks)
+            continue;
+        if(best_group == -1 || inodeGroupDirs[group] < inodeGroupDirs[best_group] ||
+            (inodeGroupDirs[group] == inodeGroupDirs[best_group] &&
+            altfs_superblock->s_groups[group].g_free_blocks_count > altfs_superblock->s_groups[best_group].g_free_blocks_count))
+            best_group = group;
+    }
+    return best_group == -1 ? fallback_group : best_group;
+}
+
+ssize_t allocate_inode_for(ssize_t parent_inum, mode_t mode)
+{
+    if(!is_valid_inode_number(parent_inum))
+        return allocate_inode();
+    if(inodeBitmap == NULL && !load_inode_bitmap())
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : No inode bitmap to allocate from.\n", ALLOCATE_INODE);
+        return -1;
+    }
+
+    // Top level directories are spread over the groups; everything else starts in its parent's group.
+    bool is_dir = S_ISDIR(mode);
+    ssize_t first_group = is_dir && parent_inum == ROOT_INODE_NUM ? find_group_for_top_directory() : INODE_TO_GROUP(parent_inum);
+    for(ssize_t i = 0; i < inodeGroupCount; i++)
+    {
+        ssize_t group = (first_group + i) % inodeGroupCount;
+        ssize_t inum = allocate_inode_in_group(group, group * INODES_PER_GROUP, is_dir);
+        if(inum != 0)
+            return inum;
+    }
+
+    fuse_log(FUSE_LOG_ERR, "%s : All inodes are allocated.\n", ALLOCATE_INODE);
+    return -1;
 }
 
 struct inode* get_inode(ssize_t inum)
@@ -141,6 +325,63 @@ struct inode* get_inode(ssize_t inum)
     return requested_inode;
 }
 
+static int compare_inode_refs(const void* a, const void* b)
+{
+    ssize_t x = ((const ssize_t*)a)[0], y = ((const ssize_t*)b)[0];
+    return (x > y) - (x < y);
+}
+
+bool get_inodes(const ssize_t* const inums, ssize_t count, struct inode* nodes)
+{
+    // Visit the inodes in inode number order so that inodes sharing a block are read together.
+    // Each ref is a pair of (inode number, index into inums).
+    ssize_t (*refs)[2] = malloc(count * sizeof(*refs));
+    if(refs == NULL)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not allocate memory for %ld inodes\n", GET_INODES, count);
+        return false;
+    }
+    for(ssize_t i = 0; i < count; i++)
+    {
+        refs[i][0] = inums[i];
+        refs[i][1] = i;
+    }
+    qsort(refs, count, sizeof(*refs), compare_inode_refs);
+
+    bool res = true;
+    char buffer[BLOCK_SIZE];
+    ssize_t loaded_block = -1;
+    for(ssize_t i = 0; i < count; i++)
+    {
+        struct inode* node = &nodes[refs[i][1]];
+        if(!is_valid_inode_number(refs[i][0]))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Invalid inode number to get: %ld\n", GET_INODES, refs[i][0]);
+            memset(node, 0, sizeof(struct inode));
+            res = false;
+            continue;
+        }
+
+        ssize_t block_num, offset;
+        inum_to_block_pos(refs[i][0], &block_num, &offset);
+        if(block_num != loaded_block)
+        {
+            if(!altfs_read_block(block_num, buffer))
+            {
+                fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", GET_INODES, block_num);
+                memset(node, 0, sizeof(struct inode));
+                loaded_block = -1;
+                res = false;
+                continue;
+            }
+            loaded_block = block_num;
+        }
+        memcpy(node, ((struct inode*)buffer) + offset, sizeof(struct inode));
+    }
+    altfs_free_memory(refs);
+    return res;
+}
+
 bool write_inode(ssize_t inum, struct inode* node)
 {
     // fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to write to inode %ld\n", WRITE_INODE, inum);
@@ -154,7 +395,9 @@ bool write_inode(ssize_t inum, struct inode* node)
     inum_to_block_pos(inum, &block_num, &offset);
 
     char buffer[BLOCK_SIZE];
+    pthread_mutex_lock(&inodeTableLock);
     if(!altfs_read_block(block_num, buffer)){
+        pthread_mutex_unlock(&inodeTableLock);
         fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", WRITE_INODE, block_num);
         return false;
     }
@@ -163,7 +406,9 @@ bool write_inode(ssize_t inum, struct inode* node)
     node_on_disc = node_on_disc + offset;
 
     memcpy(node_on_disc, node, sizeof(struct inode));
-    if(!altfs_write_block(block_num, buffer)){
+    bool written = altfs_journal_block(block_num, buffer);
+    pthread_mutex_unlock(&inodeTableLock);
+    if(!written){
         fuse_log(FUSE_LOG_ERR, "%s : Error writing data to block number %ld\n", WRITE_INODE, block_num);
         return false;
     }
@@ -186,29 +431,30 @@ bool free_indirect_blocks(ssize_t i_block_num, ssize_t indirection)
         return false;
     }
     ssize_t* data_blocks = (ssize_t*)buffer;
+    ssize_t count = 0;
+    while(count < NUM_OF_ADDRESSES_PER_BLOCK && data_blocks[count] != 0)
+        count++;
 
-    // Iterate over every address (number)
-    for(ssize_t i = 0; i < NUM_OF_ADDRESSES_PER_BLOCK; i++)
+    if(indirection == 1)
     {
-        ssize_t block_num = data_blocks[i];
-        if(block_num == 0)
+        // The data blocks are freed together, with the block holding their addresses when it fits.
+        bool with_self = count < NUM_OF_ADDRESSES_PER_BLOCK;
+        if(with_self)
+            data_blocks[count] = i_block_num;
+        if(!free_data_blocks(data_blocks, count + with_self))
         {
-            break;
+            fuse_log(FUSE_LOG_ERR, "%s : Error freeing the data blocks listed in block %ld\n", FREE_INODE, i_block_num);
+            return false;
         }
-        if(indirection == 1)
-        {
-            // fuse_log(FUSE_LOG_DEBUG, "%s Freeing indirect data block: %ld.\n", FREE_INODE, block_num);
-            // Free the data block
-            if(!free_data_block(block_num))
-            {
-                fuse_log(FUSE_LOG_ERR, "%s : Error freeing data block: %ld\n", FREE_INODE, block_num);
-                return false;
-            }
-        } else
+        if(with_self)
+            return true;
+    } else
+    {
+        for(ssize_t i = 0; i < count; i++)
         {
-            // fuse_log(FUSE_LOG_DEBUG, "%s Freeing %ld-1 indirect data blocks starting at: %ld.\n", FREE_INODE, indirection, block_num);
+            // fuse_log(FUSE_LOG_DEBUG, "%s Freeing %ld-1 indirect data blocks starting at: %ld.\n", FREE_INODE, indirection, data_blocks[i]);
             // Recursively call the function with a lower indirection
-            if(!free_indirect_blocks(block_num, indirection-1))
+            if(!free_indirect_blocks(data_blocks[i], indirection-1))
             {
                 fuse_log(FUSE_LOG_ERR, "%s : Error freeing indirect data blocks at indirection %ld.\n", FREE_INODE, indirection);
                 return false;
@@ -232,21 +478,20 @@ Helper function to free all data blocks associated with an inode.
 */
 bool free_data_blocks_in_inode(struct inode* node)
 {
+    // Inline data lives in the inode itself.
+    if(node->i_flags & INODE_FLAG_INLINE_DATA)
+    {
+        return true;
+    }
+
     // Free the direct blocks.
-    for(ssize_t i = 0; i < NUM_OF_DIRECT_BLOCKS; i++)
+    ssize_t direct_count = 0;
+    while(direct_count < NUM_OF_DIRECT_BLOCKS && node->i_direct_blocks[direct_count] != 0)
+        direct_count++;
+    if(!free_data_blocks((const ssize_t*)node->i_direct_blocks, direct_count))
     {
-        ssize_t block_num = node->i_direct_blocks[i];
-        if(block_num != 0)
-        {
-            if(!free_data_block(block_num))
-            {
-                fuse_log(FUSE_LOG_ERR, "%s : Error freeing direct data block %ld\n", FREE_INODE, block_num);
-                return false;
-            }
-        } else
-        {
-            break;
-        }
+        fuse_log(FUSE_LOG_ERR, "%s : Error freeing direct data blocks\n", FREE_INODE);
+        return false;
     }
 
     // Free single indirect data blocks.
@@ -310,6 +555,14 @@ bool free_inode(ssize_t inum)
         return false;
     }
 
+    // The other inodes of the block may have changed while the data blocks were freed.
+    pthread_mutex_lock(&inodeTableLock);
+    if(!altfs_read_block(block_num, buffer)){
+        pthread_mutex_unlock(&inodeTableLock);
+        fuse_log(FUSE_LOG_ERR, "%s : Error reading data block number %ld\n", FREE_INODE, block_num);
+        return false;
+    }
+    bool was_dir = S_ISDIR(node->i_mode);
     node->i_mode = 0;
     node->i_uid = 0;
     node->i_gid = 0;
@@ -327,15 +580,37 @@ bool free_inode(ssize_t inum)
     node->i_double_indirect = 0;
     node->i_triple_indirect = 0;
     node->i_child_num = 0;
+    node->i_flags = 0;
 
-    if(!altfs_write_block(block_num, buffer))
+    bool written = altfs_journal_block(block_num, buffer);
+    pthread_mutex_unlock(&inodeTableLock);
+    if(!written)
     {
         fuse_log(FUSE_LOG_ERR, "%s : Error writing data to block number %ld\n", FREE_INODE, block_num);
         return false;
     }
 
+    release_block_reservation(inum);
+    if(inodeBitmap != NULL && inum > ROOT_INODE_NUM)
+    {
+        ssize_t group = INODE_TO_GROUP(inum);
+        bool cleared = false;
+        pthread_mutex_lock(&groupLocks[group]);
+        if(inodeBitmap[inum / 64] & ((uint64_t) 1 << (inum % 64)))
+        {
+            clear_inode_bit(inum);
+            if(was_dir)
+                inodeGroupDirs[group]--;
+            cleared = true;
+        }
+        pthread_mutex_unlock(&groupLocks[group]);
+        if(cleared)
+            update_superblock_free_counts(0, 1);
+    }
+    pthread_mutex_lock(&firstInodeLock);
     altfs_superblock->s_first_ino = min(inum, altfs_superblock->s_first_ino);
-    altfs_write_superblock();
+    pthread_mutex_unlock(&firstInodeLock);
+    mark_superblock_dirty();
     fuse_log(FUSE_LOG_DEBUG, "%s : Inode freed: %ld, next free in superblock: %ld\n", FREE_INODE, inum, altfs_superblock->s_first_ino);
     return true;
 }
@@ -1,20 +1,43 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/statvfs.h>
 #include <time.h>
 
 #include "../header/data_block_ops.h"
+#include "../header/delayed_alloc.h"
+#include "../header/directory_cache.h"
 #include "../header/directory_ops.h"
+#include "../header/disk_layer.h"
 #include "../header/inode_data_block_ops.h"
 #include "../header/inode_ops.h"
 #include "../header/interface_layer.h"
+#include "../header/orphan_list.h"
+#include "../header/readahead.h"
 #include "../header/superblock_layer.h"
+#include "../header/write_buffer.h"
 
 #define CREATE_NEW_FILE "create_new_file"
 
-bool altfs_init()
+static enum durability_mode durabilityMode = DURABILITY_STRICT;
+
+bool altfs_init(bool recount)
 {
-    return setup_filesystem();
+    if(!setup_filesystem())
+        return false;
+
+    if(recount)
+    {
+        ssize_t counted_blocks = altfs_superblock->s_free_blocks_count;
+        ssize_t free_blocks = count_free_data_blocks(true);
+        if(free_blocks < 0)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not recount free data blocks.\n", INIT);
+            return false;
+        }
+        fuse_log(FUSE_LOG_DEBUG, "%s : Recounted free data blocks: %ld (was %ld).\n", INIT, free_blocks, counted_blocks);
+    }
+    return true;
 }
 
 /*
@@ -66,6 +89,7 @@ ssize_t altfs_getattr(const char* path, struct stat** st)
 
     inode_to_stat(&node, st);
     (*st)->st_ino = inum;
+    (*st)->st_size = get_buffered_file_size(inum, get_delayed_file_size(inum, node->i_file_size));
     altfs_free_memory(node);
 
     // fuse_log(FUSE_LOG_DEBUG, "%s : Got attributes for %s\n", GETATTR, path);
@@ -131,14 +155,14 @@ ssize_t create_new_file(const char* const path, struct inode** buff, mode_t mode
     }
 
     // Allocate new inode and add directory entry
-    ssize_t child_inode_num = allocate_inode();
+    ssize_t child_inode_num = allocate_inode_for(parent_inode_num, mode);
     if(child_inode_num == -1)
     {
         fuse_log(FUSE_LOG_ERR, "%s : Could not allocate an inode for file.\n", CREATE_NEW_FILE);
         altfs_free_memory(parent_inode);
         return -EDQUOT;
     }
-    if(!add_directory_entry(&parent_inode, child_inode_num, child_name))
+    if(!add_directory_entry(&parent_inode, child_inode_num, mode, child_name))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Could not add directory entry for file.\n", CREATE_NEW_FILE);
         free_inode(child_inode_num);
@@ -160,12 +184,15 @@ ssize_t create_new_file(const char* const path, struct inode** buff, mode_t mode
     (*buff)->i_links_count = 1;
     (*buff)->i_mode = mode;
     (*buff)->i_blocks_num = 0;
-    (*buff)->i_file_size = 0;
+    (*buff)->i_file_size = S_ISDIR(mode) ? INODE_INLINE_DATA_SIZE : 0;
     (*buff)->i_atime = curr_time;
     (*buff)->i_mtime = curr_time;
     (*buff)->i_ctime = curr_time;
     (*buff)->i_status_change_time = curr_time;
     (*buff)->i_child_num = 0;
+    // Regular files and directories start out with their contents in the inode.
+    memset((*buff)->i_inline_data, 0, INODE_INLINE_DATA_SIZE);
+    (*buff)->i_flags = (S_ISREG(mode) || S_ISDIR(mode)) ? INODE_FLAG_INLINE_DATA : 0;
 
     if(!write_inode(child_inode_num, *buff))
     {
@@ -211,7 +238,7 @@ bool altfs_mkdir(const char* path, mode_t mode)
     // fuse_log(FUSE_LOG_DEBUG, "%s : Alloted inode number %ld to directory %s.\n", MKDIR, dir_inode_num, path);
 
     char* name = ".";
-    if(!add_directory_entry(&dir_inode, dir_inode_num, name))
+    if(!add_directory_entry(&dir_inode, dir_inode_num, S_IFDIR, name))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Failed to add directory entry: %s.\n", MKDIR, name);
         altfs_free_memory(dir_inode);
@@ -219,7 +246,7 @@ bool altfs_mkdir(const char* path, mode_t mode)
     }
 
     name = "..";
-    if(!add_directory_entry(&dir_inode, parent_inum, name))
+    if(!add_directory_entry(&dir_inode, parent_inum, S_IFDIR, name))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Failed to add directory entry: %s.\n", MKDIR, name);
         altfs_free_memory(dir_inode);
@@ -236,7 +263,15 @@ bool altfs_mkdir(const char* path, mode_t mode)
     return true;
 }
 
-ssize_t altfs_readdir(const char* path, void* buff, fuse_fill_dir_t filler)
+/*
+The offset of a directory entry is the byte position of its record in the directory:
+logical block number * BLOCK_SIZE + position of the record in the block.
+Each entry is reported with the offset just past its record, so a read that is resumed from that
+offset continues with the next record. Offsets stay valid across creates and deletes of other entries:
+records in directory blocks never move (see remove_directory_entry_at), and the records of a block are
+always walked from its start, so an offset inside a reused or joined deleted record is fine too.
+*/
+ssize_t altfs_readdir(const char* path, void* buff, fuse_fill_dir_t filler, off_t offset, enum fuse_readdir_flags flags)
 {
     ssize_t inum = name_i(path);
     if(inum == -1)
@@ -249,43 +284,85 @@ ssize_t altfs_readdir(const char* path, void* buff, fuse_fill_dir_t filler)
     if(!S_ISDIR(node->i_mode))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Path %s is not a directory.\n", READDIR, path);
+        altfs_free_memory(node);
         return -ENOTDIR;
     }
+    if(offset < 0)
+    {
+        altfs_free_memory(node);
+        return -EINVAL;
+    }
+
+    // Plain readdir only needs the inode number and file type, both stored in the record.
+    // Readdirplus loads the inodes of a whole directory block in one batch.
+    bool plus = (flags & FUSE_READDIR_PLUS) != 0;
+    enum fuse_fill_dir_flags fill_flags = plus ? FUSE_FILL_DIR_PLUS : 0;
+    ssize_t inums[MAX_RECORDS_PER_BLOCK];
+    unsigned char types[MAX_RECORDS_PER_BLOCK];
+    char* names[MAX_RECORDS_PER_BLOCK];
+    off_t next_offsets[MAX_RECORDS_PER_BLOCK];
+    struct inode* file_inodes = plus ? (struct inode*) malloc(MAX_RECORDS_PER_BLOCK * sizeof(struct inode)) : NULL;
 
-    ssize_t num_blocks = node->i_blocks_num;
+    ssize_t num_blocks = get_directory_block_count(node);
     ssize_t prev = 0;
-    for(ssize_t i_block_num = 0; i_block_num < num_blocks; i_block_num++)
+    bool buffer_full = false;
+    for(ssize_t i_block_num = offset / BLOCK_SIZE; i_block_num < num_blocks && !buffer_full; i_block_num++)
     {
-        ssize_t dblock_num = get_disk_block_from_inode_block(node, i_block_num, &prev);
-        char* dblock = read_data_block(dblock_num);
-        
-        ssize_t offset = 0;
-        while(offset < LAST_POSSIBLE_RECORD)
+        ssize_t dblock_num;
+        char* dblock = read_directory_block(node, i_block_num, &prev, &dblock_num);
+        if(dblock == NULL)
+            break;
+
+        // Records before the resume position were already returned.
+        ssize_t start_pos = (i_block_num == offset / BLOCK_SIZE) ? offset % BLOCK_SIZE : 0;
+        ssize_t num_records = 0;
+        ssize_t pos = 0;
+        while(pos <= LAST_POSSIBLE_RECORD)
         {
-            char* record = dblock + offset;
+            char* record = dblock + pos;
             unsigned short rec_len = ((unsigned short*)record)[0];
-            ssize_t file_inum = ((ssize_t*)(record + RECORD_LENGTH))[0];
-            unsigned short name_len = rec_len - RECORD_FIXED_LEN;
             if(rec_len == 0)
                 break;
+            ssize_t file_inum = ((ssize_t*)(record + RECORD_LENGTH))[0];
+            if(pos >= start_pos && file_inum != RECORD_DELETED_INUM)
+            {
+                inums[num_records] = file_inum;
+                types[num_records] = record[RECORD_LENGTH + RECORD_INUM];
+                names[num_records] = record + RECORD_FIXED_LEN;
+                next_offsets[num_records] = i_block_num * BLOCK_SIZE + pos + rec_len;
+                num_records++;
+            }
+            pos += rec_len;
+        }
 
-            char file_name[name_len];
-            memcpy(file_name, record + RECORD_FIXED_LEN, name_len);
-
-            struct inode* file_inode = get_inode(file_inum);
+        if(plus)
+        {
+            get_inodes(inums, num_records, file_inodes);
+        }
+        for(ssize_t i = 0; i < num_records; i++)
+        {
             struct stat stbuff_data;
             memset(&stbuff_data, 0, sizeof(struct stat));
             struct stat *stbuff = &stbuff_data;
-            inode_to_stat(&file_inode, &stbuff);
-            stbuff->st_ino = file_inum;
-            filler(buff, file_name, stbuff, 0, 0);  // check if the last value should be FUSE_FILL_DIR_PLUS
-            altfs_free_memory(file_inode);
-
-            record = NULL;
-            offset += rec_len;
+            if(plus)
+            {
+                struct inode* file_inode = &file_inodes[i];
+                inode_to_stat(&file_inode, &stbuff);
+            } else
+            {
+                stbuff->st_mode = RECORD_TYPE_TO_MODE(types[i]);
+            }
+            stbuff->st_ino = inums[i];
+            // A non-zero return means the buffer is full: the caller resumes from the last offset it got.
+            if(filler(buff, names[i], stbuff, next_offsets[i], fill_flags) != 0)
+            {
+                buffer_full = true;
+                break;
+            }
         }
         altfs_free_memory(dblock);
     }
+    altfs_free_memory(file_inodes);
     altfs_free_memory(node);
 
     return 0;
@@ -377,7 +454,12 @@ ssize_t altfs_unlink(const char* path)
     node->i_links_count--;
     if(node->i_links_count == 0)
     {
-        free_inode(inum);
+        if(S_ISDIR(node->i_mode))
+            dir_cache_invalidate(node);
+        drop_file_write_buffers(inum);
+        drop_delayed_blocks(inum);
+        if(!add_orphan(inum, node))
+            free_inode(inum);
     } else
     {
         time_t curr_time = time(NULL);
@@ -387,10 +469,7 @@ ssize_t altfs_unlink(const char* path)
     write_inode(parent_inum, parent);
     altfs_free_memory(parent);
     altfs_free_memory(node);
-    if(!remove_from_inode_cache(path))
-    {
-        flush_inode_cache(true);
-    }
+    remove_from_inode_cache(path);
     fuse_log(FUSE_LOG_DEBUG, "%s : Deleted file %s\n", UNLINK, path);
     return 0;
 }
@@ -462,12 +541,54 @@ ssize_t altfs_open(const char* path, ssize_t oflag)
     return inum;
 }
 
-// Check if this even needs to be implemented.
 ssize_t altfs_close(ssize_t file_descriptor)
 {
+    if(file_descriptor == 0)
+        return 0;
+    return close_write_buffer(file_descriptor);
+}
+
+ssize_t altfs_flush(const char* path, ssize_t file_descriptor)
+{
+    ssize_t res = file_descriptor == 0 ? 0 : flush_write_buffer(file_descriptor);
+    ssize_t inum = name_i(path);
+    if(inum == -1)
+        return res;     // deleted: nothing of it left to write
+    if(!flush_file_write_buffers(inum) && res == 0)
+        res = -EIO;
+    if(!flush_delayed_blocks(inum, NULL))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not flush the buffered data of %s.\n", FLUSH, path);
+        if(res == 0)
+            res = -EIO;
+    }
+    return res;
+}
+
+ssize_t altfs_sync()
+{
+    if(durabilityMode == DURABILITY_NONE)
+        return 0;
+    // Holds the freelist heads and counts, so fdatasync needs it as much as fsync.
+    if(!sync_superblock())
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write the superblock.\n", SYNC);
+        return -EIO;
+    }
+    bool synced = durabilityMode == DURABILITY_BATCHED ? altfs_sync_volume_batched() : altfs_sync_volume();
+    if(!synced)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not sync the volume.\n", SYNC);
+        return -EIO;
+    }
     return 0;
 }
 
+void altfs_set_durability(enum durability_mode mode)
+{
+    durabilityMode = mode;
+}
+
 ssize_t altfs_read(const char* path, char* buff, size_t nbytes, off_t offset)
 {
     fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to read %ld bytes from %s at offset %ld.\n", READ, nbytes, path, offset);
@@ -488,6 +609,12 @@ ssize_t altfs_read(const char* path, char* buff, size_t nbytes, off_t offset)
         fuse_log(FUSE_LOG_ERR, "%s : Inode for file %s not found.\n", READ, path);
         return -ENOENT;
     }
+    flush_file_write_buffers(inum);
+    if(!flush_delayed_blocks(inum, NULL))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not flush the buffered data of %s.\n", READ, path);
+        return -EIO;
+    }
 
     struct inode* node= get_inode(inum);
     // if(!(bool)(node->i_mode & S_IRUSR))
@@ -524,7 +651,12 @@ ssize_t altfs_read(const char* path, char* buff, size_t nbytes, off_t offset)
     char* buf_read = NULL;
 
     ssize_t prev_block = 0;
-    if(blocks_to_read == 1)
+    if(node->i_flags & INODE_FLAG_INLINE_DATA)
+    {
+        memcpy(buff, node->i_inline_data + offset, nbytes);
+        bytes_read = nbytes;
+    }
+    else if(blocks_to_read == 1)
     {
         // Only 1 block to be read
         dblock_num = get_disk_block_from_inode_block(node, start_i_block, &prev_block);
@@ -588,6 +720,8 @@ ssize_t altfs_read(const char* path, char* buff, size_t nbytes, off_t offset)
         }
     }
     altfs_free_memory(buf_read);
+    if(!(node->i_flags & INODE_FLAG_INLINE_DATA))
+        readahead_after_read(node, inum, start_i_block, end_i_block);
     time_t curr_time = time(NULL);
     node->i_atime = curr_time;
 
@@ -601,7 +735,20 @@ ssize_t altfs_read(const char* path, char* buff, size_t nbytes, off_t offset)
 
 ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t offset)
 {
-    fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to write %ld bytes to %s at offset %ld.\n", WRITE, nbytes, path, offset);
+    ssize_t inum = name_i(path);
+    if (inum == -1)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Inode for file %s not found.\n", WRITE, path);
+        return -ENOENT;
+    }
+    // Data still buffered for the file was written before this.
+    flush_file_write_buffers(inum);
+    return altfs_write_inum(inum, buff, nbytes, offset);
+}
+
+ssize_t altfs_write_inum(ssize_t inum, const char* buff, size_t nbytes, off_t offset)
+{
+    fuse_log(FUSE_LOG_DEBUG, "%s : Attempting to write %ld bytes to inode %ld at offset %ld.\n", WRITE, nbytes, inum, offset);
     if(nbytes == 0)
     {
         fuse_log(FUSE_LOG_DEBUG, "%s : Nbytes is 0, returning 0.\n", WRITE);
@@ -614,26 +761,72 @@ ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t off
         return -EINVAL;
     }
 
-    ssize_t inum = name_i(path);
-    if (inum == -1)
-    {
-        fuse_log(FUSE_LOG_ERR, "%s : Inode for file %s not found.\n", WRITE, path);
-        return -ENOENT;
-    }
-
     struct inode* node = get_inode(inum);
     // if(!(bool)(node->i_mode & S_IWUSR))
     // {
-    //     fuse_log(FUSE_LOG_ERR, "%s : File %s does not have write permission.\n", WRITE, path);
+    //     fuse_log(FUSE_LOG_ERR, "%s : Inode %ld does not have write permission.\n", WRITE, inum);
     //     return -EACCES;
     // }
     size_t bytes_written = 0;
 
+    if(node->i_flags & INODE_FLAG_INLINE_DATA)
+    {
+        if(offset + nbytes <= INODE_INLINE_DATA_SIZE)
+        {
+            memcpy(node->i_inline_data + offset, buff, nbytes);
+            if(offset + (ssize_t)nbytes > node->i_file_size)
+                node->i_file_size = offset + nbytes;
+            time_t curr_time = time(NULL);
+            node->i_mtime = curr_time;
+            node->i_status_change_time = curr_time;
+            if(!write_inode(inum, node))
+            {
+                fuse_log(FUSE_LOG_ERR, "%s : Could not write inode %ld.\n", WRITE, inum);
+                altfs_free_memory(node);
+                return -1;
+            }
+            fuse_log(FUSE_LOG_DEBUG, "%s : Written %ld bytes inline to inode %ld\n", WRITE, nbytes, inum);
+            altfs_free_memory(node);
+            return nbytes;
+        }
+
+        // The file no longer fits in its inode: its contents move to the write buffer if they can,
+        // or else to a new data block.
+        if(S_ISREG(node->i_mode) && node->i_file_size > 0 && prepare_delayed_write(node, inum, 0, node->i_file_size))
+        {
+            write_delayed_blocks(inum, node->i_inline_data, node->i_file_size, 0);
+            memset(node->i_inline_data, 0, INODE_INLINE_DATA_SIZE);
+            node->i_flags &= ~INODE_FLAG_INLINE_DATA;
+            node->i_blocks_num = 0;
+            node->i_file_size = 0;
+        }
+        else if(!move_inline_data_to_block(node, inum))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not move inline data of inode %ld to a data block.\n", WRITE, inum);
+            altfs_free_memory(node);
+            return -ENOSPC;
+        }
+    }
+
     ssize_t start_i_block = (ssize_t)(offset / BLOCK_SIZE);
     ssize_t start_block_offset = (ssize_t)(offset % BLOCK_SIZE);
     ssize_t end_i_block = (ssize_t)((offset + nbytes - 1) / BLOCK_SIZE);
     ssize_t end_block_offset = (ssize_t)((offset + nbytes - 1) % BLOCK_SIZE);
-    ssize_t new_blocks_to_be_added = end_i_block - node->i_blocks_num + 1;
+
+    // What goes past the allocated blocks is buffered, and gets its blocks when the file is flushed.
+    // If it cannot be buffered, the blocks already buffered are allocated first, and then this write's.
+    bool delayed = false;
+    if(end_i_block >= node->i_blocks_num)
+    {
+        delayed = S_ISREG(node->i_mode) && prepare_delayed_write(node, inum, offset, nbytes);
+        if(!delayed && !flush_delayed_blocks(inum, node))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not flush the buffered data of inode %ld.\n", WRITE, inum);
+            altfs_free_memory(node);
+            return -ENOSPC;
+        }
+    }
+    ssize_t new_blocks_to_be_added = delayed ? 0 : end_i_block - node->i_blocks_num + 1;
     ssize_t starting_block = start_i_block - node->i_blocks_num + 1; // In case offset > file size, we might be starting some blocks after what has been allocated.
 
     char overwrite_buf[BLOCK_SIZE];
@@ -698,10 +891,17 @@ ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t off
         buf_read = NULL;
     }
 
+    if(delayed && bytes_written < nbytes)
+    {
+        write_delayed_blocks(inum, buff + bytes_written, nbytes - bytes_written, offset + bytes_written);
+        bytes_written = nbytes;
+    }
+
     ssize_t new_block_num;
+    ssize_t goal = new_blocks_to_be_added > 0 ? get_allocation_goal(node, inum) : 0;
     for(ssize_t i = 1; i <= new_blocks_to_be_added; i++)
     {
-        new_block_num = allocate_data_block();
+        new_block_num = allocate_data_block_near(goal, inum);
         if(new_block_num <= 0)
         {
             fuse_log(FUSE_LOG_ERR, "%s : Could not allocate new data block. Bytes written %ld.\n", WRITE, bytes_written);
@@ -712,6 +912,13 @@ ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t off
             fuse_log(FUSE_LOG_ERR, "%s : Could not add new data block to inode %ld.\n", WRITE, inum);
             break;
         }
+        goal = new_block_num + 1;
+        // A long write is split into journal operations, each leaving the blocks so far in the inode.
+        if(i % OPERATION_BATCH_BLOCKS == 0 && i < new_blocks_to_be_added)
+        {
+            write_inode(inum, node);
+            altfs_journal_restart();
+        }
 
         memset(overwrite_buf, 0, BLOCK_SIZE);
         if(starting_block >= 1 && i == starting_block) // first block with data; only goes in if overall starts writing here
@@ -741,9 +948,12 @@ ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t off
         }
     }
 
-    ssize_t bytes_to_add = (ssize_t)((offset + bytes_written) - node->i_file_size);
-    bytes_to_add = (bytes_to_add > 0) ? bytes_to_add : 0;
-    node->i_file_size += bytes_to_add;
+    // The inode only counts the bytes that have blocks; the buffer keeps the size past them.
+    ssize_t written_end = (ssize_t)(offset + bytes_written);
+    if(written_end > node->i_blocks_num * BLOCK_SIZE)
+        written_end = node->i_blocks_num * BLOCK_SIZE;
+    if(written_end > node->i_file_size)
+        node->i_file_size = written_end;
     if(bytes_written > 0)
     {
         time_t curr_time= time(NULL);
@@ -755,7 +965,7 @@ ssize_t altfs_write(const char* path, const char* buff, size_t nbytes, off_t off
         fuse_log(FUSE_LOG_ERR, "%s : Could not write inode %ld.\n", WRITE, inum);
         return -1;
     }
-    fuse_log(FUSE_LOG_DEBUG, "%s : Written %ld bytes to %s\n", WRITE, bytes_written, path);
+    fuse_log(FUSE_LOG_DEBUG, "%s : Written %ld bytes to inode %ld\n", WRITE, bytes_written, inum);
     altfs_free_memory(node);
     return bytes_written;
 }
@@ -769,6 +979,12 @@ ssize_t altfs_truncate(const char* path, off_t length)
         fuse_log(FUSE_LOG_ERR, "%s : Failed to get inode number for path: %s.\n", TRUNCATE, path);
         return -ENOENT;
     }
+    flush_file_write_buffers(inum);
+    if(!flush_delayed_blocks(inum, NULL))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Could not flush the buffered data of %s.\n", TRUNCATE, path);
+        return -EIO;
+    }
     struct inode* node = get_inode(inum);
     if(!(bool)(node->i_mode & S_IWUSR))
     {
@@ -806,9 +1022,48 @@ ssize_t altfs_truncate(const char* path, off_t length)
         }
     }
 
+    // A long tail is freed in batches, each its own journal operation.
+    ssize_t keep = (length == 0) ? 0 : (ssize_t)((length - 1) / BLOCK_SIZE + 1);
+    while(node->i_blocks_num > keep + OPERATION_BATCH_BLOCKS)
+    {
+        release_block_reservation(inum);
+        if(!remove_datablocks_from_inode(node, node->i_blocks_num - OPERATION_BATCH_BLOCKS))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to free the blocks after %ld of %s.\n", TRUNCATE, node->i_blocks_num, path);
+            altfs_free_memory(node);
+            return -1;
+        }
+        if(node->i_file_size > node->i_blocks_num * BLOCK_SIZE)
+            node->i_file_size = node->i_blocks_num * BLOCK_SIZE;
+        write_inode(inum, node);
+        altfs_journal_restart();
+    }
+
+    // A file short enough to fit in its inode is kept there.
+    if(S_ISREG(node->i_mode) && length <= INODE_INLINE_DATA_SIZE)
+    {
+        if(node->i_flags & INODE_FLAG_INLINE_DATA)
+        {
+            memset(node->i_inline_data + length, 0, INODE_INLINE_DATA_SIZE - length);
+        }
+        else if(!move_data_inline(node, length))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Failed to move the contents of %s into its inode.\n", TRUNCATE, path);
+            altfs_free_memory(node);
+            return -1;
+        }
+        node->i_file_size = (ssize_t)length;
+        write_inode(inum, node);
+        altfs_free_memory(node);
+        fuse_log(FUSE_LOG_DEBUG, "%s : Truncated %s to %ld bytes.\n", TRUNCATE, path, (ssize_t)length);
+        return 0;
+    }
+
     ssize_t i_block_num = (length == 0) ? -1 : (ssize_t)((length - 1) / BLOCK_SIZE);
     if(node->i_blocks_num > i_block_num + 1)
     {
+        // The blocks after the new end are about to be freed: the file is not streaming there any more.
+        release_block_reservation(inum);
         // Remove everything from i_block_num + 1
         remove_datablocks_from_inode(node, i_block_num + 1);
     }
@@ -872,139 +1127,244 @@ ssize_t altfs_chmod(const char* path, mode_t mode)
     return 0;
 }
 
-ssize_t altfs_rename(const char *from, const char *to)
+/*
+Move the located record at from_pos to to_child_name in the target directory, replacing the
+record at to_pos if the target exists. The caller owns (and frees) every buffer passed in.
+
+@return 0 on success, negative errno on failure.
+*/
+static ssize_t move_directory_record(ssize_t from_parent_inum, struct inode** from_parent_inode, struct fileposition* from_pos,
+    ssize_t to_parent_inum, struct inode** to_parent_inode, const struct fileposition* const to_pos, char* to_child_name)
 {
-    // fuse_log(FUSE_LOG_DEBUG, "%s : Attempting rename from %s to %s.\n", RENAME, from, to);
-    // Hacky approach - copy file to the new location and remove the old one
-    // check if from exists
+    bool same_dir = (from_parent_inum == to_parent_inum);
+    ssize_t inum = ((ssize_t*)(from_pos->p_block + from_pos->offset + RECORD_LENGTH))[0];
+    struct inode* node = get_inode(inum);
+    bool is_dir = S_ISDIR(node->i_mode);
 
-    if(altfs_access(from) != 0)
-    {
-        fuse_log(FUSE_LOG_ERR, "%s : From path %s not found.\n", RENAME, from);
-        return -ENOENT;
-    }
-    // check if to exists
-    if(altfs_access(to) == 0)
+    if(to_pos->offset != -1)
     {
-        // to exists, try to unlink it
-        ssize_t unlink_res = altfs_unlink(to);
-        if(unlink_res != 0)
+        ssize_t replaced_inum = ((ssize_t*)(to_pos->p_block + to_pos->offset + RECORD_LENGTH))[0];
+        if(replaced_inum == inum)
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Failed to unlink %s\n", RENAME, to);
-            return unlink_res;
+            // Both names are links to the same file: nothing to do.
+            altfs_free_memory(node);
+            return 0;
         }
-    }
-    
-    ssize_t to_path_len = strlen(to);
-    char to_parent_path[to_path_len + 1];
-    if(!copy_parent_path(to_parent_path, to, to_path_len))
+        struct inode* replaced = get_inode(replaced_inum);
+        ssize_t err = 0;
+        if(S_ISDIR(replaced->i_mode) && !is_dir)
+            err = -EISDIR;
+        else if(!S_ISDIR(replaced->i_mode) && is_dir)
+            err = -ENOTDIR;
+        else if(S_ISDIR(replaced->i_mode) && !is_empty_dir(&replaced))
+            err = -ENOTEMPTY;
+        else if(!set_directory_entry_inum(*to_parent_inode, to_pos, inum, node->i_mode))
+            err = -EIO;
+        if(err != 0)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Cannot replace target %s: %ld.\n", RENAME, to_child_name, err);
+            altfs_free_memory(replaced);
+            altfs_free_memory(node);
+            return err;
+        }
+
+        // Drop the link held by the overwritten record.
+        replaced->i_links_count--;
+        if(replaced->i_links_count == 0)
+        {
+            if(S_ISDIR(replaced->i_mode))
+                dir_cache_invalidate(replaced);
+            drop_file_write_buffers(replaced_inum);
+            drop_delayed_blocks(replaced_inum);
+            if(!add_orphan(replaced_inum, replaced))
+                free_inode(replaced_inum);
+        } else
+        {
+            replaced->i_status_change_time = time(NULL);
+            write_inode(replaced_inum, replaced);
+        }
+        altfs_free_memory(replaced);
+    } else if(same_dir && rename_directory_entry_in_place(*from_parent_inode, from_pos, to_child_name))
     {
-        fuse_log(FUSE_LOG_ERR, "%s : No parent path exists for to path: %s.\n", RENAME, to);
-        return -1;
+        altfs_free_memory(node);
+        return 0;
+    } else if(!add_directory_entry(to_parent_inode, inum, node->i_mode, to_child_name))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Error adding child record %s to target directory.\n", RENAME, to_child_name);
+        altfs_free_memory(node);
+        return -EDQUOT;
     }
 
-    // Check for to's parent sanity.
-    ssize_t to_parent_inode_num = name_i(to_parent_path);
-    if(to_parent_inode_num == -1)
+    // The record for the new name may have landed in the block holding the old one, or moved the
+    // records of an inline directory to a data block.
+    if(same_dir && !reload_file_position(*from_parent_inode, from_pos))
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Invalid to parent path: %s.\n", RENAME, to_parent_path);
-        return -1;
+        altfs_free_memory(node);
+        return -EIO;
     }
-    struct inode* to_parent_inode = get_inode(to_parent_inode_num);
-    if(!S_ISDIR(to_parent_inode->i_mode))
+    if(!remove_directory_entry_at(from_parent_inode, from_pos))
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Parent is not a directory: %s.\n", RENAME, to_parent_path);
-        altfs_free_memory(to_parent_inode);
-        return -1;
+        altfs_free_memory(node);
+        return -EIO;
     }
-    // Check parent write permission
-    // if(!(bool)(to_parent_inode->i_mode & S_IWUSR))
-    // {
-    //     fuse_log(FUSE_LOG_ERR, "%s : Parent directory does not have write permission: %s.\n", RENAME, to_parent_path);
-    //     altfs_free_memory(to_parent_inode);
-    //     return -EACCES;
-    // }
 
-    /*
-    Add record in to's parent.
-    */
-    // fuse_log(FUSE_LOG_DEBUG, "%s : Adding record in TO's parent.\n", RENAME);
-    char to_child_name[to_path_len + 1];
-    if(!copy_file_name(to_child_name, to, to_path_len))
+    // A directory that changed parents must point its ".." at the new one.
+    if(is_dir && !same_dir)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error getting child file name from path: %s.\n", RENAME, to);
-        return -1;
+        struct fileposition dotdot_pos = get_file_position_in_dir("..", node);
+        if(dotdot_pos.offset != -1 && set_directory_entry_inum(node, &dotdot_pos, to_parent_inum, S_IFDIR) &&
+            dotdot_pos.p_plock_num == INLINE_DIR_BLOCK_NUM)
+        {
+            write_inode(inum, node);
+        }
+        altfs_free_memory(dotdot_pos.p_block);
     }
+    altfs_free_memory(node);
+    return 0;
+}
 
-    ssize_t inum = name_i(from);
-    if(!add_directory_entry(&to_parent_inode, inum, to_child_name))
+/*
+ALGORITHM:
+
+Resolve both parent directories (through the inode cache) and locate the source and target records once.
+If the target exists:
+    Point the target record at the source inode and drop the link of the replaced inode.
+Else if both names are in the same directory and the new name fits in the source record:
+    Rewrite the source record's name in place.
+Else:
+    Add a record for the new name in the target directory.
+Remove the source record (unless it was renamed in place).
+Invalidate cached lookups under both paths.
+*/
+ssize_t altfs_rename(const char *from, const char *to)
+{
+    ssize_t from_path_len = strlen(from);
+    ssize_t to_path_len = strlen(to);
+    if(strcmp(from, to) == 0)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error adding child record %s to parent %s: %s.\n", RENAME, to_child_name, to_parent_path);
-        altfs_free_memory(to_parent_inode);
-        return -EDQUOT;
+        return name_i(from) == -1 ? -ENOENT : 0;
     }
-    time_t curr_time = time(NULL);
-    to_parent_inode->i_mtime = curr_time;
-    to_parent_inode->i_ctime = curr_time;
-    if(!write_inode(to_parent_inode_num, to_parent_inode))
+    // A directory cannot be moved beneath itself.
+    if(to_path_len > from_path_len && strncmp(from, to, from_path_len) == 0 && to[from_path_len] == '/')
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Could not write directory inode.\n", RENAME);
-        altfs_free_memory(to_parent_inode);
-        return -1;
+        fuse_log(FUSE_LOG_ERR, "%s : Cannot move %s beneath itself to %s.\n", RENAME, from, to);
+        return -EINVAL;
     }
-    altfs_free_memory(to_parent_inode);
 
-    /*
-    Remove record in from's parent.
-    */
-    // fuse_log(FUSE_LOG_DEBUG, "%s : Removing record from FROM's parent.\n", RENAME);
-    ssize_t from_path_len = strlen(from);
     char from_parent_path[from_path_len + 1];
-    if(!copy_parent_path(from_parent_path, from, from_path_len))
+    char from_child_name[from_path_len + 1];
+    if(!copy_parent_path(from_parent_path, from, from_path_len) || !copy_file_name(from_child_name, from, from_path_len))
     {
         fuse_log(FUSE_LOG_ERR, "%s : No parent path exists for path: %s.\n", RENAME, from);
-        return -1;
+        return -ENOENT;
+    }
+    char to_parent_path[to_path_len + 1];
+    char to_child_name[to_path_len + 1];
+    if(!copy_parent_path(to_parent_path, to, to_path_len) || !copy_file_name(to_child_name, to, to_path_len))
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : No parent path exists for to path: %s.\n", RENAME, to);
+        return -ENOENT;
+    }
+    if(strlen(to_child_name) > MAX_FILE_NAME_LENGTH)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : File name is > 255 bytes: %s.\n", RENAME, to);
+        return -ENAMETOOLONG;
     }
 
-    ssize_t from_parent_inode_num = name_i(from_parent_path);
-    if(from_parent_inode_num == -1)
+    ssize_t from_parent_inum = name_i(from_parent_path);
+    if(from_parent_inum == -1)
     {
         fuse_log(FUSE_LOG_ERR, "%s : Invalid parent path: %s.\n", RENAME, from_parent_path);
-        return -1;
+        return -ENOENT;
     }
-    struct inode* from_parent_inode = get_inode(from_parent_inode_num);
-
-    char from_child_name[from_path_len + 1];
-    if(!copy_file_name(from_child_name, from, from_path_len))
+    ssize_t to_parent_inum = name_i(to_parent_path);
+    if(to_parent_inum == -1)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Error getting child file name from path: %s.\n", RENAME, from);
-        return -1;
+        fuse_log(FUSE_LOG_ERR, "%s : Invalid to parent path: %s.\n", RENAME, to_parent_path);
+        return -ENOENT;
     }
+    bool same_dir = (from_parent_inum == to_parent_inum);
 
-    if(!remove_directory_entry(&from_parent_inode, from_child_name))
+    struct inode* from_parent_inode = get_inode(from_parent_inum);
+    struct inode* to_parent_inode = same_dir ? from_parent_inode : get_inode(to_parent_inum);
+    if(!S_ISDIR(to_parent_inode->i_mode))
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Could not delete entry for child %s in parent %s.\n", RENAME, from_child_name, from_parent_path);
+        fuse_log(FUSE_LOG_ERR, "%s : Parent is not a directory: %s.\n", RENAME, to_parent_path);
+        if(!same_dir)
+            altfs_free_memory(to_parent_inode);
         altfs_free_memory(from_parent_inode);
-        return -1;
+        return -ENOTDIR;
     }
-    from_parent_inode->i_mtime = curr_time;
-    from_parent_inode->i_ctime = curr_time;
-    if(!write_inode(from_parent_inode_num, from_parent_inode))
+
+    ssize_t res = 0;
+    struct fileposition from_pos = get_file_position_in_dir(from_child_name, from_parent_inode);
+    struct fileposition to_pos = { NULL, -1, -1, -1 };
+    if(from_pos.offset == -1)
     {
-        fuse_log(FUSE_LOG_ERR, "%s : Could not write directory inode.\n", RENAME);
-        altfs_free_memory(from_parent_inode);
-        return -1;
+        fuse_log(FUSE_LOG_ERR, "%s : From path %s not found.\n", RENAME, from);
+        res = -ENOENT;
+    } else
+    {
+        to_pos = get_file_position_in_dir(to_child_name, to_parent_inode);
+        res = move_directory_record(from_parent_inum, &from_parent_inode, &from_pos, to_parent_inum, &to_parent_inode, &to_pos, to_child_name);
+    }
+
+    if(res == 0)
+    {
+        time_t curr_time = time(NULL);
+        from_parent_inode->i_mtime = curr_time;
+        from_parent_inode->i_ctime = curr_time;
+        to_parent_inode->i_mtime = curr_time;
+        to_parent_inode->i_ctime = curr_time;
+        if(!write_inode(from_parent_inum, from_parent_inode) || (!same_dir && !write_inode(to_parent_inum, to_parent_inode)))
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not write directory inode.\n", RENAME);
+            res = -EIO;
+        }
     }
+
+    altfs_free_memory(from_pos.p_block);
+    altfs_free_memory(to_pos.p_block);
+    if(!same_dir)
+        altfs_free_memory(to_parent_inode);
     altfs_free_memory(from_parent_inode);
+    if(res != 0)
+    {
+        return res;
+    }
 
-    flush_inode_cache(true);
+    // Cached lookups under either name are now stale.
+    remove_from_inode_cache(from);
+    remove_from_inode_cache(to);
 
     fuse_log(FUSE_LOG_DEBUG, "%s : Renamed %s to %s\n", RENAME, from, to);
     return 0;
 }
 
+ssize_t altfs_statfs(struct statvfs* st)
+{
+    // Blocks held for delayed writes are as good as used.
+    ssize_t free_blocks = get_available_data_blocks();
+    memset(st, 0, sizeof(struct statvfs));
+    st->f_bsize = BLOCK_SIZE;
+    st->f_frsize = BLOCK_SIZE;
+    st->f_blocks = NUM_OF_DATA_BLOCKS;
+    st->f_bfree = free_blocks;
+    st->f_bavail = free_blocks;
+    st->f_files = altfs_superblock->s_inodes_count;
+    st->f_ffree = altfs_superblock->s_free_inodes_count;
+    st->f_favail = altfs_superblock->s_free_inodes_count;
+    st->f_namemax = MAX_FILE_NAME_LENGTH;
+    return 0;
+}
+
 void altfs_destroy()
 {
+    stop_orphan_worker();
+    flush_all_write_buffers();
+    flush_all_delayed_blocks();
     flush_inode_cache(false);
+    flush_dir_cache();
+    free_inode_bitmap();
     teardown();
 }
@@ -50,7 +50,7 @@ int main(int argc, char *argv[])
 
     printf("mkaltfs (02-Dec-2023)\n");
 
-    ssize_t n_inodes = INODE_BLOCK_COUNT * (BLOCK_SIZE / sizeof(struct inode));
+    ssize_t n_inodes = INODE_BLOCK_COUNT * (BLOCK_SIZE / INODE_SIZE);
     if(F)
         printf("Creating filesystem with %ld 4k blocks and %ld inodes\n\n", BLOCK_COUNT, n_inodes);
 
@@ -0,0 +1,259 @@
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../header/data_block_ops.h"
+#include "../header/inode_ops.h"
+#include "../header/orphan_list.h"
+
+static bool orphanWorkerRunning = false;
+static bool orphanWorkerStop = false;
+static pthread_t orphanWorker;
+static pthread_mutex_t orphanLock = PTHREAD_MUTEX_INITIALIZER;   // guards the above, s_orphans and s_orphan_chain
+static pthread_cond_t orphanAdded = PTHREAD_COND_INITIALIZER;
+
+// Call with orphanLock held.
+static bool write_orphans_locked()
+{
+    mark_superblock_dirty();
+    return sync_superblock();
+}
+
+// Call with orphanLock held.
+static void remove_orphan_locked(ssize_t inum)
+{
+    ssize_t count = altfs_superblock->s_orphans_count;
+    for(ssize_t i = 0; i < count; i++)
+    {
+        if(altfs_superblock->s_orphans[i] != inum)
+            continue;
+        memmove(&altfs_superblock->s_orphans[i], &altfs_superblock->s_orphans[i + 1], (count - i - 1) * sizeof(ssize_t));
+        altfs_superblock->s_orphans[count - 1] = 0;
+        altfs_superblock->s_orphans_count--;
+        if(!write_orphans_locked())
+            fuse_log(FUSE_LOG_ERR, "%s : Could not write the orphan list after freeing inode %ld.\n", FREE_ORPHAN, inum);
+        return;
+    }
+}
+
+bool add_orphan(ssize_t inum, struct inode* node)
+{
+    if(S_ISDIR(node->i_mode) || (node->i_flags & INODE_FLAG_INLINE_DATA) || node->i_blocks_num < ORPHAN_MIN_BLOCKS)
+        return false;
+
+    pthread_mutex_lock(&orphanLock);
+    // Once the list is full, the orphan goes on the chain through the inodes, which is as durable.
+    bool full = altfs_superblock->s_orphans_count == MAX_ORPHANS;
+    node->i_status_change_time = time(NULL);
+    if(full)
+        node->i_next_orphan = altfs_superblock->s_orphan_chain;
+    if(!write_inode(inum, node))
+    {
+        pthread_mutex_unlock(&orphanLock);
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write inode %ld.\n", ADD_ORPHAN, inum);
+        return false;
+    }
+    if(full)
+    {
+        fuse_log(FUSE_LOG_DEBUG, "%s : Orphan list is full, inode %ld goes on the chain.\n", ADD_ORPHAN, inum);
+        altfs_superblock->s_orphan_chain = inum;
+    } else
+        altfs_superblock->s_orphans[altfs_superblock->s_orphans_count++] = inum;
+    if(!write_orphans_locked())
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write the orphan list with inode %ld.\n", ADD_ORPHAN, inum);
+    pthread_cond_signal(&orphanAdded);
+    pthread_mutex_unlock(&orphanLock);
+    fuse_log(FUSE_LOG_DEBUG, "%s : Inode %ld with %ld blocks is freed in the background.\n", ADD_ORPHAN, inum, node->i_blocks_num);
+    return true;
+}
+
+/*
+Take logical blocks [start, end) (the last ones) off an inode: their data blocks, and the indirect
+blocks that only map blocks in the range, go to blocks. The block pointers in the inode are cleared.
+
+@return Number of blocks put in blocks, or -1 if a block could not be mapped.
+*/
+static ssize_t collect_tail_blocks(struct inode* node, ssize_t start, ssize_t end, ssize_t* blocks)
+{
+    ssize_t count = 0;
+    ssize_t prev_indirect_block = 0;
+    for(ssize_t block = start; block < end; block++)
+    {
+        ssize_t dblock_num = get_disk_block_from_inode_block(node, block, &prev_indirect_block);
+        if(dblock_num <= 0)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not map logical block %ld.\n", FREE_ORPHAN, block);
+            return -1;
+        }
+        blocks[count++] = dblock_num;
+        if(block < NUM_OF_DIRECT_BLOCKS)
+            node->i_direct_blocks[block] = 0;
+        if(block < DIRECT_PLUS_SINGLE_INDIRECT_ADDR)
+            continue;
+
+        // A block of addresses goes with the first block it maps.
+        if((block - DIRECT_PLUS_SINGLE_INDIRECT_ADDR) % NUM_OF_ADDRESSES_PER_BLOCK == 0)
+            blocks[count++] = prev_indirect_block;
+        if(block >= DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR &&
+            (block - DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR) % NUM_OF_DOUBLE_INDIRECT_BLOCK_ADDR == 0)
+        {
+            ssize_t* triple_indirect_block_arr = (ssize_t*) read_data_block(node->i_triple_indirect);
+            if(triple_indirect_block_arr == NULL)
+                return -1;
+            blocks[count++] = triple_indirect_block_arr[(block - DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR) / NUM_OF_DOUBLE_INDIRECT_BLOCK_ADDR];
+            altfs_free_memory(triple_indirect_block_arr);
+        }
+    }
+
+    if(start <= NUM_OF_DIRECT_BLOCKS && end > NUM_OF_DIRECT_BLOCKS)
+    {
+        blocks[count++] = node->i_single_indirect;
+        node->i_single_indirect = 0;
+    }
+    if(start <= DIRECT_PLUS_SINGLE_INDIRECT_ADDR && end > DIRECT_PLUS_SINGLE_INDIRECT_ADDR)
+    {
+        blocks[count++] = node->i_double_indirect;
+        node->i_double_indirect = 0;
+    }
+    if(start <= DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR && end > DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR)
+    {
+        blocks[count++] = node->i_triple_indirect;
+        node->i_triple_indirect = 0;
+    }
+    return count;
+}
+
+/*
+Free the next batch of an orphan's blocks, or the orphan itself once it has none left.
+
+@return 1 if the orphan is gone (or was not an orphan), 0 if it has blocks left, -1 on failure.
+*/
+static ssize_t free_orphan_batch(ssize_t inum)
+{
+    struct inode* node = get_inode(inum);
+    if(node == NULL)
+        return -1;
+    if(!node->i_allocated || node->i_links_count != 0)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Inode %ld is not an orphan, dropped from the list.\n", FREE_ORPHAN, inum);
+        altfs_free_memory(node);
+        return 1;
+    }
+    if(node->i_blocks_num == 0)
+    {
+        altfs_free_memory(node);
+        return free_inode(inum) ? 1 : -1;
+    }
+
+    ssize_t* blocks = (ssize_t*) malloc((ORPHAN_FREE_BATCH + ORPHAN_FREE_BATCH / NUM_OF_ADDRESSES_PER_BLOCK + 8) * sizeof(ssize_t));
+    ssize_t end = node->i_blocks_num;
+    ssize_t start = end > ORPHAN_FREE_BATCH ? end - ORPHAN_FREE_BATCH : 0;
+    ssize_t count = blocks == NULL ? -1 : collect_tail_blocks(node, start, end, blocks);
+    if(count < 0)
+    {
+        altfs_free_memory(blocks);
+        altfs_free_memory(node);
+        return -1;
+    }
+
+    // The inode lets go of the blocks before they are freed.
+    node->i_blocks_num = start;
+    if(node->i_file_size > start * BLOCK_SIZE)
+        node->i_file_size = start * BLOCK_SIZE;
+    bool res = write_inode(inum, node);
+    altfs_free_memory(node);
+    if(res && !free_data_blocks(blocks, count))
+        fuse_log(FUSE_LOG_ERR, "%s : Could not free all %ld blocks of a batch of inode %ld.\n", FREE_ORPHAN, count, inum);
+    altfs_free_memory(blocks);
+    return res ? 0 : -1;
+}
+
+/*
+Move orphans from the chain to the free entries of s_orphans. Call with orphanLock held, in a journal
+operation: the chain and the list are written in the same transaction.
+*/
+static void move_chained_orphans_locked()
+{
+    ssize_t moved = 0;
+    while(altfs_superblock->s_orphan_chain != 0 && altfs_superblock->s_orphans_count < MAX_ORPHANS)
+    {
+        ssize_t inum = altfs_superblock->s_orphan_chain;
+        struct inode* node = get_inode(inum);
+        if(node == NULL)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not read chained orphan %ld, the rest of the chain is lost.\n", FREE_ORPHAN, inum);
+            altfs_superblock->s_orphan_chain = 0;
+            break;
+        }
+        altfs_superblock->s_orphan_chain = node->i_next_orphan;
+        altfs_superblock->s_orphans[altfs_superblock->s_orphans_count++] = inum;
+        node->i_next_orphan = 0;
+        write_inode(inum, node);
+        altfs_free_memory(node);
+        moved++;
+    }
+    if(moved > 0 && !write_orphans_locked())
+        fuse_log(FUSE_LOG_ERR, "%s : Could not write the orphan list with %ld chained inodes.\n", FREE_ORPHAN, moved);
+}
+
+static void* run_orphan_worker(void* arg)
+{
+    pthread_mutex_lock(&orphanLock);
+    while(true)
+    {
+        while(altfs_superblock->s_orphans_count == 0 && altfs_superblock->s_orphan_chain == 0 && !orphanWorkerStop)
+            pthread_cond_wait(&orphanAdded, &orphanLock);
+        if(orphanWorkerStop)
+            break;
+        pthread_mutex_unlock(&orphanLock);
+
+        // A batch is one operation of the journal, like the FUSE operations.
+        altfs_journal_start();
+        pthread_mutex_lock(&orphanLock);
+        move_chained_orphans_locked();
+        ssize_t inum = altfs_superblock->s_orphans[0];
+        pthread_mutex_unlock(&orphanLock);
+
+        ssize_t res = free_orphan_batch(inum);
+
+        pthread_mutex_lock(&orphanLock);
+        if(res == -1)
+            fuse_log(FUSE_LOG_ERR, "%s : Could not free orphan inode %ld, its blocks are lost.\n", FREE_ORPHAN, inum);
+        if(res != 0)
+            remove_orphan_locked(inum);
+        altfs_journal_stop();
+    }
+    pthread_mutex_unlock(&orphanLock);
+    return NULL;
+}
+
+void start_orphan_worker()
+{
+    pthread_mutex_lock(&orphanLock);
+    if(!orphanWorkerRunning)
+    {
+        if(pthread_create(&orphanWorker, NULL, run_orphan_worker, NULL) != 0)
+            fuse_log(FUSE_LOG_ERR, "%s : Could not start the orphan thread.\n", FREE_ORPHAN);
+        else
+            orphanWorkerRunning = true;
+    }
+    if(orphanWorkerRunning && (altfs_superblock->s_orphans_count > 0 || altfs_superblock->s_orphan_chain != 0))
+        fuse_log(FUSE_LOG_DEBUG, "%s : Resuming %ld orphans%s.\n", FREE_ORPHAN, altfs_superblock->s_orphans_count,
+            altfs_superblock->s_orphan_chain != 0 ? " and a chain of more" : "");
+    pthread_mutex_unlock(&orphanLock);
+}
+
+void stop_orphan_worker()
+{
+    pthread_mutex_lock(&orphanLock);
+    bool running = orphanWorkerRunning;
+    orphanWorkerStop = true;
+    pthread_cond_signal(&orphanAdded);
+    pthread_mutex_unlock(&orphanLock);
+    if(running)
+        pthread_join(orphanWorker, NULL);
+
+    pthread_mutex_lock(&orphanLock);
+    orphanWorkerRunning = false;
+    orphanWorkerStop = false;
+    pthread_mutex_unlock(&orphanLock);
+}
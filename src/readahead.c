@@ -0,0 +1,80 @@
+#include "../header/disk_layer.h"
+#include "../header/inode_ops.h"
+#include "../header/readahead.h"
+
+static struct readahead_state readaheadStates[READAHEAD_SLOTS];
+
+static inline struct readahead_state* get_readahead_state(ssize_t inum)
+{
+    return &readaheadStates[(((uint64_t)inum * 0x9e3779b97f4a7c15ull) >> 32) % READAHEAD_SLOTS];
+}
+
+/*
+Queue logical blocks [from, to) of a file. Mapping them reads the indirect blocks on the way, which are
+queued as well: the reader maps every block through them again.
+
+@return The logical block the queued range ends at (to, or less if a block could not be mapped).
+*/
+static ssize_t queue_window(const struct inode* const node, ssize_t from, ssize_t to)
+{
+    ssize_t blocks[READAHEAD_MAX_BLOCKS + 8];
+    ssize_t count = 0;
+    if(from < DIRECT_PLUS_SINGLE_INDIRECT_ADDR && to > NUM_OF_DIRECT_BLOCKS)
+        blocks[count++] = node->i_single_indirect;
+    if(from < DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR && to > DIRECT_PLUS_SINGLE_INDIRECT_ADDR)
+        blocks[count++] = node->i_double_indirect;
+    if(to > DIRECT_PLUS_SINGLE_DOUBLE_INDIRECT_ADDR)
+        blocks[count++] = node->i_triple_indirect;
+
+    ssize_t prev_indirect_block = 0;
+    ssize_t block = from;
+    for(; block < to; block++)
+    {
+        ssize_t last_indirect_block = prev_indirect_block;
+        ssize_t dblock_num = get_disk_block_from_inode_block(node, block, &prev_indirect_block);
+        if(dblock_num <= 0)
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Could not map logical block %ld, read ahead stops there.\n", READAHEAD, block);
+            break;
+        }
+        if(prev_indirect_block != last_indirect_block)
+            blocks[count++] = prev_indirect_block;
+        blocks[count++] = dblock_num;
+    }
+    altfs_prefetch_blocks(blocks, count);
+    return block;
+}
+
+void readahead_after_read(const struct inode* const node, ssize_t inum, ssize_t first_block, ssize_t last_block)
+{
+    struct readahead_state* ra = get_readahead_state(inum);
+    if(ra->inum != inum)
+    {
+        memset(ra, 0, sizeof(struct readahead_state));
+        ra->inum = inum;
+    }
+
+    bool sequential = first_block == ra->next_block || first_block + 1 == ra->next_block;
+    ra->next_block = last_block + 1;
+    if(!sequential)
+    {
+        ra->window /= 2;
+        if(ra->window < READAHEAD_MIN_BLOCKS)
+            ra->window = 0;
+        ra->ahead_until = ra->next_block;
+        return;
+    }
+    if(ra->ahead_until < ra->next_block)
+        ra->ahead_until = ra->next_block;
+    if(ra->window > 0 && ra->ahead_until - ra->next_block > ra->window / 2)
+        return;
+
+    ra->window = ra->window == 0 ? READAHEAD_MIN_BLOCKS : ra->window * 2;
+    if(ra->window > READAHEAD_MAX_BLOCKS)
+        ra->window = READAHEAD_MAX_BLOCKS;
+    ssize_t end = ra->next_block + ra->window;
+    if(end > node->i_blocks_num)
+        end = node->i_blocks_num;
+    if(ra->ahead_until < end)
+        ra->ahead_until = queue_window(node, ra->ahead_until, end);
+}
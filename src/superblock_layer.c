@@ -1,25 +1,73 @@
 #include "../header/disk_layer.h"
 #include "../header/superblock_layer.h"
 
-/*
-Write the superblock (static) to the disk.
+static bool altfs_superblock_dirty = false;    // in-memory superblock differs from block 0
+static time_t altfs_superblock_written = 0;     // when block 0 was last written
+static pthread_mutex_t superblockLock = PTHREAD_MUTEX_INITIALIZER;   // guards the two above and the totals
+pthread_mutex_t groupLocks[MAX_ALLOCATION_GROUPS] = { [0 ... MAX_ALLOCATION_GROUPS - 1] = PTHREAD_MUTEX_INITIALIZER };
 
-@return true if success, false if failure.
-*/
 bool altfs_write_superblock()
 {
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, BLOCK_SIZE);
     memcpy(buffer, altfs_superblock, sizeof(struct superblock));
-    if(!altfs_write_block(0, buffer))
+    if(!altfs_journal_block(0, buffer))
     {
         fuse_log(FUSE_LOG_ERR, "%s : Error writing superblock to memory.\n", ALTFS_SUPERBLOCK);
         return false;
     }
-    fuse_log(FUSE_LOG_DEBUG, "%s : Superblock written!!!\n", ALTFS_SUPERBLOCK);
+    altfs_superblock_dirty = false;
+    altfs_superblock_written = time(NULL);
+    return true;
+}
+
+// Call with superblockLock held.
+static bool sync_superblock_locked()
+{
+    if(!altfs_superblock_dirty || altfs_superblock == NULL)
+        return true;
+    if(!altfs_write_superblock())
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Failed to write dirty superblock.\n", SYNC_SUPERBLOCK);
+        return false;
+    }
     return true;
 }
 
+// Call with superblockLock held.
+static void mark_superblock_dirty_locked()
+{
+    altfs_superblock_dirty = true;
+    // The freelist heads have to commit with the freelist blocks and inodes, which are logged right away.
+    if(altfs_journal_enabled() ||
+        (SUPERBLOCK_FLUSH_INTERVAL > 0 && time(NULL) - altfs_superblock_written >= SUPERBLOCK_FLUSH_INTERVAL))
+        sync_superblock_locked();
+}
+
+bool sync_superblock()
+{
+    pthread_mutex_lock(&superblockLock);
+    bool res = sync_superblock_locked();
+    pthread_mutex_unlock(&superblockLock);
+    return res;
+}
+
+void mark_superblock_dirty()
+{
+    pthread_mutex_lock(&superblockLock);
+    mark_superblock_dirty_locked();
+    pthread_mutex_unlock(&superblockLock);
+}
+
+void update_superblock_free_counts(ssize_t blocks, ssize_t inodes)
+{
+    pthread_mutex_lock(&superblockLock);
+    altfs_superblock->s_free_blocks_count += blocks;
+    altfs_superblock->s_free_inodes_count += inodes;
+    mark_superblock_dirty_locked();
+    pthread_mutex_unlock(&superblockLock);
+}
+
 /*
 Reads the first block of memory and assigns it to the static superblock object.
 
@@ -38,6 +86,13 @@ bool load_superblock()
     fuse_log(FUSE_LOG_DEBUG, "load_superblock : Loading superblock from memory...\n");
     #endif
 
+    // An interrupted commit may have left the superblock itself behind.
+    if(!altfs_replay_journal())
+    {
+        fuse_log(FUSE_LOG_ERR, "load_superblock : Could not recover the journal!!!\n");
+        return false;
+    }
+
     char sb_buffer[BLOCK_SIZE];
     memset(sb_buffer, 0, BLOCK_SIZE);
     altfs_read_block(0, sb_buffer);
@@ -50,7 +105,13 @@ bool load_superblock()
     }
 
     struct superblock* sb = (struct superblock*)sb_buffer;
-    ssize_t t1 = (BLOCK_SIZE) / sizeof(struct inode);
+    if(sb->s_layout_version != DISK_LAYOUT_VERSION || sb->s_inode_size != INODE_SIZE || sb->s_groups_count != NUM_OF_ALLOCATION_GROUPS)
+    {
+        fuse_log(FUSE_LOG_ERR, "load_superblock : Unsupported disk layout (version %ld, inode size %ld, %ld groups), expected version %ld, inode size %ld, %ld groups. Run mkfs again.\n",
+            sb->s_layout_version, sb->s_inode_size, sb->s_groups_count, DISK_LAYOUT_VERSION, INODE_SIZE, NUM_OF_ALLOCATION_GROUPS);
+        return false;
+    }
+    ssize_t t1 = (BLOCK_SIZE) / INODE_SIZE;
     ssize_t t2 = INODE_BLOCK_COUNT * t1;
     if(sb->s_num_of_inodes_per_block != t1 || sb->s_inodes_count != t2)
     {
@@ -63,6 +124,8 @@ bool load_superblock()
         altfs_superblock = (struct superblock*)malloc(sizeof(struct superblock));
     }
     memcpy(altfs_superblock, sb, sizeof(struct superblock));
+    altfs_superblock_dirty = false;
+    altfs_superblock_written = time(NULL);
     if(altfs_superblock->s_inodes_count == 0 || altfs_superblock->s_num_of_inodes_per_block == 0)
     {
         fuse_log(FUSE_LOG_ERR, "load_superblock : Superblock loaded incorrectly!\n");
@@ -75,14 +138,24 @@ bool load_superblock()
 // Initializes superblock and writes to physical block 0
 bool altfs_create_superblock()
 {
-    altfs_superblock = (struct superblock*)malloc(sizeof(struct superblock));
+    altfs_superblock = (struct superblock*)calloc(1, sizeof(struct superblock));
     // fd 0,1,2 = input, output, error => first ino will start from 3
     altfs_superblock->s_first_ino = 3;
-    //altfs_superblock->s_inode_size = sizeof(struct inode);
-    altfs_superblock->s_num_of_inodes_per_block = (BLOCK_SIZE) / sizeof(struct inode);
+    altfs_superblock->s_inode_size = INODE_SIZE;
+    altfs_superblock->s_layout_version = DISK_LAYOUT_VERSION;
+    altfs_superblock->s_num_of_inodes_per_block = (BLOCK_SIZE) / INODE_SIZE;
     altfs_superblock->s_inodes_count = INODE_BLOCK_COUNT * (altfs_superblock->s_num_of_inodes_per_block);
-    // first data block will be the head of free list
-    altfs_superblock->s_freelist_head = INODE_BLOCK_COUNT + 1;
+    // Every data block starts out on the freelist; the inodes before s_first_ino are reserved.
+    altfs_superblock->s_free_blocks_count = NUM_OF_DATA_BLOCKS;
+    altfs_superblock->s_free_inodes_count = altfs_superblock->s_inodes_count - altfs_superblock->s_first_ino;
+    // first data block of every group will be the head of its free list
+    altfs_superblock->s_groups_count = NUM_OF_ALLOCATION_GROUPS;
+    for(ssize_t group = 0; group < NUM_OF_ALLOCATION_GROUPS; group++)
+    {
+        ssize_t group_end = GROUP_END_BLOCK(group);
+        altfs_superblock->s_groups[group].g_freelist_head = GROUP_FIRST_BLOCK(group);
+        altfs_superblock->s_groups[group].g_free_blocks_count = group_end - GROUP_FIRST_BLOCK(group);
+    }
 
     fuse_log(FUSE_LOG_DEBUG, "%s : Writing superblock...\n", ALTFS_SUPERBLOCK);
     return altfs_write_superblock();
@@ -109,49 +182,42 @@ bool altfs_create_ilist()
 }
 
 
-bool altfs_create_freelist()
+/*
+Create the free list of one allocation group: a chain of blocks that each hold the number of the
+next block of the chain, followed by the numbers of the NUM_OF_ADDRESSES_PER_BLOCK - 1 blocks after it.
+*/
+static bool altfs_create_group_freelist(ssize_t group)
 {
-    // iterate over all blocks meant for free list 
-    // Initialize the addresses
-    ssize_t blocknum = altfs_superblock->s_freelist_head;
+    ssize_t group_end = GROUP_END_BLOCK(group);
     char buffer[BLOCK_SIZE];
-    ssize_t nullvalue = 0;
 
-    fuse_log(FUSE_LOG_DEBUG, "%s : Creating free list...\n", ALTFS_CREATE_FREELIST);
-    for(ssize_t i = 0; i < NUM_OF_FREE_LIST_BLOCKS; i++)
+    for(ssize_t currblocknum = GROUP_FIRST_BLOCK(group); currblocknum < group_end; currblocknum += NUM_OF_ADDRESSES_PER_BLOCK)
     {
-        ssize_t currblocknum = blocknum;
         // initialize block with zeroes
         memset(buffer, 0, BLOCK_SIZE);
-        ssize_t offset = 0;
-        // for each block, initialize addresses
-        // Starts from index 1 since first one witll have block address off next free list block
-        for(ssize_t j=1; j < NUM_OF_ADDRESSES_PER_BLOCK; j++)
-        {
-            offset += ADDRESS_SIZE; 
-            blocknum += 1;
-            // start writing at buffer + offset since first index will have address of next free block
-            // Copy address of the respective block into the buffer
-            if (blocknum >= BLOCK_COUNT)
-                memcpy(buffer+offset, &nullvalue, ADDRESS_SIZE);
-            else
-                memcpy(buffer+offset, &blocknum, ADDRESS_SIZE);
-        }
-        blocknum += 1;
-        if (blocknum >= BLOCK_COUNT)
-            memcpy(buffer, &nullvalue, ADDRESS_SIZE);
-        else
-            memcpy(buffer, &blocknum, ADDRESS_SIZE);
-        
-        if (!altfs_write_block(currblocknum, buffer))  
+        ssize_t* addresses = (ssize_t*)buffer;
+        // Starts from index 1 since first one will have block address of next free list block
+        for(ssize_t j = 1; j < NUM_OF_ADDRESSES_PER_BLOCK && currblocknum + j < group_end; j++)
+            addresses[j] = currblocknum + j;
+        if(currblocknum + NUM_OF_ADDRESSES_PER_BLOCK < group_end)
+            addresses[0] = currblocknum + NUM_OF_ADDRESSES_PER_BLOCK;
+
+        if (!altfs_write_block(currblocknum, buffer))
         {
-            fuse_log(FUSE_LOG_ERR, "%s : Error writing block number %d to free list\n", ALTFS_CREATE_FREELIST, currblocknum);
+            fuse_log(FUSE_LOG_ERR, "%s : Error writing block number %ld to free list\n", ALTFS_CREATE_FREELIST, currblocknum);
             return false;
         }
-        //fuse_log(FUSE_LOG_DEBUG, "%s Successfully wrote block number %ld with contents %s\n", ALTFS_CREATE_FREELIST, currblocknum, buffer);
-        // TODO: Check on below check
-        //if (blocknum >= BLOCK_COUNT)
-        //    break;
+    }
+    return true;
+}
+
+bool altfs_create_freelist()
+{
+    fuse_log(FUSE_LOG_DEBUG, "%s : Creating free list...\n", ALTFS_CREATE_FREELIST);
+    for(ssize_t group = 0; group < NUM_OF_ALLOCATION_GROUPS; group++)
+    {
+        if(!altfs_create_group_freelist(group))
+            return false;
     }
     return true;
 }
@@ -195,6 +261,13 @@ bool altfs_makefs_options(bool erase, bool format)
             return false;
         }
         fuse_log(FUSE_LOG_DEBUG, "%s : Successfully created free list\n", ALTFS_MAKEFS);
+
+        if(!altfs_format_journal())
+        {
+            fuse_log(FUSE_LOG_ERR, "%s : Error creating journal while initializing FS\n",ALTFS_MAKEFS);
+            return false;
+        }
+        fuse_log(FUSE_LOG_DEBUG, "%s : Successfully created journal\n", ALTFS_MAKEFS);
     }
 
     #ifdef DISK_MEMORY
@@ -206,7 +279,7 @@ bool altfs_makefs_options(bool erase, bool format)
 
 void teardown()
 {
-    if(!altfs_write_superblock())
+    if(!sync_superblock())
     {
         fuse_log(FUSE_LOG_ERR, "teardown : Failed to write superblock!\n");
     }
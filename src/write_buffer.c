@@ -0,0 +1,198 @@
+#include <errno.h>
+
+#include "../header/interface_layer.h"
+#include "../header/write_buffer.h"
+
+static struct write_buffer writeBuffers[WRITE_BUFFER_SLOTS];
+
+static inline struct write_buffer* get_write_buffer(ssize_t handle)
+{
+    if(handle <= 0 || handle > WRITE_BUFFER_SLOTS || !writeBuffers[handle - 1].in_use)
+        return NULL;
+    return &writeBuffers[handle - 1];
+}
+
+/*
+Write the buffered data out to the file.
+
+@return 0 if success, -errornum if failure (the data is dropped either way).
+*/
+static ssize_t write_out(struct write_buffer* wb)
+{
+    if(wb->length == 0)
+        return 0;
+    ssize_t written = altfs_write_inum(wb->inum, wb->data, wb->length, wb->offset);
+    ssize_t res = 0;
+    if(written != wb->length)
+    {
+        fuse_log(FUSE_LOG_ERR, "%s : Wrote %ld of %ld buffered bytes to inode %ld at offset %ld.\n",
+            FLUSH_WRITE_BUFFER, written, wb->length, wb->inum, wb->offset);
+        res = written < 0 ? written : -EIO;
+    }
+    wb->length = 0;
+    return res;
+}
+
+/*
+Write out a buffer on behalf of someone else than its handle: the error is kept for the handle.
+*/
+static bool write_out_for_handle(struct write_buffer* wb)
+{
+    ssize_t res = write_out(wb);
+    if(res != 0 && wb->error == 0)
+        wb->error = res;
+    return res == 0;
+}
+
+static void flush_expired_write_buffers(time_t now)
+{
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        struct write_buffer* wb = &writeBuffers[i];
+        if(wb->in_use && wb->length > 0 && now - wb->first_write >= WRITE_BUFFER_TIMEOUT)
+            write_out_for_handle(wb);
+    }
+}
+
+ssize_t open_write_buffer(ssize_t inum)
+{
+    flush_expired_write_buffers(time(NULL));
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        if(!writeBuffers[i].in_use)
+        {
+            memset(&writeBuffers[i], 0, sizeof(struct write_buffer));
+            writeBuffers[i].in_use = true;
+            writeBuffers[i].inum = inum;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+ssize_t buffered_write(ssize_t handle, const char* buff, size_t nbytes, off_t offset)
+{
+    struct write_buffer* wb = get_write_buffer(handle);
+    if(wb == NULL)
+        return -EBADF;
+    if(wb->inum == -1)
+        return -ENOENT;
+    time_t now = time(NULL);
+    flush_expired_write_buffers(now);
+
+    // A write that does not follow the buffered bytes goes after them.
+    if(wb->length > 0 && offset != wb->offset + wb->length)
+    {
+        ssize_t res = write_out(wb);
+        if(res != 0)
+            return res;
+    }
+    // Big writes gain nothing from the buffer.
+    if((ssize_t)nbytes >= WRITE_BUFFER_SIZE)
+    {
+        flush_file_write_buffers(wb->inum);
+        return altfs_write_inum(wb->inum, buff, nbytes, offset);
+    }
+    if(wb->data == NULL)
+    {
+        wb->data = (char*) malloc(WRITE_BUFFER_SIZE);
+        if(wb->data == NULL)
+            return altfs_write_inum(wb->inum, buff, nbytes, offset);
+    }
+
+    size_t copied = 0;
+    while(copied < nbytes)
+    {
+        if(wb->length == 0)
+        {
+            // Only one handle of a file holds data, so that buffers never overtake each other.
+            flush_file_write_buffers(wb->inum);
+            wb->offset = offset + copied;
+            wb->first_write = now;
+        }
+        // The buffer ends on a block boundary, so that it is written out as whole blocks.
+        ssize_t capacity = (wb->offset / BLOCK_SIZE) * BLOCK_SIZE + WRITE_BUFFER_SIZE - wb->offset;
+        ssize_t to_copy = nbytes - copied < (size_t)(capacity - wb->length) ? (ssize_t)(nbytes - copied) : capacity - wb->length;
+        memcpy(wb->data + wb->length, buff + copied, to_copy);
+        wb->length += to_copy;
+        copied += to_copy;
+        if(wb->length == capacity)
+        {
+            ssize_t res = write_out(wb);
+            if(res != 0)
+                return copied > to_copy ? (ssize_t)(copied - to_copy) : res;
+        }
+    }
+    return nbytes;
+}
+
+ssize_t flush_write_buffer(ssize_t handle)
+{
+    struct write_buffer* wb = get_write_buffer(handle);
+    if(wb == NULL)
+        return -EBADF;
+    ssize_t res = wb->inum == -1 ? 0 : write_out(wb);
+    if(res == 0)
+        res = wb->error;
+    wb->error = 0;
+    return res;
+}
+
+ssize_t close_write_buffer(ssize_t handle)
+{
+    struct write_buffer* wb = get_write_buffer(handle);
+    if(wb == NULL)
+        return -EBADF;
+    ssize_t res = flush_write_buffer(handle);
+    altfs_free_memory(wb->data);
+    memset(wb, 0, sizeof(struct write_buffer));
+    return res;
+}
+
+bool flush_file_write_buffers(ssize_t inum)
+{
+    bool res = true;
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        struct write_buffer* wb = &writeBuffers[i];
+        if(wb->in_use && wb->inum == inum && wb->length > 0 && !write_out_for_handle(wb))
+            res = false;
+    }
+    return res;
+}
+
+bool flush_all_write_buffers()
+{
+    bool res = true;
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        struct write_buffer* wb = &writeBuffers[i];
+        if(wb->in_use && wb->inum != -1 && wb->length > 0 && !write_out_for_handle(wb))
+            res = false;
+    }
+    return res;
+}
+
+void drop_file_write_buffers(ssize_t inum)
+{
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        struct write_buffer* wb = &writeBuffers[i];
+        if(wb->in_use && wb->inum == inum)
+        {
+            wb->inum = -1;
+            wb->length = 0;
+        }
+    }
+}
+
+ssize_t get_buffered_file_size(ssize_t inum, ssize_t file_size)
+{
+    for(ssize_t i = 0; i < WRITE_BUFFER_SLOTS; i++)
+    {
+        struct write_buffer* wb = &writeBuffers[i];
+        if(wb->in_use && wb->inum == inum && wb->length > 0 && wb->offset + wb->length > file_size)
+            return wb->offset + wb->length;
+    }
+    return file_size;
+}
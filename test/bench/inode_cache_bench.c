@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/inode_cache.c"
+
+#define INODE_CACHE_BENCH "inode_cache_bench"
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+Keys look like real paths: a few levels of lowercase directories with a numbered file at the end.
+*/
+static char** make_keys(ssize_t n, const char* prefix)
+{
+    char** keys = (char**)malloc(n * sizeof(char*));
+    char buf[128];
+    for(ssize_t i = 0; i < n; i++)
+    {
+        snprintf(buf, sizeof(buf), "/%s/dir_%ld/sub_%ld/file_%ld.txt", prefix, i % 97, i % 1013, i);
+        keys[i] = strdup(buf);
+    }
+    return keys;
+}
+
+static void free_keys(char** keys, ssize_t n)
+{
+    for(ssize_t i = 0; i < n; i++)
+        free(keys[i]);
+    free(keys);
+}
+
+/*
+name_i caches every directory on the way to a file before the file itself, so do the same here.
+*/
+static void cache_parents(struct inode_cache* cache, char** keys, ssize_t n)
+{
+    char buf[128];
+    for(ssize_t i = 0; i < n; i++)
+    {
+        size_t len = strlen(keys[i]);
+        for(size_t j = 1; j < len; j++)
+        {
+            if(keys[i][j] != '/')
+                continue;
+            memcpy(buf, keys[i], j);
+            buf[j] = '\0';
+            if(get_cache_entry(cache, buf) == -1)
+                set_cache_entry(cache, buf, 0);
+        }
+    }
+}
+
+static void run(ssize_t n)
+{
+    char** keys = make_keys(n, "data");
+    char** missing = make_keys(n, "nope");
+    // Room for the files and their parent directories.
+    struct inode_cache* cache = create_inode_cache(2 * n + 200000);
+    cache_parents(cache, keys, n);
+
+    double start = now_ns();
+    for(ssize_t i = 0; i < n; i++)
+        set_cache_entry(cache, keys[i], i + 1);
+    double insert_ns = (now_ns() - start) / n;
+
+    // Visit keys in a scattered order so the LRU list is reshuffled on every hit.
+    ssize_t hits = 0;
+    start = now_ns();
+    for(ssize_t i = 0; i < n; i++)
+        hits += (get_cache_entry(cache, keys[(i * 7919) % n]) > 0);
+    double hit_ns = (now_ns() - start) / n;
+
+    ssize_t misses = 0;
+    start = now_ns();
+    for(ssize_t i = 0; i < n; i++)
+        misses += (get_cache_entry(cache, missing[i]) == -1);
+    double miss_ns = (now_ns() - start) / n;
+
+    start = now_ns();
+    for(ssize_t i = 0; i < n; i++)
+        remove_cache_entry(cache, keys[i]);
+    double remove_ns = (now_ns() - start) / n;
+
+    printf("%s : n=%8ld buckets=%8ld | insert %7.1f ns | hit %7.1f ns | miss %7.1f ns | remove %7.1f ns | hits %ld misses %ld\n",
+        INODE_CACHE_BENCH, n, cache->num_buckets, insert_ns, hit_ns, miss_ns, remove_ns, hits, misses);
+
+    free_inode_cache(cache);
+    free_keys(keys, n);
+    free_keys(missing, n);
+}
+
+int main()
+{
+    run(10000);
+    run(100000);
+    run(1000000);
+    return 0;
+}
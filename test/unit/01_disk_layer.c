@@ -7,6 +7,12 @@
 #define SUCCESS "Success: "
 #define FAILED "Failed: "
 
+static void* start_operation(void* arg)
+{
+    altfs_journal_start();
+    return (void*) (intptr_t) altfs_journal_stop();
+}
+
 int main(int argc, char *argv[])
 {
     // Test1 : Allocate memory
@@ -102,6 +108,166 @@ int main(int argc, char *argv[])
     }
     printf("%s Test8: Write, read and data compare for all blocks passed\n",DISK_LAYER_TEST);
 
+    // Test9: Journaled blocks reach their home block on commit only
+    char* disk_buff = (char *)malloc(BLOCK_SIZE);
+    char *journalstr = "This is a journaled string.";
+    if (!altfs_format_journal() || !altfs_replay_journal())
+    {
+        printf("%s Test9: %s Failed to start the journal\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    memset(buff, 0, BLOCK_SIZE);
+    memcpy(buff, journalstr, strlen(journalstr));
+    altfs_journal_start();
+    if (!altfs_journal_block(20, buff) || !altfs_read_block(20, buff) || strcmp(buff, journalstr) != 0)
+    {
+        printf("%s Test9: %s Journaled block not read back\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    // A plain write to a journaled block goes into the transaction.
+    buff[0] = 't';
+    if (!altfs_write_block(20, buff) || !read_block_from_volume(20, disk_buff) || strcmp(disk_buff, teststr) != 0)
+    {
+        printf("%s Test9: %s Journaled block written home before the commit\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    if (!altfs_journal_stop() || journalCount != 1)
+    {
+        printf("%s Test9: %s Transaction committed before it was due\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    if (!altfs_journal_commit() || !read_block_from_volume(20, disk_buff) || strcmp(disk_buff, buff) != 0)
+    {
+        printf("%s Test9: %s Journaled block not written home by the commit\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    struct journal_header* header = (struct journal_header*) disk_buff;
+    if (!read_block_from_volume(JOURNAL_FIRST_BLOCK, disk_buff) || header->j_sequence != 1 || header->j_count != 0)
+    {
+        printf("%s Test9: %s Journal header not cleared after the commit\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    printf("%s Test9: %s Journaled block written home on commit\n",DISK_LAYER_TEST,SUCCESS);
+
+    // Test10: Replay a committed transaction left in the log, and drop one that was not fully logged
+    close_journal();
+    memset(disk_buff, 0, BLOCK_SIZE);
+    ((int64_t*) disk_buff)[0] = 21;
+    memset(buff, 0, BLOCK_SIZE);
+    memcpy(buff, journalstr, strlen(journalstr));
+    char* header_buff = (char *)calloc(1, BLOCK_SIZE);
+    header = (struct journal_header*) header_buff;
+    header->j_magic = JOURNAL_MAGIC;
+    header->j_sequence = 2;
+    header->j_count = 1;
+    header->j_checksum = journal_checksum(disk_buff, buff, 1) + 1;
+    if (!altfs_write_block(JOURNAL_FIRST_BLOCK + 1, disk_buff) || !altfs_write_block(JOURNAL_FIRST_LOG_BLOCK, buff) ||
+        !altfs_write_block(JOURNAL_FIRST_BLOCK, header_buff) || !altfs_replay_journal() ||
+        !altfs_read_block(21, buff) || strcmp(buff, teststr) != 0)
+    {
+        printf("%s Test10: %s Transaction with a bad checksum was replayed\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    close_journal();
+    memset(buff, 0, BLOCK_SIZE);
+    memcpy(buff, journalstr, strlen(journalstr));
+    header->j_checksum = journal_checksum(disk_buff, buff, 1);
+    if (!altfs_write_block(JOURNAL_FIRST_BLOCK, header_buff) || !altfs_replay_journal() ||
+        !altfs_read_block(21, buff) || strcmp(buff, journalstr) != 0 || journalSequence != 2)
+    {
+        printf("%s Test10: %s Committed transaction was not replayed\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    if (!read_block_from_volume(JOURNAL_FIRST_BLOCK, header_buff) || header->j_count != 0)
+    {
+        printf("%s Test10: %s Journal header not cleared after the replay\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    close_journal();
+    // The superblock is logged as block 0, next to a block that is not.
+    ((int64_t*) disk_buff)[0] = 22;
+    ((int64_t*) disk_buff)[1] = 0;
+    char* images = (char *)calloc(2, BLOCK_SIZE);
+    memcpy(images, journalstr, strlen(journalstr));
+    memcpy(images + BLOCK_SIZE, journalstr, strlen(journalstr));
+    images[BLOCK_SIZE] = 's';
+    header->j_sequence = 3;
+    header->j_count = 2;
+    header->j_checksum = journal_checksum(disk_buff, images, 2);
+    if (!altfs_write_block(JOURNAL_FIRST_BLOCK + 1, disk_buff) || !altfs_write_block(JOURNAL_FIRST_LOG_BLOCK, images) ||
+        !altfs_write_block(JOURNAL_FIRST_LOG_BLOCK + 1, images + BLOCK_SIZE) || !altfs_write_block(JOURNAL_FIRST_BLOCK, header_buff) ||
+        !altfs_replay_journal() || !read_block_from_volume(0, buff) || strcmp(buff, images + BLOCK_SIZE) != 0 ||
+        !read_block_from_volume(22, buff) || strcmp(buff, journalstr) != 0)
+    {
+        printf("%s Test10: %s Transaction logging the superblock was not replayed\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    close_journal();
+    // A transaction logging a block outside the file system writes none of its blocks home.
+    ((int64_t*) disk_buff)[0] = 23;
+    ((int64_t*) disk_buff)[1] = JOURNAL_FIRST_BLOCK;
+    header->j_sequence = 4;
+    header->j_checksum = journal_checksum(disk_buff, images, 2);
+    if (!altfs_write_block(JOURNAL_FIRST_BLOCK + 1, disk_buff) || !altfs_write_block(JOURNAL_FIRST_BLOCK, header_buff) ||
+        altfs_replay_journal() || !read_block_from_volume(23, buff) || strcmp(buff, teststr) != 0)
+    {
+        printf("%s Test10: %s Transaction with a bad block was partly replayed\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    free(images);
+    free(header_buff);
+    free(disk_buff);
+    printf("%s Test10: %s Replayed the committed transaction only\n",DISK_LAYER_TEST,SUCCESS);
+
+    // Test11: An operation that does not fit in the transaction waits for the running ones to end
+    if (!altfs_format_journal() || !altfs_replay_journal())
+    {
+        printf("%s Test11: %s Failed to start the journal\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    altfs_journal_start();
+    ssize_t fill = JOURNAL_MAX_BLOCKS - JOURNAL_OPERATION_BLOCKS;
+    for(ssize_t i = 0; i < fill; i++)
+    {
+        if (!altfs_journal_block(100 + i, buff))
+        {
+            printf("%s Test11: %s Failed to log block %ld\n",DISK_LAYER_TEST,FAILED,100 + i);
+            return -1;
+        }
+    }
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, start_operation, NULL);
+    usleep(100000);
+    if (journalHandles != 1 || !journalCommitWaiting || journalCount != fill)
+    {
+        printf("%s Test11: %s Operation started without room in the transaction\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    // The running operation still has its room.
+    for(ssize_t i = fill; i < JOURNAL_MAX_BLOCKS; i++)
+        altfs_journal_block(100 + i, buff);
+    if (journalCount != JOURNAL_MAX_BLOCKS || !altfs_journal_stop())
+    {
+        printf("%s Test11: %s Running operation did not get its room\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    void* stopped;
+    pthread_join(waiter, &stopped);
+    if (!stopped || journalHandles != 0 || journalCommitWaiting || journalCount != 0)
+    {
+        printf("%s Test11: %s Transaction not committed when its operations ended\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    altfs_journal_start();
+    altfs_journal_block(100, buff);
+    if (!altfs_journal_restart() || journalHandles != 1 || journalCount != 1 || !altfs_journal_stop())
+    {
+        printf("%s Test11: %s Restarted operation lost its place\n",DISK_LAYER_TEST,FAILED);
+        return -1;
+    }
+    close_journal();
+    printf("%s Test11: %s Operations are committed whole\n",DISK_LAYER_TEST,SUCCESS);
+
     /*bool altfs_dealloc = altfs_dealloc_memory();
     if (!altfs_dealloc)
     {
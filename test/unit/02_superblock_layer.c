@@ -38,7 +38,7 @@ int main(int argc, char *argv[])
     fprintf(stdout, "%s Test2: %s Printed superblock contents\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
 
     // Test3 : Verify freelist by printing first free block
-    int nextfreeblock = print_freelist(superblockObj->s_freelist_head);
+    int nextfreeblock = print_freelist(superblockObj->s_groups[0].g_freelist_head);
     fprintf(stdout, "%s Test3: %s Printed freelist contents\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
     
     // Test4 : Verify first 10 free blocks
@@ -49,6 +49,73 @@ int main(int argc, char *argv[])
     }
     fprintf(stdout, "%s Test4: %s Printed first 10 freelist block contents\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
 
+    // Test5 : Verify the disk layout is recorded, and a superblock with another layout is refused
+    if (superblockObj->s_inode_size != INODE_SIZE || superblockObj->s_layout_version != DISK_LAYOUT_VERSION ||
+        superblockObj->s_num_of_inodes_per_block != BLOCK_SIZE / INODE_SIZE)
+    {
+        fprintf(stderr, "%s Test5: %s Superblock has inode size %ld, layout version %ld\n", SUPERBLOCK_LAYER_TEST, FAILED, superblockObj->s_inode_size, superblockObj->s_layout_version);
+        return -1;
+    }
+    if (!load_superblock())
+    {
+        fprintf(stderr, "%s Test5: %s Could not load the superblock written by makefs\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    superblockObj->s_layout_version = DISK_LAYOUT_VERSION - 1;
+    if (!altfs_write_block(0, buffer) || load_superblock())
+    {
+        fprintf(stderr, "%s Test5: %s Superblock with an old disk layout was loaded\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    superblockObj->s_layout_version = DISK_LAYOUT_VERSION;
+    altfs_write_block(0, buffer);
+    fprintf(stdout, "%s Test5: %s Disk layout version checked on load\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
+
+    // Test6 : Verify superblock changes are kept in memory until synced (before the journal is started)
+    close_journal();
+    ssize_t freelist_head = altfs_superblock->s_groups[0].g_freelist_head;
+    altfs_superblock->s_groups[0].g_freelist_head = freelist_head + 1;
+    mark_superblock_dirty();
+    altfs_read_block(0, buffer);
+    if (superblockObj->s_groups[0].g_freelist_head != freelist_head)
+    {
+        fprintf(stderr, "%s Test6: %s Superblock written before sync\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    if (!sync_superblock() || !altfs_read_block(0, buffer) || superblockObj->s_groups[0].g_freelist_head != freelist_head + 1)
+    {
+        fprintf(stderr, "%s Test6: %s Superblock not written by sync\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    altfs_superblock->s_groups[0].g_freelist_head = freelist_head;
+    mark_superblock_dirty();
+    sync_superblock();
+    fprintf(stdout, "%s Test6: %s Superblock writes coalesced until sync\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
+
+    // Test7 : Verify superblock changes are logged right away once the journal is started
+    if (!altfs_replay_journal())
+    {
+        fprintf(stderr, "%s Test7: %s Could not start the journal\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    altfs_superblock->s_groups[0].g_freelist_head = freelist_head + 1;
+    mark_superblock_dirty();
+    if (!altfs_read_block(0, buffer) || superblockObj->s_groups[0].g_freelist_head != freelist_head + 1 ||
+        !read_block_from_volume(0, buffer) || superblockObj->s_groups[0].g_freelist_head != freelist_head)
+    {
+        fprintf(stderr, "%s Test7: %s Superblock change not logged in the running transaction\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    if (!altfs_journal_commit() || !read_block_from_volume(0, buffer) || superblockObj->s_groups[0].g_freelist_head != freelist_head + 1)
+    {
+        fprintf(stderr, "%s Test7: %s Superblock change not written home by the commit\n", SUPERBLOCK_LAYER_TEST, FAILED);
+        return -1;
+    }
+    altfs_superblock->s_groups[0].g_freelist_head = freelist_head;
+    mark_superblock_dirty();
+    altfs_journal_commit();
+    fprintf(stdout, "%s Test7: %s Superblock changes logged with the journal\n",SUPERBLOCK_LAYER_TEST, SUCCESS);
+
     printf("\n========== RUNNING TESTS COMPLETE ==========\n\n");
     return 0;
 }
\ No newline at end of file
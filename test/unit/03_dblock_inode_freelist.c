@@ -26,6 +26,7 @@ int test_verify_freelist_allocation()
     // verify correct free list update
     for(ssize_t i = 0; i < NUM_OF_ADDRESSES_PER_BLOCK + 10; i++)
     {
+        sync_superblock();
         if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
@@ -33,7 +34,7 @@ int test_verify_freelist_allocation()
         }
         sb = (struct superblock*)sb_buf;
 
-        fprintf(stdout, "\n%s : Iteration: %ld Free list head: %ld\n", DBLOCK_INODE_FREELIST_TEST,i, sb->s_freelist_head);
+        fprintf(stdout, "\n%s : Iteration: %ld Free list head: %ld\n", DBLOCK_INODE_FREELIST_TEST,i, sb->s_groups[0].g_freelist_head);
         
         // Allocate new data block
         ssize_t block_num = allocate_data_block();
@@ -48,16 +49,17 @@ int test_verify_freelist_allocation()
         if (i == NUM_OF_ADDRESSES_PER_BLOCK - 1 ||
             i == NUM_OF_ADDRESSES_PER_BLOCK ||
             i == NUM_OF_ADDRESSES_PER_BLOCK + 10 - 1)
-            print_freelist(sb->s_freelist_head);
+            print_freelist(sb->s_groups[0].g_freelist_head);
     }
     // print free list after allocating 512+10 blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
 
     for(int i = 0; i < NUM_OF_ADDRESSES_PER_BLOCK + 10; i++)
     {
@@ -70,13 +72,14 @@ int test_verify_freelist_allocation()
     }
 
     // print free list after freeing 512+10 blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
 
 
     free(sb_buf);
@@ -95,13 +98,14 @@ int test_data_block_ops()
     char *sb_buf = (char*)malloc(BLOCK_SIZE);
     struct superblock* sb;
 
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
     
     ssize_t blocks_to_free[10];
 
@@ -125,13 +129,14 @@ int test_data_block_ops()
     fprintf(stdout, "\n******************* END: VERIFY FREELIST AFTER ALLOCATING 10 BLOCKS *********************\n");
 
     // print free list after allocating 10 blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
     fprintf(stdout, "%s: Number of free blocks left: %llu\n",DBLOCK_INODE_FREELIST_TEST, get_num_of_free_blocks());
 
     // free first 5 data blocks allocated
@@ -149,6 +154,7 @@ int test_data_block_ops()
     fprintf(stdout, "\n******************* END: VERIFY FREELIST AFTER FREEING 5 BLOCKS *********************\n");
 
     // print free list after freeing 5 blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
@@ -156,7 +162,7 @@ int test_data_block_ops()
         }
     sb = (struct superblock*)sb_buf;
     fprintf(stdout, "%s: Number of free blocks left: %llu\n",DBLOCK_INODE_FREELIST_TEST, get_num_of_free_blocks());
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
 
     // allocate 5 more blocks
     fprintf(stdout, "\n******************* START: VERIFY FREELIST AFTER ALLOCATING 5 MORE BLOCKS *********************\n");
@@ -176,13 +182,14 @@ int test_data_block_ops()
     fprintf(stdout, "\n******************* END: VERIFY FREELIST AFTER ALLOCATING 5 MORE BLOCKS *********************\n");
 
     // print free list after allocating 5 more blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
 
     // free all 10 data blocks allocated
     fprintf(stdout, "\n******************* START: VERIFY FREELIST AFTER FREEING 10 BLOCKS *********************\n");
@@ -199,19 +206,104 @@ int test_data_block_ops()
     fprintf(stdout, "\n******************* END: VERIFY FREELIST AFTER FREEING 10 BLOCKS *********************\n");
 
     // print free list after freeing 10 blocks
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
         {
             fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DBLOCK_INODE_FREELIST_TEST);
             return -1;
         }
     sb = (struct superblock*)sb_buf;
-    print_freelist(sb->s_freelist_head);
+    print_freelist(sb->s_groups[0].g_freelist_head);
 
     free(sb_buf);
     fprintf(stdout, "%s : Freelist consistency verified.\n", DBLOCK_INODE_FREELIST_TEST);
     return 0;
 }
 
+// Blocks are allocated after a goal, and a file's window is left alone by other files
+int test_allocation_goal()
+{
+    fprintf(stdout, "\n******************* START: TESTING ALLOCATION GOALS AND RESERVATIONS *********************\n");
+    ssize_t file_a = 100, file_b = 200;
+
+    // Two files writing one block at a time do not interleave
+    ssize_t a1 = allocate_data_block_near(0, file_a);
+    ssize_t b1 = allocate_data_block_near(0, file_b);
+    ssize_t a2 = allocate_data_block_near(a1 + 1, file_a);
+    ssize_t b2 = allocate_data_block_near(b1 + 1, file_b);
+    fprintf(stdout, "%s : File A got %ld, %ld; file B got %ld, %ld.\n", DBLOCK_INODE_FREELIST_TEST, a1, a2, b1, b2);
+    if(a1 <= 0 || b1 <= 0 || a2 != a1 + 1 || b2 != b1 + 1)
+    {
+        fprintf(stderr, "%s : Blocks of a file are not consecutive.\n", DBLOCK_INODE_FREELIST_TEST);
+        return -1;
+    }
+    if(b1 > a1 && b1 <= a1 + BLOCK_RESERVATION_WINDOW)
+    {
+        fprintf(stderr, "%s : Block %ld was taken from the window of file A.\n", DBLOCK_INODE_FREELIST_TEST, b1);
+        return -1;
+    }
+
+    // Without an owner, the window is only skipped, not kept
+    release_block_reservation(file_a);
+    ssize_t c1 = allocate_data_block();
+    if(c1 != a2 + 1)
+    {
+        fprintf(stderr, "%s : Released window not reused: got %ld, expected %ld.\n", DBLOCK_INODE_FREELIST_TEST, c1, a2 + 1);
+        return -1;
+    }
+    release_block_reservation(file_b);
+
+    ssize_t to_free[] = { a1, a2, b1, b2, c1 };
+    for(int i = 0; i < 5; i++)
+    {
+        if(!free_data_block(to_free[i]))
+        {
+            fprintf(stderr, "%s : Error while free-ing data block %ld.\n", DBLOCK_INODE_FREELIST_TEST, to_free[i]);
+            return -1;
+        }
+    }
+    fprintf(stdout, "\n******************* END: TESTING ALLOCATION GOALS AND RESERVATIONS *********************\n");
+    return 0;
+}
+
+// Many blocks freed at once end up on the freelists of their groups, as if freed one by one
+int test_free_data_blocks()
+{
+    fprintf(stdout, "\n******************* START: TESTING BATCHED FREEING *********************\n");
+    ssize_t count = ALLOCATION_GROUP_BLOCKS + 100;   // more than a group holds
+    ssize_t* blocks = (ssize_t*) malloc((count + 1) * sizeof(ssize_t));
+    ssize_t free_blocks = altfs_superblock->s_free_blocks_count;
+    for(ssize_t i = 0; i < count; i++)
+    {
+        blocks[i] = allocate_data_block();
+        if(blocks[i] <= 0)
+        {
+            fprintf(stderr, "%s : Failed to allocate data block %ld.\n", DBLOCK_INODE_FREELIST_TEST, i);
+            return -1;
+        }
+    }
+    // Out of order, and with an invalid block number, which is skipped
+    for(ssize_t i = 0; i < count / 2; i += 2)
+    {
+        ssize_t temp = blocks[i];
+        blocks[i] = blocks[count - 1 - i];
+        blocks[count - 1 - i] = temp;
+    }
+    blocks[count] = 0;
+    bool res = free_data_blocks(blocks, count + 1);
+    altfs_free_memory(blocks);
+    ssize_t counted = count_free_data_blocks(false);
+    fprintf(stdout, "%s : Free blocks: %ld (was %ld), counted on the freelists: %ld.\n", DBLOCK_INODE_FREELIST_TEST,
+        altfs_superblock->s_free_blocks_count, free_blocks, counted);
+    if(res || altfs_superblock->s_free_blocks_count != free_blocks || counted != free_blocks)
+    {
+        fprintf(stderr, "%s : Batched freeing lost blocks or accepted an invalid one.\n", DBLOCK_INODE_FREELIST_TEST);
+        return -1;
+    }
+    fprintf(stdout, "\n******************* END: TESTING BATCHED FREEING *********************\n");
+    return 0;
+}
+
 int main()
 {
      printf("=============== TESTING DATA BLOCK & INODE OPERATIONS =============\n\n");
@@ -224,18 +316,34 @@ int main()
     }
     #endif
 
-    // Test 1 - Test data block ops
+    // Test 1 - Test allocation goals, on the freelist as made by makefs
+    if (test_allocation_goal() == -1)
+    {
+        fprintf(stderr, "%s : Test1 - testing for allocation goals failed\n", DBLOCK_INODE_FREELIST_TEST);
+        teardown();
+        return -1;
+    }
+
+    // Test 2 - Test data block ops
     if (test_data_block_ops() == -1)
     {
-        fprintf(stderr, "%s : Test1 - testing for data block ops failed\n", DBLOCK_INODE_FREELIST_TEST);
+        fprintf(stderr, "%s : Test2 - testing for data block ops failed\n", DBLOCK_INODE_FREELIST_TEST);
         teardown();
         return -1;
     }
     
-    // Test 2 - Test free list update after allocating > 512 blocks
+    // Test 3 - Test free list update after allocating > 512 blocks
     if (test_verify_freelist_allocation() == -1)
     {
-        fprintf(stderr, "%s : Test2 - testing for free list updation failed\n", DBLOCK_INODE_FREELIST_TEST);
+        fprintf(stderr, "%s : Test3 - testing for free list updation failed\n", DBLOCK_INODE_FREELIST_TEST);
+        teardown();
+        return -1;
+    }
+
+    // Test 4 - Test freeing many blocks at once
+    if (test_free_data_blocks() == -1)
+    {
+        fprintf(stderr, "%s : Test4 - testing for batched freeing failed\n", DBLOCK_INODE_FREELIST_TEST);
         teardown();
         return -1;
     }
@@ -67,17 +67,18 @@ int main()
 
     // Check freelist consistency
     char *sb_buf = (char*)malloc(BLOCK_SIZE);
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
     {
         fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DATABLOCK_LAYER_TEST);
         return -1;
     }
     struct superblock* sb = (struct superblock*)sb_buf;
-    if(sb->s_freelist_head != INODE_BLOCK_COUNT + 1 + NUM_OF_ADDRESSES_PER_BLOCK)
+    if(sb->s_groups[0].g_freelist_head != INODE_BLOCK_COUNT + 1 + NUM_OF_ADDRESSES_PER_BLOCK)
     {
         fprintf(stderr, "%s : Freelist head inconsistent after CRUDS.\n", DATABLOCK_LAYER_TEST);
         fprintf(stderr, "%s : Freelist head: %ld | Should be: %ld.\n", DATABLOCK_LAYER_TEST,
-            sb->s_freelist_head, (INODE_BLOCK_COUNT + 1 + NUM_OF_ADDRESSES_PER_BLOCK));
+            sb->s_groups[0].g_freelist_head, (INODE_BLOCK_COUNT + 1 + NUM_OF_ADDRESSES_PER_BLOCK));
         return -1;
     }
     fprintf(stdout, "%s : Freelist consistent!.\n", DATABLOCK_LAYER_TEST);
@@ -91,17 +92,18 @@ int main()
     }
     fprintf(stdout, "%s : Free operation verified.\n", DATABLOCK_LAYER_TEST);
     // Check freelist consistency
+    sync_superblock();
     if (!altfs_read_block(0, sb_buf))
     {
         fprintf(stderr, "%s : Failed to read block 0 for superblock\n", DATABLOCK_LAYER_TEST);
         return -1;
     }
     sb = (struct superblock*)sb_buf;
-    if(sb->s_freelist_head != INODE_BLOCK_COUNT + 1)
+    if(sb->s_groups[0].g_freelist_head != INODE_BLOCK_COUNT + 1)
     {
         fprintf(stderr, "%s : Freelist head inconsistent after free_data_block.\n", DATABLOCK_LAYER_TEST);
         fprintf(stderr, "%s : Freelist head: %ld | Should be: %ld.\n", DATABLOCK_LAYER_TEST,
-            sb->s_freelist_head, (INODE_BLOCK_COUNT + 1));
+            sb->s_groups[0].g_freelist_head, (INODE_BLOCK_COUNT + 1));
         return -1;
     }
     fprintf(stdout, "%s : Freelist consistent!.\n", DATABLOCK_LAYER_TEST);
@@ -253,6 +255,7 @@ int main()
     altfs_free_memory(read_node);
 
     // Free a smaller value inode
+    ssize_t freed_inum = inum;
     inum = 4;
     fprintf(stdout, "%s : Freeing the inode %ld.\n", DATABLOCK_LAYER_TEST, inum);
     if(!free_inode(inum))
@@ -263,6 +266,24 @@ int main()
 
     fprintf(stdout, "%s : Free inode verified.\n\n", DATABLOCK_LAYER_TEST);
 
+    // Freed inodes are handed out again lowest first, without a scan of the inode blocks.
+    ssize_t first_reused = allocate_inode();
+    ssize_t second_reused = allocate_inode();
+    if(first_reused != freed_inum || second_reused != 4)
+    {
+        fprintf(stderr, "%s : Freed inodes not reused: got %ld and %ld, expected %ld and 4.\n", DATABLOCK_LAYER_TEST, first_reused, second_reused, freed_inum);
+        return -1;
+    }
+    struct inode* reused_node = get_inode(first_reused);
+    if(!reused_node->i_allocated)
+    {
+        fprintf(stderr, "%s : Reused inode %ld not marked allocated on disk.\n", DATABLOCK_LAYER_TEST, first_reused);
+        altfs_free_memory(reused_node);
+        return -1;
+    }
+    altfs_free_memory(reused_node);
+    fprintf(stdout, "%s : Inode reuse verified.\n\n", DATABLOCK_LAYER_TEST);
+
     printf("=============== ALL TESTS RUN ================\n\n");
     teardown();
     return 0;
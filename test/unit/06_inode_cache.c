@@ -64,5 +64,79 @@ int main()
     
     fprintf(stdout, "%s : Successfully tested adding null entries to cache\n", TEST_INODE_CACHE);
 
+    // Lowercase keys that differ only in the last characters must not collide into one bucket,
+    // and the table must grow past its initial bucket count.
+    ssize_t num_keys = 20000;
+    inodeCache = create_inode_cache(num_keys);
+    char key[64];
+    for(ssize_t i = 0; i < num_keys; i++)
+    {
+        snprintf(key, sizeof(key), "/home/user/project/src/file_%ld.c", i);
+        set_cache_entry(inodeCache, key, i + 1);
+    }
+    assert(inodeCache->size == num_keys);
+    assert(inodeCache->num_buckets > CACHE_MIN_BUCKETS);
+    assert(inodeCache->size * CACHE_MAX_LOAD_DEN <= inodeCache->num_buckets * CACHE_MAX_LOAD_NUM);
+    for(ssize_t i = 0; i < num_keys; i++)
+    {
+        snprintf(key, sizeof(key), "/home/user/project/src/file_%ld.c", i);
+        assert(get_cache_entry(inodeCache, key) == i + 1);
+    }
+
+    // Removing one entry must not drop others sharing its bucket.
+    assert(remove_cache_entry(inodeCache, "/home/user/project/src/file_7.c"));
+    assert(get_cache_entry(inodeCache, "/home/user/project/src/file_7.c") == -1);
+    for(ssize_t i = 0; i < num_keys; i++)
+    {
+        if(i == 7)
+            continue;
+        snprintf(key, sizeof(key), "/home/user/project/src/file_%ld.c", i);
+        assert(get_cache_entry(inodeCache, key) == i + 1);
+    }
+    free_inode_cache(inodeCache);
+
+    fprintf(stdout, "%s : Successfully verified chaining and resizing\n", TEST_INODE_CACHE);
+
+    // Removing a directory drops every cached path beneath it, but not siblings sharing a name prefix.
+    inodeCache = create_inode_cache(100);
+    set_cache_entry(inodeCache, "/a", 1);
+    set_cache_entry(inodeCache, "/a/b", 2);
+    set_cache_entry(inodeCache, "/a/b/c", 3);
+    set_cache_entry(inodeCache, "/a/bc", 4);
+    assert(remove_cache_entry(inodeCache, "/a/b"));
+    assert(get_cache_entry(inodeCache, "/a/b") == -1);
+    assert(get_cache_entry(inodeCache, "/a/b/c") == -1);
+    assert(get_cache_entry(inodeCache, "/a/bc") == 4);
+    assert(get_cache_entry(inodeCache, "/a") == 1);
+    assert(inodeCache->size == 2);
+
+    // Paths cached before their parent are still found.
+    set_cache_entry(inodeCache, "/p/q/r", 5);
+    set_cache_entry(inodeCache, "/p", 6);
+    assert(inodeCache->num_orphans == 1);
+    assert(remove_cache_entry(inodeCache, "/p"));
+    assert(get_cache_entry(inodeCache, "/p/q/r") == -1);
+    assert(inodeCache->num_orphans == 0);
+    assert(!remove_cache_entry(inodeCache, "/p"));
+    free_inode_cache(inodeCache);
+
+    // A recently used child keeps its parent from being evicted.
+    inodeCache = create_inode_cache(3);
+    set_cache_entry(inodeCache, "/d", 1);
+    set_cache_entry(inodeCache, "/d/x", 2);
+    set_cache_entry(inodeCache, "/e", 3);
+    assert(get_cache_entry(inodeCache, "/d/x") == 2);
+    set_cache_entry(inodeCache, "/f", 4);
+    assert(get_cache_entry(inodeCache, "/e") == -1);
+    assert(get_cache_entry(inodeCache, "/d") == 1);
+    assert(get_cache_entry(inodeCache, "/d/x") == 2);
+    free_inode_cache(inodeCache);
+
+    fprintf(stdout, "%s : Successfully verified subtree invalidation\n", TEST_INODE_CACHE);
+
+    // Path hashes are built one component at a time
+    assert(path_hash("/a/bc", 5) == path_hash_component(path_hash("/a", 2), "bc", 2));
+    assert(path_hash("/a/bc", 5) != path_hash("/ab/c", 5));
+
     return 0;
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include "../../src/data_block_ops.c"
 #include "../../src/inode_data_block_ops.c"
 #include "../../src/inode_cache.c"
+#include "../../src/directory_cache.c"
 #include "../../src/directory_ops.c"
 
 #include "test_helpers.c"
@@ -22,7 +23,7 @@ bool test_add_directory_entry()
     struct inode* node = get_inode(inum1);
     node->i_mode = S_IFDIR;
     char* dir_name = "directory1";
-    if(!add_directory_entry(&node, 123, dir_name))
+    if(!add_directory_entry(&node, 123, S_IFDIR, dir_name))
     {
         fprintf(stderr, "%s : Failed to add directory entry: %s\n", FILESYSTEM_OPS_TEST, dir_name);
         altfs_free_memory(node);
@@ -38,10 +39,10 @@ bool test_add_directory_entry()
     // fill till populate next block
     printf("%s : Adding many directory entries...\n", FILESYSTEM_OPS_TEST);
     char name[50];
-    for(int i = 0; i < 149; i++)
+    for(int i = 0; i < 135; i++)
     {
         snprintf(name, sizeof(name), "this_is_an_excruciatingly_long_directory_%d", i);
-        if(!add_directory_entry(&node, i, name))
+        if(!add_directory_entry(&node, i, S_IFDIR, name))
         {
             fprintf(stderr, "%s : Failed to add directory entry: %s\n", FILESYSTEM_OPS_TEST, dir_name);
             altfs_free_memory(node);
@@ -79,7 +80,7 @@ bool test_add_directory_entry()
 
     // try adding another entry
     dir_name = "directory_hahaha";
-    if(!add_directory_entry(&node, 123, dir_name))
+    if(!add_directory_entry(&node, 123, S_IFDIR, dir_name))
     {
         fprintf(stderr, "%s : Failed to add directory entry: %s\n", FILESYSTEM_OPS_TEST, dir_name);
         altfs_free_memory(node);
@@ -107,11 +108,11 @@ bool test_get_file_position()
     struct inode* node = get_inode(inum1);
     node->i_mode = S_IFDIR;
     char* dir_name = "directory1";
-    add_directory_entry(&node, 111, dir_name);
+    add_directory_entry(&node, 111, S_IFDIR, dir_name);
     dir_name = "directory2";
-    add_directory_entry(&node, 222, dir_name);
+    add_directory_entry(&node, 222, S_IFDIR, dir_name);
     dir_name = "directory3";
-    add_directory_entry(&node, 333, dir_name);
+    add_directory_entry(&node, 333, S_IFDIR, dir_name);
     write_inode(inum1, node);
 
     struct fileposition fp = get_file_position_in_dir("directory2", node);
@@ -121,7 +122,7 @@ bool test_get_file_position()
         altfs_free_memory(node);
         return false;
     }
-    if(fp.offset != 21)
+    if(fp.offset != 24)
     {
         fprintf(stderr, "%s : Incorrect offset for file %s: %ld\n", FILESYSTEM_OPS_TEST, "directory2", fp.offset);
         altfs_free_memory(fp.p_block);
@@ -135,6 +136,13 @@ bool test_get_file_position()
         altfs_free_memory(node);
         return false;
     }
+    if(((unsigned short*)(fp.p_block + fp.offset + RECORD_TAG_OFFSET))[0] != get_name_tag("directory2", 10))
+    {
+        fprintf(stderr, "%s : Incorrect name tag for file %s\n", FILESYSTEM_OPS_TEST, "directory2");
+        altfs_free_memory(fp.p_block);
+        altfs_free_memory(node);
+        return false;
+    }
     altfs_free_memory(fp.p_block);
 
     // Negative test
@@ -154,6 +162,203 @@ bool test_get_file_position()
     return true;
 }
 
+bool test_reuse_directory_space()
+{
+    printf("\n%s : Testing reuse of freed directory space...\n", FILESYSTEM_OPS_TEST);
+    ssize_t inum1 = allocate_inode();
+    struct inode* node = get_inode(inum1);
+    node->i_mode = S_IFDIR;
+    char name[50];
+    for(int i = 0; i < 300; i++)
+    {
+        snprintf(name, sizeof(name), "a_fairly_long_file_name_%d", i);
+        if(!add_directory_entry(&node, i + 1, S_IFREG, name))
+        {
+            fprintf(stderr, "%s : Failed to add directory entry: %s\n", FILESYSTEM_OPS_TEST, name);
+            altfs_free_memory(node);
+            return false;
+        }
+    }
+    ssize_t num_blocks = node->i_blocks_num;
+    if(num_blocks < 3)
+    {
+        fprintf(stderr, "%s : Expected at least 3 blocks, got %ld\n", FILESYSTEM_OPS_TEST, num_blocks);
+        altfs_free_memory(node);
+        return false;
+    }
+
+    // Removed records are only marked deleted, and their space in the first block must be used
+    // before a new block is allocated.
+    for(int i = 0; i < 40; i++)
+    {
+        snprintf(name, sizeof(name), "a_fairly_long_file_name_%d", i);
+        if(!remove_directory_entry(&node, name))
+        {
+            fprintf(stderr, "%s : Failed to remove directory entry: %s\n", FILESYSTEM_OPS_TEST, name);
+            altfs_free_memory(node);
+            return false;
+        }
+        struct fileposition removed = get_file_position_in_dir(name, node);
+        altfs_free_memory(removed.p_block);
+        if(removed.offset != -1)
+        {
+            fprintf(stderr, "%s : Removed entry still found: %s\n", FILESYSTEM_OPS_TEST, name);
+            altfs_free_memory(node);
+            return false;
+        }
+    }
+    // The free space table rebuilt from the blocks must see the deleted records too.
+    dir_cache_invalidate(node);
+    if(!add_directory_entry(&node, 1000, S_IFREG, "a_fairly_long_file_name_x"))
+    {
+        fprintf(stderr, "%s : Failed to add directory entry.\n", FILESYSTEM_OPS_TEST);
+        altfs_free_memory(node);
+        return false;
+    }
+    struct fileposition fp = get_file_position_in_dir("a_fairly_long_file_name_x", node);
+    altfs_free_memory(fp.p_block);
+    if(node->i_blocks_num != num_blocks || fp.l_block_num != 0)
+    {
+        fprintf(stderr, "%s : Entry added in block %ld of %ld, expected block 0 of %ld\n", FILESYSTEM_OPS_TEST, fp.l_block_num, node->i_blocks_num, num_blocks);
+        altfs_free_memory(node);
+        return false;
+    }
+
+    // Emptying the last block frees it.
+    for(int i = 40; i < 300; i++)
+    {
+        snprintf(name, sizeof(name), "a_fairly_long_file_name_%d", i);
+        if(!remove_directory_entry(&node, name))
+        {
+            fprintf(stderr, "%s : Failed to remove directory entry: %s\n", FILESYSTEM_OPS_TEST, name);
+            altfs_free_memory(node);
+            return false;
+        }
+    }
+    if(node->i_blocks_num != 1 || node->i_file_size != BLOCK_SIZE)
+    {
+        fprintf(stderr, "%s : Directory should have shrunk to 1 block, has %ld\n", FILESYSTEM_OPS_TEST, node->i_blocks_num);
+        altfs_free_memory(node);
+        return false;
+    }
+    fp = get_file_position_in_dir("a_fairly_long_file_name_x", node);
+    altfs_free_memory(fp.p_block);
+    if(fp.offset == -1)
+    {
+        fprintf(stderr, "%s : Entry lost while shrinking directory\n", FILESYSTEM_OPS_TEST);
+        altfs_free_memory(node);
+        return false;
+    }
+
+    printf("\n%s : Ran all tests for reuse of freed directory space!!!\n", FILESYSTEM_OPS_TEST);
+    free_inode(inum1);
+    altfs_free_memory(node);
+    return true;
+}
+
+bool test_directory_filter()
+{
+    printf("\n%s : Testing directory name filter...\n", FILESYSTEM_OPS_TEST);
+    ssize_t inum1 = allocate_inode();
+    struct inode* node = get_inode(inum1);
+    node->i_mode = S_IFDIR;
+    char name[50];
+    for(int i = 0; i < 200; i++)
+    {
+        snprintf(name, sizeof(name), "present_%d", i);
+        add_directory_entry(&node, i + 1, S_IFREG, name);
+    }
+
+    // Every name added must pass the filter, whether it was updated in place or rebuilt from disk.
+    for(int pass = 0; pass < 2; pass++)
+    {
+        ssize_t false_positives = 0;
+        for(int i = 0; i < 200; i++)
+        {
+            snprintf(name, sizeof(name), "present_%d", i);
+            if(!dir_cache_may_contain(node, name, strlen(name)))
+            {
+                fprintf(stderr, "%s : Filter rejected existing entry %s\n", FILESYSTEM_OPS_TEST, name);
+                altfs_free_memory(node);
+                return false;
+            }
+            snprintf(name, sizeof(name), "absent_%d", i);
+            if(dir_cache_may_contain(node, name, strlen(name)))
+                false_positives++;
+        }
+        printf("%s : %ld of 200 absent names passed the filter\n", FILESYSTEM_OPS_TEST, false_positives);
+        if(false_positives > 20)
+        {
+            fprintf(stderr, "%s : Filter lets through too many absent names\n", FILESYSTEM_OPS_TEST);
+            altfs_free_memory(node);
+            return false;
+        }
+        flush_dir_cache();
+    }
+
+    // A name given to a record in place is found.
+    struct fileposition fp = get_file_position_in_dir("present_7", node);
+    if(fp.offset == -1 || !rename_directory_entry_in_place(node, &fp, "renamed_7"))
+    {
+        fprintf(stderr, "%s : Failed to rename entry present_7\n", FILESYSTEM_OPS_TEST);
+        altfs_free_memory(fp.p_block);
+        altfs_free_memory(node);
+        return false;
+    }
+    altfs_free_memory(fp.p_block);
+    fp = get_file_position_in_dir("renamed_7", node);
+    altfs_free_memory(fp.p_block);
+    if(fp.offset == -1)
+    {
+        fprintf(stderr, "%s : Renamed entry not found\n", FILESYSTEM_OPS_TEST);
+        altfs_free_memory(node);
+        return false;
+    }
+
+    printf("\n%s : Ran all tests for directory name filter!!!\n", FILESYSTEM_OPS_TEST);
+    free_inode(inum1);
+    altfs_free_memory(node);
+    return true;
+}
+
+bool test_directory_cache_sets()
+{
+    printf("\n%s : Testing directory cache replacement...\n", FILESYSTEM_OPS_TEST);
+    flush_dir_cache();
+
+    // Directories whose first blocks fall in the same set; the first one is looked up all along.
+    ssize_t keys[DIR_CACHE_WAYS + 1];
+    ssize_t found = 0;
+    for(ssize_t key = 1; found <= DIR_CACHE_WAYS; key++)
+    {
+        if(get_dir_cache_set(key) == get_dir_cache_set(1))
+            keys[found++] = key;
+    }
+    struct inode dir;
+    memset(&dir, 0, sizeof(struct inode));
+    dir.i_mode = S_IFDIR;
+    dir.i_blocks_num = 1;
+    for(ssize_t i = 0; i <= DIR_CACHE_WAYS; i++)
+    {
+        dir.i_direct_blocks[0] = keys[i];
+        dir_cache_update_space(&dir, 0, BLOCK_SIZE);
+        if(find_dir_cache_entry(keys[0]) == NULL)
+        {
+            fprintf(stderr, "%s : Directory in use was dropped for directory %ld of its set\n", FILESYSTEM_OPS_TEST, i);
+            return false;
+        }
+    }
+    if(find_dir_cache_entry(keys[1]) != NULL || find_dir_cache_entry(keys[DIR_CACHE_WAYS]) == NULL)
+    {
+        fprintf(stderr, "%s : The least recently used directory was not the one replaced\n", FILESYSTEM_OPS_TEST);
+        return false;
+    }
+    flush_dir_cache();
+
+    printf("\n%s : Ran all tests for directory cache replacement!!!\n", FILESYSTEM_OPS_TEST);
+    return true;
+}
+
 bool test_setup_filesystem()
 {
     printf("\n%s : Testing filesystem initialization...\n", FILESYSTEM_OPS_TEST);
@@ -206,21 +411,21 @@ bool test_name_i()
     */
     struct inode* root_dir = get_inode(ROOT_INODE_NUM);
     ssize_t inum1 = allocate_inode();
-    add_directory_entry(&root_dir, inum1, "dir1");
+    add_directory_entry(&root_dir, inum1, S_IFDIR, "dir1");
     write_inode(ROOT_INODE_NUM, root_dir);
 
     struct inode* dir1 = get_inode(inum1);
     dir1->i_mode = S_IFDIR | DEFAULT_PERMISSIONS;
     ssize_t inum2 = allocate_inode();
-    add_directory_entry(&dir1, inum2, "dir2");
+    add_directory_entry(&dir1, inum2, S_IFDIR, "dir2");
     ssize_t inum3 = allocate_inode();
-    add_directory_entry(&dir1, inum3, "file1");
+    add_directory_entry(&dir1, inum3, S_IFREG, "file1");
     write_inode(inum1, dir1);
 
     struct inode* dir2 = get_inode(inum2);
     dir2->i_mode = S_IFDIR | DEFAULT_PERMISSIONS;
     ssize_t inum4 = allocate_inode();
-    add_directory_entry(&dir2, inum4, "file2");
+    add_directory_entry(&dir2, inum4, S_IFREG, "file2");
     write_inode(inum2, dir2);
 
     // printf("---- root contents ----\n");
@@ -276,6 +481,24 @@ bool test_name_i()
         return false;
     }
 
+    // Repeated and trailing '/' name the same file
+    path = "/dir1//dir2/file2/";
+    if(name_i(path) != inum4)
+    {
+        fprintf(stderr, "%s : Wrong inum reported for path: %s\n", FILESYSTEM_OPS_TEST, path);
+        return false;
+    }
+
+    // Resolved from the cached ancestor /dir1/dir2
+    flush_inode_cache(true);
+    name_i("/dir1/dir2");
+    path = "/dir1/dir2/file2";
+    if(name_i(path) != inum4 || get_cache_entry(inodeCache, path) != inum4)
+    {
+        fprintf(stderr, "%s : Wrong inum reported for path: %s\n", FILESYSTEM_OPS_TEST, path);
+        return false;
+    }
+
     printf("\n%s : Ran all tests for namei!!!\n", FILESYSTEM_OPS_TEST);
     return true;
 }
@@ -305,6 +528,24 @@ int main()
         return -1;
     }
 
+    if(!test_reuse_directory_space())
+    {
+        printf("%s : Testing reuse of directory space failed!\n", FILESYSTEM_OPS_TEST);
+        return -1;
+    }
+
+    if(!test_directory_filter())
+    {
+        printf("%s : Testing directory name filter failed!\n", FILESYSTEM_OPS_TEST);
+        return -1;
+    }
+
+    if(!test_directory_cache_sets())
+    {
+        printf("%s : Testing directory cache replacement failed!\n", FILESYSTEM_OPS_TEST);
+        return -1;
+    }
+
     if(!test_setup_filesystem())
     {
         printf("%s : Testing filesystem initialization failed!\n", FILESYSTEM_OPS_TEST);
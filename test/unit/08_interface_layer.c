@@ -10,9 +10,14 @@
 #include "../../src/inode_ops.c"
 #include "../../src/data_block_ops.c"
 #include "../../src/inode_data_block_ops.c"
+#include "../../src/delayed_alloc.c"
+#include "../../src/readahead.c"
+#include "../../src/orphan_list.c"
 #include "../../src/inode_cache.c"
+#include "../../src/directory_cache.c"
 #include "../../src/directory_ops.c"
 #include "../../src/interface_layer.c"
+#include "../../src/write_buffer.c"
 
 #include "test_helpers.c"
 
@@ -23,13 +28,13 @@ bool test_getattr()
     printf("\n########## %s : Testing getattr() ##########\n", INTERFACE_LAYER_TEST);
     ssize_t dir_inum = allocate_inode();
     struct inode* root = get_inode(ROOT_INODE_NUM);
-    add_directory_entry(&root, dir_inum, "dir1");
+    add_directory_entry(&root, dir_inum, S_IFDIR, "dir1");
     write_inode(ROOT_INODE_NUM, root);
 
     ssize_t file_inum = allocate_inode();
     struct inode* dir1 = get_inode(dir_inum);
     dir1->i_mode = S_IFDIR | DEFAULT_PERMISSIONS;
-    add_directory_entry(&dir1, file_inum, "file1");
+    add_directory_entry(&dir1, file_inum, S_IFREG, "file1");
     write_inode(dir_inum, dir1);
 
     struct inode* file1 = get_inode(file_inum);
@@ -176,15 +181,15 @@ bool test_mkdir()
 
     ssize_t dir2_inum = name_i("/dir2");
     struct inode* dir2 = get_inode(dir2_inum);
-    if(dir2->i_blocks_num != 1)
+    if(dir2->i_blocks_num != 0 || !(dir2->i_flags & INODE_FLAG_INLINE_DATA) || dir2->i_file_size != INODE_INLINE_DATA_SIZE)
     {
-        fprintf(stderr, "%s : Incorrect number of blocks in directory /dir2: %ld\n", INTERFACE_LAYER_TEST, dir2->i_blocks_num);
+        fprintf(stderr, "%s : Directory /dir2 not stored inline, has %ld blocks\n", INTERFACE_LAYER_TEST, dir2->i_blocks_num);
         altfs_free_memory(dir2);
         return false;
     }
     if(dir2->i_child_num != 2)
     {
-        fprintf(stderr, "%s : Incorrect number of children in directory /dir2: %ld\n", INTERFACE_LAYER_TEST, dir2->i_child_num);
+        fprintf(stderr, "%s : Incorrect number of children in directory /dir2: %u\n", INTERFACE_LAYER_TEST, dir2->i_child_num);
         altfs_free_memory(dir2);
         return false;
     }
@@ -193,7 +198,7 @@ bool test_mkdir()
     struct inode* root = get_inode(ROOT_INODE_NUM);
     if(root->i_child_num != 4)
     {
-        fprintf(stderr, "%s : Incorrect number of children in parent directory /: %ld\n", INTERFACE_LAYER_TEST, root->i_child_num);
+        fprintf(stderr, "%s : Incorrect number of children in parent directory /: %u\n", INTERFACE_LAYER_TEST, root->i_child_num);
         altfs_free_memory(dir2);
         altfs_free_memory(root);
         return false;
@@ -243,8 +248,51 @@ bool test_mkdir()
         return false;
     }
     altfs_free_memory(fp.p_block);
-
     altfs_free_memory(dir2);
+    printf("\n");
+
+    // Records move to a data block once they no longer fit in the inode
+    printf("TEST 6\n");
+    if(!altfs_mkdir("/dir4", DEFAULT_PERMISSIONS))
+    {
+        fprintf(stderr, "%s : Failed to create directory /dir4.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    ssize_t dir4_inum = name_i("/dir4");
+    char path[32];
+    for(int i = 0; i < 8; i++)
+    {
+        snprintf(path, sizeof(path), "/dir4/file_%d", i);
+        if(!altfs_mknod(path, S_IFREG | DEFAULT_PERMISSIONS, 0))
+        {
+            fprintf(stderr, "%s : Failed to create %s.\n", INTERFACE_LAYER_TEST, path);
+            return false;
+        }
+    }
+    struct inode* dir4 = get_inode(dir4_inum);
+    if(dir4->i_blocks_num != 1 || (dir4->i_flags & INODE_FLAG_INLINE_DATA) || dir4->i_child_num != 10)
+    {
+        fprintf(stderr, "%s : Directory /dir4 did not move to a data block: %ld blocks, %u children\n", INTERFACE_LAYER_TEST, dir4->i_blocks_num, dir4->i_child_num);
+        altfs_free_memory(dir4);
+        return false;
+    }
+    altfs_free_memory(dir4);
+    flush_inode_cache(true);
+    for(int i = 0; i < 8; i++)
+    {
+        snprintf(path, sizeof(path), "/dir4/file_%d", i);
+        if(name_i(path) == -1 || altfs_unlink(path) != 0)
+        {
+            fprintf(stderr, "%s : Lost or failed to remove %s.\n", INTERFACE_LAYER_TEST, path);
+            return false;
+        }
+    }
+    if(altfs_unlink("/dir4") != 0)
+    {
+        fprintf(stderr, "%s : Failed to remove /dir4.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+
     printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
     return true;
 }
@@ -373,7 +421,7 @@ bool test_write()
 
     ssize_t inum = name_i("/dir2/file3");
 
-    // Will add new data blocks
+    // Small writes are stored in the inode
     printf("TEST 2\n");
     if(altfs_write("/dir2/file3", data, 12, 0) != 12)
     {
@@ -381,25 +429,22 @@ bool test_write()
         return false;
     }
     struct inode* file = get_inode(inum);
-    if(file->i_blocks_num != 1 || file->i_file_size != 12)
+    if(file->i_blocks_num != 0 || file->i_file_size != 12 || !(file->i_flags & INODE_FLAG_INLINE_DATA))
     {
         fprintf(stderr, "%s : File size for /dir2/file3 not correct. n_blocks: %ld, size (bytes): %ld\n", INTERFACE_LAYER_TEST, file->i_blocks_num, file->i_file_size);
         altfs_free_memory(file);
         return false;
     }
-    char* buff = read_data_block(file->i_direct_blocks[0]);
-    if(strncmp(data, buff, 12) != 0)
+    if(strncmp(data, file->i_inline_data, 12) != 0)
     {
-        fprintf(stderr, "%s : Incorrect data written in /dir2/file3. Should be: |%s|, was: |%s|\n", INTERFACE_LAYER_TEST, data, buff);
+        fprintf(stderr, "%s : Incorrect data written in /dir2/file3. Should be: |%s|, was: |%.12s|\n", INTERFACE_LAYER_TEST, data, file->i_inline_data);
         altfs_free_memory(file);
-        altfs_free_memory(buff);
         return false;
     }
     altfs_free_memory(file);
-    altfs_free_memory(buff);
     printf("\n");
 
-    // Will write in the same datablock again (add)
+    // Will write in the inode again (add)
     printf("TEST 3\n");
     if(altfs_write("/dir2/file3", data, 12, 12) != 12)
     {
@@ -407,38 +452,45 @@ bool test_write()
         return false;
     }
     file = get_inode(inum);
-    if(file->i_blocks_num != 1 || file->i_file_size != 24)
+    if(file->i_blocks_num != 0 || file->i_file_size != 24 || !(file->i_flags & INODE_FLAG_INLINE_DATA))
     {
         fprintf(stderr, "%s : File size for /dir2/file3 not correct. n_blocks: %ld, size (bytes): %ld\n", INTERFACE_LAYER_TEST, file->i_blocks_num, file->i_file_size);
         altfs_free_memory(file);
         return false;
     }
-    buff = read_data_block(file->i_direct_blocks[0]);
-    if(strncmp("Hello world!Hello world!", buff, 24) != 0)
+    if(strncmp("Hello world!Hello world!", file->i_inline_data, 24) != 0)
     {
-        fprintf(stderr, "%s : Incorrect data written in /dir2/file3. Should be: |Hello world!Hello world!|, was: |%s|\n", INTERFACE_LAYER_TEST, buff);
+        fprintf(stderr, "%s : Incorrect data written in /dir2/file3. Should be: |Hello world!Hello world!|, was: |%.24s|\n", INTERFACE_LAYER_TEST, file->i_inline_data);
         altfs_free_memory(file);
-        altfs_free_memory(buff);
         return false;
     }
     altfs_free_memory(file);
-    altfs_free_memory(buff);
     printf("\n");
 
-    // Will write in the next datablock (add)
+    // Will move the inline data to a datablock and write in the next datablock (add)
     printf("TEST 4\n");
     if(altfs_write("/dir2/file3", data, 12, 4096) != 12)
     {
         fprintf(stderr, "%s : Did not write full string to /dir2/file3.\n", INTERFACE_LAYER_TEST);
         return false;
     }
+    flush_delayed_blocks(inum, NULL);
     file = get_inode(inum);
-    if(file->i_blocks_num != 2 || file->i_file_size != 4108)
+    if(file->i_blocks_num != 2 || file->i_file_size != 4108 || (file->i_flags & INODE_FLAG_INLINE_DATA))
     {
         fprintf(stderr, "%s : File size for /dir2/file3 not correct. n_blocks: %ld, size (bytes): %ld\n", INTERFACE_LAYER_TEST, file->i_blocks_num, file->i_file_size);
         altfs_free_memory(file);
         return false;
     }
+    char* buff = read_data_block(file->i_direct_blocks[0]);
+    if(strncmp("Hello world!Hello world!", buff, 24) != 0)
+    {
+        fprintf(stderr, "%s : Inline data not moved to block 0 of /dir2/file3. Was: |%.24s|\n", INTERFACE_LAYER_TEST, buff);
+        altfs_free_memory(file);
+        altfs_free_memory(buff);
+        return false;
+    }
+    altfs_free_memory(buff);
     buff = read_data_block(file->i_direct_blocks[1]);
     if(strncmp(data, buff, 12) != 0)
     {
@@ -458,6 +510,7 @@ bool test_write()
         fprintf(stderr, "%s : Did not write full string to /dir2/file3.\n", INTERFACE_LAYER_TEST);
         return false;
     }
+    flush_delayed_blocks(inum, NULL);
     file = get_inode(inum);
     if(file->i_blocks_num != 3 || file->i_file_size != 8202)
     {
@@ -495,6 +548,7 @@ bool test_write()
         fprintf(stderr, "%s : Did not write full string to /dir2/file3.\n", INTERFACE_LAYER_TEST);
         return false;
     }
+    flush_delayed_blocks(inum, NULL);
     file = get_inode(inum);
     if(file->i_blocks_num != 3 || file->i_file_size != 8202)
     {
@@ -539,6 +593,7 @@ bool test_write()
         fprintf(stderr, "%s : Did not write full string to /dir2/file3.\n", INTERFACE_LAYER_TEST);
         return false;
     }
+    flush_delayed_blocks(inum, NULL);
     file = get_inode(inum);
     if(file->i_blocks_num != 6 || file->i_file_size != 20485)
     {
@@ -782,6 +837,63 @@ bool test_truncate()
         fprintf(stderr, "%s : Did not fail truncate on readonly file /dir2/file2.\n", INTERFACE_LAYER_TEST);
         return false;
     }
+
+    // A file short enough to fit in its inode goes back there
+    printf("TEST 6\n");
+    char big_data[200];
+    memset(big_data, 'b', 200);
+    inum = altfs_open("/dir2/file5", O_CREAT|O_RDWR);
+    if(inum < ROOT_INODE_NUM || altfs_write("/dir2/file5", big_data, 200, 0) != 200)
+    {
+        fprintf(stderr, "%s : Failed to write 200 bytes to /dir2/file5.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    if(altfs_truncate("/dir2/file5", 50) != 0)
+    {
+        fprintf(stderr, "%s : Truncate /dir2/file5 failed.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    node2 = get_inode(inum);
+    if(node2->i_file_size != 50 || node2->i_blocks_num != 0 || !(node2->i_flags & INODE_FLAG_INLINE_DATA))
+    {
+        fprintf(stderr, "%s : /dir2/file5 not stored inline. Found: %ld bytes, %ld blocks.\n", INTERFACE_LAYER_TEST, node2->i_file_size, node2->i_blocks_num);
+        altfs_free_memory(node2);
+        return false;
+    }
+    altfs_free_memory(node2);
+    char read_buff[50];
+    if(altfs_read("/dir2/file5", read_buff, 50, 0) != 50 || strncmp(big_data, read_buff, 50) != 0)
+    {
+        fprintf(stderr, "%s : Incorrect data in /dir2/file5 after truncate. Found: |%.50s|.\n", INTERFACE_LAYER_TEST, read_buff);
+        return false;
+    }
+    altfs_unlink("/dir2/file5");
+
+    // A long tail is freed in several journal operations
+    printf("TEST 7\n");
+    ssize_t file_size = (3 * OPERATION_BATCH_BLOCKS + 10) * BLOCK_SIZE;
+    char* data = (char*) calloc(1, file_size);
+    ssize_t free_blocks = altfs_superblock->s_free_blocks_count;
+    inum = altfs_open("/dir2/file6", O_CREAT|O_RDWR);
+    altfs_journal_start();
+    if(inum < ROOT_INODE_NUM || altfs_write("/dir2/file6", data, file_size, 0) != file_size ||
+        altfs_truncate("/dir2/file6", BLOCK_SIZE + 1) != 0 || journalHandles != 1)
+    {
+        fprintf(stderr, "%s : Failed to write and truncate /dir2/file6.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    altfs_journal_stop();
+    altfs_free_memory(data);
+    node2 = get_inode(inum);
+    if(node2->i_file_size != BLOCK_SIZE + 1 || node2->i_blocks_num != 2 || altfs_superblock->s_free_blocks_count != free_blocks - 2)
+    {
+        fprintf(stderr, "%s : /dir2/file6 not truncated. Found: %ld bytes, %ld blocks, %ld free blocks (was %ld).\n", INTERFACE_LAYER_TEST,
+            node2->i_file_size, node2->i_blocks_num, altfs_superblock->s_free_blocks_count, free_blocks);
+        altfs_free_memory(node2);
+        return false;
+    }
+    altfs_free_memory(node2);
+    altfs_unlink("/dir2/file6");
     
     printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
     return true;
@@ -857,7 +969,7 @@ bool test_unlink()
     struct inode* dir = get_inode(dir_inum);
     if(dir->i_child_num != 3)
     {
-        fprintf(stderr, "%s : Child count for /dir3 is not 3: %ld.\n", INTERFACE_LAYER_TEST, dir->i_child_num );
+        fprintf(stderr, "%s : Child count for /dir3 is not 3: %u.\n", INTERFACE_LAYER_TEST, dir->i_child_num );
         altfs_free_memory(dir);
         return false;
     }
@@ -882,7 +994,7 @@ bool test_unlink()
     dir = get_inode(dir_inum);
     if(dir->i_child_num != 2)
     {
-        fprintf(stderr, "%s : Child count for /dir3 is not 2: %ld.\n", INTERFACE_LAYER_TEST, dir->i_child_num );
+        fprintf(stderr, "%s : Child count for /dir3 is not 2: %u.\n", INTERFACE_LAYER_TEST, dir->i_child_num );
         altfs_free_memory(dir);
         return false;
     }
@@ -907,7 +1019,7 @@ bool test_unlink()
     struct inode* root = get_inode(ROOT_INODE_NUM);
     if(root->i_child_num != 4)
     {
-        fprintf(stderr, "%s : Child count for / is not 4: %ld.\n", INTERFACE_LAYER_TEST, root->i_child_num );
+        fprintf(stderr, "%s : Child count for / is not 4: %u.\n", INTERFACE_LAYER_TEST, root->i_child_num );
         altfs_free_memory(root);
         return false;
     }
@@ -940,7 +1052,6 @@ bool test_unlink()
     return true;
 }
 
-// TODO: Fix flaky tests.
 bool test_rename()
 {
     printf("\n########## %s : Testing rename() ##########\n", INTERFACE_LAYER_TEST);
@@ -1044,11 +1155,725 @@ bool test_rename()
         fprintf(stderr, "%s : Wrong inums fetched for /dir2/dir3/file1: %ld (should be -1), or /dir2/dir1/file1: %ld (should not be -1).\n", INTERFACE_LAYER_TEST, inum1, inum2);
         return false;
     }
+    printf("\n");
+
+    // Shorter names are written in place, longer ones move to a new record
+    printf("TEST 5\n");
+    if(altfs_rename("/dir2/dir1/file1", "/dir2/dir1/f") != 0 || name_i("/dir2/dir1/f") != inum2 || name_i("/dir2/dir1/file1") != -1)
+    {
+        fprintf(stderr, "%s : Failed to rename /dir2/dir1/file1 to /dir2/dir1/f.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    if(altfs_rename("/dir2/dir1/f", "/dir2/dir1/a_much_longer_name") != 0 || name_i("/dir2/dir1/a_much_longer_name") != inum2 || name_i("/dir2/dir1/f") != -1)
+    {
+        fprintf(stderr, "%s : Failed to rename /dir2/dir1/f to /dir2/dir1/a_much_longer_name.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    printf("\n");
+
+    // Renaming onto an existing file replaces it
+    printf("TEST 6\n");
+    inum1 = name_i("/dir2/file1");
+    if(altfs_rename("/dir2/dir1/a_much_longer_name", "/dir2/file1") != 0)
+    {
+        fprintf(stderr, "%s : Failed to rename /dir2/dir1/a_much_longer_name over /dir2/file1.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    if(name_i("/dir2/file1") != inum2 || name_i("/dir2/dir1/a_much_longer_name") != -1)
+    {
+        fprintf(stderr, "%s : /dir2/file1 should now be inode %ld.\n", INTERFACE_LAYER_TEST, inum2);
+        return false;
+    }
+    node = get_inode(inum1);
+    if(node->i_allocated)
+    {
+        fprintf(stderr, "%s : The replaced inode %ld should have been freed.\n", INTERFACE_LAYER_TEST, inum1);
+        altfs_free_memory(node);
+        return false;
+    }
+    altfs_free_memory(node);
     
     printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
     return true;
 }
 
+struct readdir_entries {
+    ssize_t count;
+    ssize_t limit;  // entries accepted before reporting a full buffer
+    char names[64][MAX_FILE_NAME_LENGTH + 1];
+    struct stat st[64];
+    off_t offs[64];
+};
+
+static int collect_entry(void* buff, const char* name, const struct stat* st, off_t off, enum fuse_fill_dir_flags flags)
+{
+    struct readdir_entries* entries = (struct readdir_entries*) buff;
+    if(entries->count == entries->limit)
+        return 1;
+    strcpy(entries->names[entries->count], name);
+    entries->st[entries->count] = *st;
+    entries->offs[entries->count] = off;
+    entries->count++;
+    return 0;
+}
+
+bool test_readdir()
+{
+    printf("\n########## %s : Testing readdir() ##########\n", INTERFACE_LAYER_TEST);
+
+    // Plain readdir takes the type from the directory record, readdirplus from the inode
+    printf("TEST 1\n");
+    static struct readdir_entries plain, plus;
+    memset(&plain, 0, sizeof(plain));
+    memset(&plus, 0, sizeof(plus));
+    plain.limit = plus.limit = 64;
+    if(altfs_readdir("/dir2", &plain, collect_entry, 0, 0) != 0 || altfs_readdir("/dir2", &plus, collect_entry, 0, FUSE_READDIR_PLUS) != 0)
+    {
+        fprintf(stderr, "%s : Failed to read directory /dir2.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    if(plain.count < 3 || plain.count != plus.count)
+    {
+        fprintf(stderr, "%s : Wrong number of entries in /dir2: %ld and %ld.\n", INTERFACE_LAYER_TEST, plain.count, plus.count);
+        return false;
+    }
+    for(ssize_t i = 0; i < plain.count; i++)
+    {
+        struct inode* node = get_inode(plain.st[i].st_ino);
+        bool ok = strcmp(plain.names[i], plus.names[i]) == 0 && plain.st[i].st_ino == plus.st[i].st_ino &&
+            (plain.st[i].st_mode & S_IFMT) == (node->i_mode & S_IFMT) && plus.st[i].st_mode == node->i_mode &&
+            plus.st[i].st_size == node->i_file_size;
+        altfs_free_memory(node);
+        if(!ok)
+        {
+            fprintf(stderr, "%s : Wrong attributes for entry %s.\n", INTERFACE_LAYER_TEST, plain.names[i]);
+            return false;
+        }
+    }
+    printf("\n");
+
+    // Reading one entry at a time, resuming from the last offset, gives the same listing
+    printf("TEST 2\n");
+    static struct readdir_entries one;
+    off_t offset = 0;
+    for(ssize_t i = 0; i < plain.count; i++)
+    {
+        memset(&one, 0, sizeof(one));
+        one.limit = 1;
+        if(altfs_readdir("/dir2", &one, collect_entry, offset, 0) != 0 || one.count != 1 ||
+            strcmp(one.names[0], plain.names[i]) != 0 || one.offs[0] != plain.offs[i])
+        {
+            fprintf(stderr, "%s : Resuming at offset %ld did not return entry %s.\n", INTERFACE_LAYER_TEST, offset, plain.names[i]);
+            return false;
+        }
+        offset = one.offs[0];
+    }
+    memset(&one, 0, sizeof(one));
+    one.limit = 1;
+    if(altfs_readdir("/dir2", &one, collect_entry, offset, 0) != 0 || one.count != 0)
+    {
+        fprintf(stderr, "%s : Entries returned past the end of /dir2.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    printf("\n");
+
+    // Unlinking the entries returned so far does not make a resumed read skip any of the others
+    printf("TEST 3\n");
+    if(!altfs_mkdir("/d", DEFAULT_PERMISSIONS))
+    {
+        fprintf(stderr, "%s : Failed to create /d.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    char path[MAX_FILE_NAME_LENGTH + 4];    // "/d/" and a name
+    bool returned[60] = { false };
+    for(ssize_t i = 0; i < 60; i++)
+    {
+        snprintf(path, sizeof(path), "/d/readdir_unlink_file_%018ld", i);   // 40 character names
+        if(!altfs_mknod(path, S_IFREG | 0775, -1))
+        {
+            fprintf(stderr, "%s : Failed to create %s.\n", INTERFACE_LAYER_TEST, path);
+            return false;
+        }
+    }
+    static struct readdir_entries batch;
+    offset = 0;
+    ssize_t total = 0;
+    do
+    {
+        memset(&batch, 0, sizeof(batch));
+        batch.limit = 10;
+        if(altfs_readdir("/d", &batch, collect_entry, offset, 0) != 0)
+        {
+            fprintf(stderr, "%s : Failed to read /d at offset %ld.\n", INTERFACE_LAYER_TEST, offset);
+            return false;
+        }
+        for(ssize_t i = 0; i < batch.count; i++)
+        {
+            if(strcmp(batch.names[i], ".") == 0 || strcmp(batch.names[i], "..") == 0)
+                continue;
+            ssize_t num = atol(batch.names[i] + strlen("readdir_unlink_file_"));
+            snprintf(path, sizeof(path), "/d/%s", batch.names[i]);
+            if(num < 0 || num >= 60 || returned[num] || altfs_unlink(path) != 0)
+            {
+                fprintf(stderr, "%s : Unexpected entry %s.\n", INTERFACE_LAYER_TEST, batch.names[i]);
+                return false;
+            }
+            returned[num] = true;
+            total++;
+        }
+        if(batch.count > 0)
+            offset = batch.offs[batch.count - 1];
+    } while(batch.count > 0);
+    memset(&batch, 0, sizeof(batch));
+    batch.limit = 10;
+    if(total != 60 || altfs_readdir("/d", &batch, collect_entry, 0, 0) != 0 || batch.count != 2)
+    {
+        fprintf(stderr, "%s : Returned %ld of 60 entries, %ld left in /d.\n", INTERFACE_LAYER_TEST, total, batch.count - 2);
+        return false;
+    }
+    altfs_unlink("/d");
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_statfs()
+{
+    printf("\n########## %s : Testing statfs() ##########\n", INTERFACE_LAYER_TEST);
+
+    // The free block counter agrees with a walk of the freelist
+    printf("TEST 1\n");
+    struct statvfs before;
+    if(altfs_statfs(&before) != 0 || before.f_blocks != NUM_OF_DATA_BLOCKS || before.f_files != altfs_superblock->s_inodes_count)
+    {
+        fprintf(stderr, "%s : statfs failed or reported a wrong size.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    ssize_t free_blocks = count_free_data_blocks(false);
+    if(before.f_bfree != free_blocks)
+    {
+        fprintf(stderr, "%s : statfs reports %ld free blocks, the freelist has %ld.\n", INTERFACE_LAYER_TEST, before.f_bfree, free_blocks);
+        return false;
+    }
+    printf("\n");
+
+    // Creating and removing a file moves both counters, and back
+    printf("TEST 2\n");
+    char* buf = (char*) malloc(3 * BLOCK_SIZE);
+    memset(buf, 's', 3 * BLOCK_SIZE);
+    bool created = altfs_mknod("/statfs_file", S_IFREG | 0775, -1);
+    ssize_t written = altfs_write("/statfs_file", buf, 3 * BLOCK_SIZE, 0);
+    altfs_free_memory(buf);
+    // statfs does not flush: the blocks held for the delayed write are counted as used.
+    struct statvfs during;
+    if(!created || written != 3 * BLOCK_SIZE || altfs_statfs(&during) != 0 ||
+        during.f_ffree != before.f_ffree - 1 || during.f_bfree != before.f_bfree - 3 - DELAYED_ALLOC_METADATA_BLOCKS)
+    {
+        fprintf(stderr, "%s : Counters with a 3 block delayed write: %ld free inodes (was %ld), %ld free blocks (was %ld).\n",
+            INTERFACE_LAYER_TEST, during.f_ffree, before.f_ffree, during.f_bfree, before.f_bfree);
+        return false;
+    }
+    if(!flush_delayed_blocks(name_i("/statfs_file"), NULL) || altfs_statfs(&during) != 0 ||
+        during.f_ffree != before.f_ffree - 1 || during.f_bfree != before.f_bfree - 3)
+    {
+        fprintf(stderr, "%s : Counters after creating a 3 block file: %ld free inodes (was %ld), %ld free blocks (was %ld).\n",
+            INTERFACE_LAYER_TEST, during.f_ffree, before.f_ffree, during.f_bfree, before.f_bfree);
+        return false;
+    }
+    struct statvfs after;
+    if(altfs_unlink("/statfs_file") != 0 || altfs_statfs(&after) != 0 ||
+        after.f_ffree != before.f_ffree || after.f_bfree != before.f_bfree)
+    {
+        fprintf(stderr, "%s : Counters not restored after unlink: %ld free inodes, %ld free blocks.\n", INTERFACE_LAYER_TEST, after.f_ffree, after.f_bfree);
+        return false;
+    }
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_allocation_groups()
+{
+    printf("\n########## %s : Testing allocation groups ##########\n", INTERFACE_LAYER_TEST);
+
+    // Directories made in the root directory go to different groups
+    printf("TEST 1\n");
+    if(!altfs_mkdir("/group_dir1", DEFAULT_PERMISSIONS) || !altfs_mkdir("/group_dir2", DEFAULT_PERMISSIONS))
+    {
+        fprintf(stderr, "%s : Failed to create the top level directories.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    ssize_t dir1_inum = name_i("/group_dir1");
+    ssize_t dir2_inum = name_i("/group_dir2");
+    if(dir1_inum <= 0 || dir2_inum <= 0 || INODE_TO_GROUP(dir1_inum) == INODE_TO_GROUP(dir2_inum))
+    {
+        fprintf(stderr, "%s : Top level directories %ld and %ld share a group.\n", INTERFACE_LAYER_TEST, dir1_inum, dir2_inum);
+        return false;
+    }
+    printf("\n");
+
+    // A file goes to its parent's group, and so do its data blocks
+    // (once the blocks the earlier tests freed in that group are committed and can be handed out again)
+    printf("TEST 2\n");
+    altfs_journal_commit();
+    char* buf = (char*) malloc(2 * BLOCK_SIZE);
+    memset(buf, 'g', 2 * BLOCK_SIZE);
+    bool created = altfs_mknod("/group_dir2/file", S_IFREG | 0775, -1);
+    ssize_t written = altfs_write("/group_dir2/file", buf, 2 * BLOCK_SIZE, 0);
+    altfs_free_memory(buf);
+    ssize_t file_inum = name_i("/group_dir2/file");
+    flush_delayed_blocks(file_inum, NULL);
+    if(!created || written != 2 * BLOCK_SIZE || file_inum <= 0 || INODE_TO_GROUP(file_inum) != INODE_TO_GROUP(dir2_inum))
+    {
+        fprintf(stderr, "%s : File %ld is not in the group of its directory %ld.\n", INTERFACE_LAYER_TEST, file_inum, dir2_inum);
+        return false;
+    }
+    struct inode* file_inode = get_inode(file_inum);
+    ssize_t first_block = file_inode->i_direct_blocks[0];
+    altfs_free_memory(file_inode);
+    if(BLOCK_TO_GROUP(first_block) != INODE_TO_GROUP(file_inum))
+    {
+        fprintf(stderr, "%s : Data block %ld of file %ld is in group %ld.\n", INTERFACE_LAYER_TEST, first_block, file_inum, BLOCK_TO_GROUP(first_block));
+        return false;
+    }
+    printf("\n");
+
+    // A freed block is not handed out again before the transaction that freed it commits
+    printf("TEST 3\n");
+    bool truncated = altfs_truncate("/group_dir2/file", 0) == 0;
+    pthread_mutex_lock(&freedLock);
+    expire_freed_blocks();
+    bool tracked = is_freed_uncommitted(first_block, false);
+    pthread_mutex_unlock(&freedLock);
+    if(!truncated || !tracked)
+    {
+        fprintf(stderr, "%s : Failed to truncate /group_dir2/file.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    ssize_t reused = allocate_data_block_near(first_block, 0);
+    if(reused <= 0 || reused == first_block)
+    {
+        fprintf(stderr, "%s : Block %ld handed out before its free was committed.\n", INTERFACE_LAYER_TEST, first_block);
+        return false;
+    }
+    free_data_block(reused);
+    bool committed = altfs_journal_commit();
+    pthread_mutex_lock(&freedLock);
+    expire_freed_blocks();
+    tracked = is_freed_uncommitted(first_block, false);
+    pthread_mutex_unlock(&freedLock);
+    if(!committed || tracked)
+    {
+        fprintf(stderr, "%s : Block %ld not free for use after the commit.\n", INTERFACE_LAYER_TEST, first_block);
+        return false;
+    }
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_delayed_allocation()
+{
+    printf("\n########## %s : Testing delayed allocation ##########\n", INTERFACE_LAYER_TEST);
+
+    // Small appends are buffered without allocating any block
+    printf("TEST 1\n");
+    ssize_t free_blocks = altfs_superblock->s_free_blocks_count;
+    char data[11] = "0123456789";
+    bool created = altfs_mknod("/delayed_file", S_IFREG | 0775, -1);
+    ssize_t inum = name_i("/delayed_file");
+    for(ssize_t i = 0; created && i < 1000; i++)
+    {
+        if(altfs_write("/delayed_file", data, 10, i * 10) != 10)
+        {
+            fprintf(stderr, "%s : Append %ld to /delayed_file failed.\n", INTERFACE_LAYER_TEST, i);
+            return false;
+        }
+    }
+    struct inode* node = get_inode(inum);
+    ssize_t blocks_on_disk = node->i_blocks_num;
+    altfs_free_memory(node);
+    struct stat* st = (struct stat*) malloc(sizeof(struct stat));
+    ssize_t res = altfs_getattr("/delayed_file", &st);
+    off_t size = st->st_size;
+    altfs_free_memory(st);
+    if(!created || blocks_on_disk != 0 || altfs_superblock->s_free_blocks_count != free_blocks || res != 0 || size != 10000)
+    {
+        fprintf(stderr, "%s : After buffered appends: %ld blocks on disk, %ld free blocks (was %ld), size %ld.\n",
+            INTERFACE_LAYER_TEST, blocks_on_disk, altfs_superblock->s_free_blocks_count, free_blocks, size);
+        return false;
+    }
+    printf("\n");
+
+    // Reading flushes the file, which gets consecutive blocks
+    printf("TEST 2\n");
+    char* buf = (char*) malloc(10000);
+    ssize_t read = altfs_read("/delayed_file", buf, 10000, 0);
+    bool same = read == 10000;
+    for(ssize_t i = 0; same && i < 1000; i++)
+        same = strncmp(buf + i * 10, data, 10) == 0;
+    altfs_free_memory(buf);
+    node = get_inode(inum);
+    bool contiguous = node->i_blocks_num == 3 && node->i_file_size == 10000 &&
+        node->i_direct_blocks[1] == node->i_direct_blocks[0] + 1 && node->i_direct_blocks[2] == node->i_direct_blocks[1] + 1;
+    altfs_free_memory(node);
+    if(!same || !contiguous || altfs_superblock->s_free_blocks_count != free_blocks - 3)
+    {
+        fprintf(stderr, "%s : Flushed file read %ld bytes (same: %d), contiguous blocks: %d.\n", INTERFACE_LAYER_TEST, read, same, contiguous);
+        return false;
+    }
+    altfs_unlink("/delayed_file");
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_write_buffer()
+{
+    printf("\n########## %s : Testing write buffers ##########\n", INTERFACE_LAYER_TEST);
+
+    // Small sequential writes through a handle stay in its buffer
+    printf("TEST 1\n");
+    char data[11] = "abcdefghij";
+    ssize_t inum = altfs_open("/buffered_file", O_CREAT | O_RDWR);
+    ssize_t handle = inum > 0 ? open_write_buffer(inum) : 0;
+    if(handle <= 0)
+    {
+        fprintf(stderr, "%s : Could not open /buffered_file with a write buffer.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    for(ssize_t i = 0; i < 100; i++)
+    {
+        if(buffered_write(handle, data, 10, i * 10) != 10)
+        {
+            fprintf(stderr, "%s : Buffered write %ld failed.\n", INTERFACE_LAYER_TEST, i);
+            return false;
+        }
+    }
+    struct inode* node = get_inode(inum);
+    ssize_t disk_size = node->i_file_size;
+    altfs_free_memory(node);
+    struct stat* st = (struct stat*) malloc(sizeof(struct stat));
+    altfs_getattr("/buffered_file", &st);
+    off_t size = st->st_size;
+    if(disk_size != 0 || size != 1000)
+    {
+        fprintf(stderr, "%s : Buffered file has size %ld on disk (should be 0), %ld in getattr (should be 1000).\n", INTERFACE_LAYER_TEST, disk_size, size);
+        altfs_free_memory(st);
+        return false;
+    }
+    printf("\n");
+
+    // A full buffer is written out once it reaches a block boundary; reads see buffered data
+    printf("TEST 2\n");
+    char* big_data = (char*) malloc(WRITE_BUFFER_SIZE);
+    memset(big_data, 'w', WRITE_BUFFER_SIZE);
+    ssize_t written = buffered_write(handle, big_data, WRITE_BUFFER_SIZE - 1000, 1000);
+    node = get_inode(inum);
+    disk_size = get_delayed_file_size(inum, node->i_file_size);
+    altfs_free_memory(node);
+    char* buf = (char*) malloc(1000);
+    ssize_t read = altfs_read("/buffered_file", buf, 1000, 0);
+    bool same = read == 1000 && strncmp(buf, data, 10) == 0 && strncmp(buf + 990, data, 10) == 0;
+    altfs_free_memory(buf);
+    altfs_free_memory(big_data);
+    if(written != WRITE_BUFFER_SIZE - 1000 || disk_size != WRITE_BUFFER_SIZE || !same)
+    {
+        fprintf(stderr, "%s : After filling the buffer: written %ld, size %ld, read back: %d.\n", INTERFACE_LAYER_TEST, written, disk_size, same);
+        return false;
+    }
+    printf("\n");
+
+    // Closing writes out the rest; a deleted file fails its handle
+    printf("TEST 3\n");
+    buffered_write(handle, data, 10, WRITE_BUFFER_SIZE);
+    if(altfs_close(handle) != 0 || altfs_getattr("/buffered_file", &st) != 0 || st->st_size != WRITE_BUFFER_SIZE + 10)
+    {
+        fprintf(stderr, "%s : Data not written out on close.\n", INTERFACE_LAYER_TEST);
+        altfs_free_memory(st);
+        return false;
+    }
+    altfs_free_memory(st);
+    handle = open_write_buffer(inum);
+    buffered_write(handle, data, 10, 0);
+    altfs_unlink("/buffered_file");
+    if(buffered_write(handle, data, 10, 10) != -ENOENT || altfs_close(handle) != 0)
+    {
+        fprintf(stderr, "%s : Handle of a deleted file still accepts writes.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_readahead()
+{
+    printf("\n########## %s : Testing readahead ##########\n", INTERFACE_LAYER_TEST);
+
+    // Reading a file block by block grows the window and fills the prefetch cache
+    printf("TEST 1\n");
+    ssize_t file_blocks = 40;
+    char* data = (char*) malloc(file_blocks * BLOCK_SIZE);
+    for(ssize_t i = 0; i < file_blocks; i++)
+        memset(data + i * BLOCK_SIZE, 'a' + i % 26, BLOCK_SIZE);
+    bool created = altfs_mknod("/readahead_file", S_IFREG | 0775, -1);
+    ssize_t inum = name_i("/readahead_file");
+    if(!created || altfs_write("/readahead_file", data, file_blocks * BLOCK_SIZE, 0) != file_blocks * BLOCK_SIZE)
+    {
+        fprintf(stderr, "%s : Could not write /readahead_file.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    char* buf = (char*) malloc(BLOCK_SIZE);
+    bool same = true;
+    for(ssize_t i = 0; same && i < 10; i++)
+        same = altfs_read("/readahead_file", buf, BLOCK_SIZE, i * BLOCK_SIZE) == BLOCK_SIZE && buf[0] == 'a' + i;
+    struct readahead_state* ra = get_readahead_state(inum);
+    if(!same || ra->inum != inum || ra->window < 2 * READAHEAD_MIN_BLOCKS || ra->ahead_until <= 10)
+    {
+        fprintf(stderr, "%s : After 10 sequential reads: same %d, window %ld, read ahead until %ld.\n",
+            INTERFACE_LAYER_TEST, same, ra->window, ra->ahead_until);
+        return false;
+    }
+    struct inode* node = get_inode(inum);
+    ssize_t prev_block = 0;
+    ssize_t dblock_num = get_disk_block_from_inode_block(node, 10, &prev_block);
+    altfs_free_memory(node);
+    struct prefetch_slot* slot = get_prefetch_slot(dblock_num);
+    for(ssize_t i = 0; i < 1000 && !(slot->blockid == dblock_num && slot->state == PREFETCH_VALID); i++)
+        usleep(1000);
+    if(slot->blockid != dblock_num || slot->state != PREFETCH_VALID || slot->data[0] != 'a' + 10)
+    {
+        fprintf(stderr, "%s : Block %ld was not read ahead.\n", INTERFACE_LAYER_TEST, dblock_num);
+        return false;
+    }
+    printf("\n");
+
+    // A write to a prefetched block is not hidden by the cache
+    printf("TEST 2\n");
+    memset(buf, 'z', BLOCK_SIZE);
+    altfs_write("/readahead_file", buf, BLOCK_SIZE, 10 * BLOCK_SIZE);
+    memset(buf, 0, BLOCK_SIZE);
+    if(altfs_read("/readahead_file", buf, BLOCK_SIZE, 10 * BLOCK_SIZE) != BLOCK_SIZE || buf[0] != 'z' || buf[BLOCK_SIZE - 1] != 'z')
+    {
+        fprintf(stderr, "%s : Read old contents of a block that was written after being read ahead.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    printf("\n");
+
+    // Random reads shrink the window until readahead stops
+    printf("TEST 3\n");
+    ssize_t window = ra->window;
+    altfs_read("/readahead_file", buf, BLOCK_SIZE, 30 * BLOCK_SIZE);
+    altfs_read("/readahead_file", buf, BLOCK_SIZE, 2 * BLOCK_SIZE);
+    altfs_read("/readahead_file", buf, BLOCK_SIZE, 20 * BLOCK_SIZE);
+    if(ra->window >= window || buf[0] != 'a' + 20)
+    {
+        fprintf(stderr, "%s : Window %ld after random reads (was %ld).\n", INTERFACE_LAYER_TEST, ra->window, window);
+        return false;
+    }
+    altfs_free_memory(buf);
+    altfs_free_memory(data);
+    altfs_unlink("/readahead_file");
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+bool test_orphans()
+{
+    printf("\n########## %s : Testing background deletion ##########\n", INTERFACE_LAYER_TEST);
+
+    // Unlinking a large file returns before its blocks are freed; the orphan thread frees them
+    printf("TEST 1\n");
+    ssize_t file_size = (ORPHAN_MIN_BLOCKS + 76) * BLOCK_SIZE;   // reaches into the double indirect blocks
+    char* data = (char*) calloc(1, file_size);
+    ssize_t free_blocks = altfs_superblock->s_free_blocks_count;
+    start_orphan_worker();
+    bool created = altfs_mknod("/orphan_file", S_IFREG | 0775, -1);
+    ssize_t inum = name_i("/orphan_file");
+    if(!created || altfs_write("/orphan_file", data, file_size, 0) != file_size || altfs_unlink("/orphan_file") != 0 || name_i("/orphan_file") != -1)
+    {
+        fprintf(stderr, "%s : Could not write and unlink /orphan_file.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    for(ssize_t i = 0; i < 5000 && altfs_superblock->s_orphans_count > 0; i++)
+        usleep(1000);
+    struct inode* node = get_inode(inum);
+    bool allocated = node->i_allocated;
+    altfs_free_memory(node);
+    if(altfs_superblock->s_orphans_count != 0 || allocated || altfs_superblock->s_free_blocks_count != free_blocks)
+    {
+        fprintf(stderr, "%s : After background deletion: %ld orphans, inode allocated: %d, %ld free blocks (was %ld).\n",
+            INTERFACE_LAYER_TEST, altfs_superblock->s_orphans_count, allocated, altfs_superblock->s_free_blocks_count, free_blocks);
+        return false;
+    }
+    printf("\n");
+
+    // Orphans are kept on disk while the thread is stopped, and freed once it starts again (as at mount)
+    printf("TEST 2\n");
+    stop_orphan_worker();
+    altfs_mknod("/orphan_file", S_IFREG | 0775, -1);
+    inum = name_i("/orphan_file");
+    altfs_write("/orphan_file", data, file_size, 0);
+    altfs_unlink("/orphan_file");
+    altfs_free_memory(data);
+    char buffer[BLOCK_SIZE];
+    altfs_read_block(0, buffer);
+    struct superblock* sb = (struct superblock*) buffer;
+    node = get_inode(inum);
+    bool orphaned = sb->s_orphans_count == 1 && sb->s_orphans[0] == inum && node->i_allocated && node->i_links_count == 0;
+    altfs_free_memory(node);
+    if(!orphaned)
+    {
+        fprintf(stderr, "%s : Unlinked inode %ld is not on the orphan list on disk.\n", INTERFACE_LAYER_TEST, inum);
+        return false;
+    }
+    start_orphan_worker();
+    for(ssize_t i = 0; i < 5000 && altfs_superblock->s_orphans_count > 0; i++)
+        usleep(1000);
+    if(altfs_superblock->s_orphans_count != 0 || altfs_superblock->s_free_blocks_count != free_blocks)
+    {
+        fprintf(stderr, "%s : Orphan not freed after restarting the thread: %ld free blocks (was %ld).\n",
+            INTERFACE_LAYER_TEST, altfs_superblock->s_free_blocks_count, free_blocks);
+        return false;
+    }
+    printf("\n");
+
+    // Orphans that find the list full are chained through their inodes on disk
+    printf("TEST 3\n");
+    stop_orphan_worker();
+    for(ssize_t i = 0; i < MAX_ORPHANS; i++)
+        altfs_superblock->s_orphans[i] = ROOT_INODE_NUM;    // dropped by the thread: not an orphan
+    altfs_superblock->s_orphans_count = MAX_ORPHANS;
+    data = (char*) calloc(1, file_size);
+    ssize_t chained[2];
+    for(ssize_t i = 0; i < 2; i++)
+    {
+        const char* path = i == 0 ? "/orphan_file" : "/orphan_file2";
+        altfs_mknod(path, S_IFREG | 0775, -1);
+        chained[i] = name_i(path);
+        altfs_write(path, data, file_size, 0);
+        if(altfs_unlink(path) != 0)
+        {
+            fprintf(stderr, "%s : Could not unlink %s.\n", INTERFACE_LAYER_TEST, path);
+            return false;
+        }
+    }
+    altfs_free_memory(data);
+    altfs_read_block(0, buffer);
+    struct inode* first = get_inode(chained[0]);
+    struct inode* second = get_inode(chained[1]);
+    bool linked = sb->s_orphans_count == MAX_ORPHANS && sb->s_orphan_chain == chained[1] &&
+        second->i_next_orphan == chained[0] && first->i_next_orphan == 0 && first->i_allocated && second->i_allocated;
+    altfs_free_memory(first);
+    altfs_free_memory(second);
+    if(!linked)
+    {
+        fprintf(stderr, "%s : Inodes %ld and %ld not chained on disk.\n", INTERFACE_LAYER_TEST, chained[0], chained[1]);
+        return false;
+    }
+    start_orphan_worker();
+    for(ssize_t i = 0; i < 5000 && (altfs_superblock->s_orphans_count > 0 || altfs_superblock->s_orphan_chain != 0); i++)
+        usleep(1000);
+    first = get_inode(chained[0]);
+    second = get_inode(chained[1]);
+    allocated = first->i_allocated || second->i_allocated;
+    altfs_free_memory(first);
+    altfs_free_memory(second);
+    if(altfs_superblock->s_orphans_count != 0 || altfs_superblock->s_orphan_chain != 0 || allocated ||
+        altfs_superblock->s_free_blocks_count != free_blocks)
+    {
+        fprintf(stderr, "%s : Chained orphans not freed: inode allocated: %d, %ld free blocks (was %ld).\n",
+            INTERFACE_LAYER_TEST, allocated, altfs_superblock->s_free_blocks_count, free_blocks);
+        return false;
+    }
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
+// Returns NULL if the sync succeeded.
+static void* run_sync(void* arg)
+{
+    return altfs_sync() == 0 ? NULL : (void*) 1;
+}
+
+bool test_fsync()
+{
+    printf("\n########## %s : Testing fsync durability modes ##########\n", INTERFACE_LAYER_TEST);
+
+    // Flush writes out the buffered data; without durability nothing is committed
+    printf("TEST 1\n");
+    char data[11] = "abcdefghij";
+    ssize_t inum = altfs_open("/synced_file", O_CREAT | O_RDWR);
+    ssize_t handle = inum > 0 ? open_write_buffer(inum) : 0;
+    if(handle <= 0 || buffered_write(handle, data, 10, 0) != 10 || altfs_flush("/synced_file", handle) != 0)
+    {
+        fprintf(stderr, "%s : Could not write and flush /synced_file.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    struct inode* node = get_inode(inum);
+    ssize_t disk_size = node->i_file_size;
+    altfs_free_memory(node);
+    altfs_set_durability(DURABILITY_NONE);
+    if(disk_size != 10 || altfs_sync() != 0 || journalCount == 0)
+    {
+        fprintf(stderr, "%s : After flush and sync without durability: size %ld, %ld blocks in the transaction.\n", INTERFACE_LAYER_TEST, disk_size, journalCount);
+        return false;
+    }
+    // The superblock with the new freelist heads is in the transaction with the blocks it describes.
+    struct superblock* logged_sb = (struct superblock*) (journalImages + (*find_journal_index(0) - 1) * BLOCK_SIZE);
+    if(*find_journal_index(0) == 0 || logged_sb->s_free_blocks_count != altfs_superblock->s_free_blocks_count)
+    {
+        fprintf(stderr, "%s : Superblock not logged with the allocation.\n", INTERFACE_LAYER_TEST);
+        return false;
+    }
+    printf("\n");
+
+    // Strict: the transaction is committed and the inode is home
+    printf("TEST 2\n");
+    altfs_set_durability(DURABILITY_STRICT);
+    char* buffer = (char*) malloc(BLOCK_SIZE);
+    ssize_t block_num = 1 + inum / (BLOCK_SIZE / INODE_SIZE);
+    struct inode* home = (struct inode*) (buffer + (inum % (BLOCK_SIZE / INODE_SIZE)) * INODE_SIZE);
+    if(altfs_sync() != 0 || journalCount != 0 || !read_block_from_volume(block_num, buffer) || home->i_file_size != 10)
+    {
+        fprintf(stderr, "%s : Strict sync left %ld blocks in the transaction.\n", INTERFACE_LAYER_TEST, journalCount);
+        altfs_free_memory(buffer);
+        return false;
+    }
+    altfs_free_memory(buffer);
+    printf("\n");
+
+    // Batched: syncs of several threads share the commit
+    printf("TEST 3\n");
+    altfs_set_durability(DURABILITY_BATCHED);
+    buffered_write(handle, data, 10, 10);
+    altfs_flush("/synced_file", handle);
+    pthread_t threads[4];
+    for(ssize_t i = 0; i < 4; i++)
+        pthread_create(&threads[i], NULL, run_sync, NULL);
+    bool synced = true;
+    for(ssize_t i = 0; i < 4; i++)
+    {
+        void* res;
+        pthread_join(threads[i], &res);
+        if(res != NULL)
+            synced = false;
+    }
+    altfs_set_durability(DURABILITY_STRICT);
+    if(!synced || journalCount != 0 || syncCompleted != syncRequested)
+    {
+        fprintf(stderr, "%s : Batched syncs failed or left %ld blocks in the transaction.\n", INTERFACE_LAYER_TEST, journalCount);
+        return false;
+    }
+    altfs_close(handle);
+
+    printf("########## %s : Done! ##########\n", INTERFACE_LAYER_TEST);
+    return true;
+}
+
 bool test_chmod()
 {
     printf("\n########## %s : Testing chmod() ##########\n", INTERFACE_LAYER_TEST);
@@ -1082,7 +1907,7 @@ int main()
     printf("Makefs complete!\n");
     #endif
 
-    if(!altfs_init())
+    if(!altfs_init(false))
     {
         fprintf(stderr, "Filesystem initialization failed!\n");
         return -1;
@@ -1143,11 +1968,59 @@ int main()
         return -1;
     }
 
-    // if(!test_rename())
-    // {
-    //     printf("%s : Testing altfs_rename() failed!\n", INTERFACE_LAYER_TEST);
-    //     return -1;
-    // }
+    if(!test_rename())
+    {
+        printf("%s : Testing altfs_rename() failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_readdir())
+    {
+        printf("%s : Testing altfs_readdir() failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_statfs())
+    {
+        printf("%s : Testing altfs_statfs() failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_allocation_groups())
+    {
+        printf("%s : Testing allocation groups failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_delayed_allocation())
+    {
+        printf("%s : Testing delayed allocation failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_write_buffer())
+    {
+        printf("%s : Testing write buffers failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_readahead())
+    {
+        printf("%s : Testing readahead failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_orphans())
+    {
+        printf("%s : Testing background deletion failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
+
+    if(!test_fsync())
+    {
+        printf("%s : Testing fsync failed!\n", INTERFACE_LAYER_TEST);
+        return -1;
+    }
 
     // if(!test_chmod())
     // {
@@ -42,36 +42,40 @@ unsigned long long get_num_of_free_blocks()
 {
     char *buffer = (char*)malloc(BLOCK_SIZE);
     // read block 0 = superblock
+    sync_superblock();
     if (!altfs_read_block(0, buffer))
     {
         fprintf(stderr, "Failed to read block 0 for superblock\n");
         return -1;
     }
     struct superblock *superblockObj = (struct superblock*)buffer;
-    altfs_free_memory(buffer);
-
-    unsigned long long nextfreeblock = superblockObj->s_freelist_head;
     unsigned long long num_of_free_blocks = 0;
 
-    while(nextfreeblock)
+    for(ssize_t group = 0; group < superblockObj->s_groups_count; group++)
     {
-        char *buff = (char*)malloc(BLOCK_SIZE);
-
-        if (!altfs_read_block(nextfreeblock, buff))
-        {
-            printf("Print freelist: Error reading contents of free list block \n");
-            return -1;
-        }
-
-        ssize_t *buff_numptr = (ssize_t *)buff;
-        nextfreeblock = buff_numptr[0]; 
-
-        for(int i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; i++)
+        unsigned long long nextfreeblock = superblockObj->s_groups[group].g_freelist_head;
+        while(nextfreeblock)
         {
-            if (buff_numptr[i] != 0)
-                num_of_free_blocks += 1;
+            char *buff = (char*)malloc(BLOCK_SIZE);
+
+            if (!altfs_read_block(nextfreeblock, buff))
+            {
+                printf("Print freelist: Error reading contents of free list block \n");
+                return -1;
+            }
+
+            ssize_t *buff_numptr = (ssize_t *)buff;
+            nextfreeblock = buff_numptr[0];
+
+            for(int i = 1; i < NUM_OF_ADDRESSES_PER_BLOCK; i++)
+            {
+                if (buff_numptr[i] != 0)
+                    num_of_free_blocks += 1;
+            }
+            altfs_free_memory(buff);
         }
     }
+    altfs_free_memory(buffer);
     return num_of_free_blocks;
 }
 
@@ -85,7 +89,7 @@ void print_constants()
 void print_superblock(struct superblock *superblockObj)
 {
     printf("\n******************** SUPERBLOCK ********************\n");
-    printf("\n NUM OF INODES: %ld \n NEXT AVAILABLE INODE: %ld \n FREE LIST HEAD: %ld \n INODES PER BLOCK: %ld \n", superblockObj->s_inodes_count, superblockObj->s_first_ino, superblockObj->s_freelist_head, superblockObj->s_num_of_inodes_per_block);
+    printf("\n NUM OF INODES: %ld \n NEXT AVAILABLE INODE: %ld \n ALLOCATION GROUPS: %ld \n GROUP 0 FREE LIST HEAD: %ld \n INODES PER BLOCK: %ld \n INODE SIZE: %ld \n LAYOUT VERSION: %ld \n", superblockObj->s_inodes_count, superblockObj->s_first_ino, superblockObj->s_groups_count, superblockObj->s_groups[0].g_freelist_head, superblockObj->s_num_of_inodes_per_block, superblockObj->s_inode_size, superblockObj->s_layout_version);
     printf("\n****************************************************\n");
     return;
 }